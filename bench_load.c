@@ -0,0 +1,938 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  End-to-End Load Generator Benchmark
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "settings.h"
+#include "framer.h"
+#include "histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*
+ * @brief The number of connections the benchmark opens, by default.
+*/
+#define BENCH_CONNECTIONS	100
+
+/*
+ * @brief The number of threads the connections are split between, by default.
+*/
+#define BENCH_THREADS		4
+
+/*
+ * @brief The number of messages every sending connection sends per second, by default.
+*/
+#define BENCH_RATE			10
+
+/*
+ * @brief The size of every message, in bytes and without its framing, by default.
+*/
+#define BENCH_SIZE			64
+
+/*
+ * @brief The smallest message size, which still fits the message's header.
+*/
+#define BENCH_MIN_SIZE		64
+
+/*
+ * @brief The fraction of the connections that send messages, by default - the rest only receive them.
+*/
+#define BENCH_SENDERS		0.1
+
+/*
+ * @brief How long the benchmark sends messages, in seconds, by default.
+*/
+#define BENCH_DURATION		10
+
+/*
+ * @brief How long the benchmark waits between connecting and sending, in milliseconds.
+ * @note The server adds a connection to its reactor only after accepting it, and a message sent
+ * 			before then never reaches it, so the benchmark gives the server time to catch up.
+*/
+#define BENCH_SETTLE		500
+
+/*
+ * @brief How long the benchmark keeps receiving after it stopped sending, in milliseconds.
+*/
+#define BENCH_DRAIN			1000
+
+/*
+ * @brief The largest number of messages the broadcast fan-out is tracked for.
+ * @note Every message takes a 16 byte slot, so this caps the tracking at 1 GB.
+*/
+#define BENCH_FANOUT_SLOTS	(1 << 26)
+
+/*
+ * @brief The results file the benchmark writes, by default.
+*/
+#define BENCH_RESULTS		"bench_results.txt"
+
+/*
+ * @brief The benchmark's options.
+*/
+typedef struct _bench_options
+{
+	// The server's address and port.
+	const char *host;
+	int port;
+
+	// The number of connections and threads.
+	size_t connections, threads;
+
+	// The messages every sender sends per second.
+	double rate;
+
+	// The size of every message, in bytes.
+	size_t size;
+
+	// The fraction of the connections that send.
+	double senders;
+
+	// How long the benchmark sends, in seconds.
+	double duration;
+
+	// How the messages are framed, the same as the server's framing.
+	framer_mode_t framing;
+
+	// The results file's path.
+	const char *output;
+} bench_options_t;
+
+/*
+ * @brief A benchmark connection.
+*/
+typedef struct _bench_conn
+{
+	// The connection's socket, -1 if it failed or was closed.
+	int fd;
+
+	// The connection's sender index, or SIZE_MAX if it only receives.
+	size_t sender;
+
+	// The sequence number of the next message the connection sends.
+	uint32_t seq;
+
+	// The message that's being sent, and how much of it was already sent.
+	char *out;
+	size_t out_len, out_off;
+
+	// The bytes received so far that aren't a whole message yet.
+	char *in;
+	size_t in_len;
+} bench_conn_t, *bench_conn_t_ptr;
+
+/*
+ * @brief A benchmark thread, and the counters of its connections.
+*/
+typedef struct _bench_thread
+{
+	// The thread.
+	pthread_t thread;
+
+	// The thread's connections, a contiguous slice of all the connections.
+	bench_conn_t_ptr conns;
+	size_t count;
+
+	// The thread's epoll instance.
+	int epoll_fd;
+
+	// When the thread finished connecting, in nanoseconds.
+	uint64_t connected_at;
+
+	// The number of connections that failed to connect, and that were closed during the run.
+	uint64_t connect_failed, disconnected;
+
+	// The number of messages sent and received, and of received messages that weren't the benchmark's.
+	uint64_t sent, received, foreign;
+
+	// The number of times a sender couldn't keep up with its rate, as its socket was full.
+	uint64_t send_blocked;
+
+	// The latency of every delivery, from the message's scheduled send to its arrival.
+	histogram_t latency;
+} bench_thread_t, *bench_thread_t_ptr;
+
+/*
+ * @brief The fan-out of a single message - how many connections got it, and when the last one did.
+*/
+typedef struct _bench_fanout
+{
+	// When the last connection got the message, in nanoseconds.
+	_Atomic uint64_t last;
+
+	// The number of connections that got the message.
+	_Atomic uint32_t count;
+} bench_fanout_t, *bench_fanout_t_ptr;
+
+/*
+ * @brief The benchmark's options.
+*/
+static bench_options_t options = {
+	.host = "127.0.0.1",
+	.port = SERVER_PORT,
+	.connections = BENCH_CONNECTIONS,
+	.threads = BENCH_THREADS,
+	.rate = BENCH_RATE,
+	.size = BENCH_SIZE,
+	.senders = BENCH_SENDERS,
+	.duration = BENCH_DURATION,
+	.framing = SERVER_FRAMING,
+	.output = BENCH_RESULTS
+};
+
+/*
+ * @brief The number of sending connections.
+*/
+static size_t sender_count = 0;
+
+/*
+ * @brief The most messages a single sender sends.
+*/
+static size_t sender_messages = 0;
+
+/*
+ * @brief The fan-out of every message, by sender and sequence number, or NULL if there are too many to track.
+*/
+static bench_fanout_t_ptr fanouts = NULL;
+
+/*
+ * @brief The barrier the threads wait on after connecting, and again before sending.
+*/
+static pthread_barrier_t barrier;
+
+/*
+ * @brief When the benchmark starts sending, in nanoseconds (see histogramClock()).
+*/
+static uint64_t bench_start = 0;
+
+/*
+ * @brief Get whether a connection sends messages.
+ * @param index The connection's index.
+ * @return The connection's sender index, or SIZE_MAX if it only receives.
+ * @note The senders are spread evenly across the connections, and so across the threads.
+*/
+static size_t bench_sender(size_t index) {
+	size_t before = (size_t)((double)index * options.senders), after = (size_t)((double)(index + 1) * options.senders);
+
+	return (after > before) ? after - 1 : SIZE_MAX;
+}
+
+/*
+ * @brief Get when a message is scheduled to be sent.
+ * @param sender The message's sender index.
+ * @param seq The message's sequence number.
+ * @return The time, in nanoseconds.
+ * @note Every sender sends at the same rate, but with its own phase, so they don't all send at once.
+ * 			A message's latency counts from its schedule, not from when it was sent, so a sender that was held
+ * 			back by a slow server still reports that delay (and doesn't hide it by sending less).
+*/
+static uint64_t bench_schedule(size_t sender, uint32_t seq) {
+	double phase = (double)sender / (double)sender_count;
+
+	return bench_start + (uint64_t)(((double)seq + 1.0 - phase) * 1e9 / options.rate);
+}
+
+/*
+ * @brief Get the size of a connection's receive buffer.
+ * @return The size, in bytes - room for at least two whole messages.
+*/
+static size_t bench_buffer_size(void) {
+	size_t size = 2 * (sizeof(uint32_t) + options.size + 1);
+
+	return (size < 65536) ? 65536 : size;
+}
+
+/*
+ * @brief Close a connection, after it failed or the server closed it.
+ * @param thread A pointer to the connection's thread.
+ * @param conn A pointer to the connection.
+ * @return void
+*/
+static void bench_close(bench_thread_t_ptr thread, bench_conn_t_ptr conn) {
+	if (conn->fd < 0)
+		return;
+
+	close(conn->fd);
+	conn->fd = -1;
+	thread->disconnected++;
+}
+
+/*
+ * @brief Connect a thread's connections to the server.
+ * @param thread A pointer to the thread.
+ * @return void
+*/
+static void bench_connect(bench_thread_t_ptr thread) {
+	struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)options.port) };
+	int nodelay = 1;
+
+	inet_pton(AF_INET, options.host, &addr.sin_addr);
+
+	for (size_t i = 0; i < thread->count; ++i)
+	{
+		bench_conn_t_ptr conn = (thread->conns + i);
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = conn };
+
+		if ((conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0 || connect(conn->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int)) < 0 ||
+			fcntl(conn->fd, F_SETFL, fcntl(conn->fd, F_GETFL) | O_NONBLOCK) < 0 || epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) < 0)
+		{
+			if (thread->connect_failed++ == 0)
+				fprintf(stderr, "%s Connecting to %s:%d failed: %s\n", C_PREFIX_ERROR, options.host, options.port, strerror(errno));
+
+			if (conn->fd >= 0)
+				close(conn->fd);
+
+			conn->fd = -1;
+		}
+	}
+
+	thread->connected_at = histogramClock();
+}
+
+/*
+ * @brief Build a sender's next message.
+ * @param conn A pointer to the sender's connection.
+ * @return void
+ * @note The message is text, "bench <sender> <seq> <schedule>" padded with 'x', so it passes through
+ * 			the server's sanitizer and printing untouched.
+*/
+static void bench_build(bench_conn_t_ptr conn) {
+	size_t header = (options.framing == FRAMER_MODE_LENGTH) ? sizeof(uint32_t) : 0;
+	char *body = conn->out + header;
+
+	memset(body, 'x', options.size);
+
+	int len = snprintf(body, options.size, "bench %zu %" PRIu32 " %" PRIu64 " ", conn->sender, conn->seq, bench_schedule(conn->sender, conn->seq));
+
+	// snprintf() terminated the text, the padding goes on right after it.
+	*(body + len) = 'x';
+
+	if (options.framing == FRAMER_MODE_LENGTH)
+	{
+		uint32_t length = htonl((uint32_t)options.size);
+
+		memcpy(conn->out, &length, sizeof(length));
+	}
+
+	else
+		*(body + options.size) = '\n';
+
+	conn->out_len = header + options.size + ((options.framing == FRAMER_MODE_NEWLINE) ? 1 : 0);
+	conn->out_off = 0;
+	conn->seq++;
+}
+
+/*
+ * @brief Send whatever is left of a connection's message.
+ * @param thread A pointer to the connection's thread.
+ * @param conn A pointer to the connection.
+ * @return true if the whole message was sent, false if the socket is full or was closed.
+*/
+static bool bench_flush(bench_thread_t_ptr thread, bench_conn_t_ptr conn) {
+	while (conn->out_off < conn->out_len)
+	{
+		ssize_t bytes = send(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (bytes < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				thread->send_blocked++;
+
+			else
+				bench_close(thread, conn);
+
+			return false;
+		}
+
+		conn->out_off += (size_t)bytes;
+	}
+
+	if (conn->out_len > 0)
+	{
+		thread->sent++;
+		conn->out_len = 0;
+	}
+
+	return true;
+}
+
+/*
+ * @brief Handle a single message a connection received.
+ * @param thread A pointer to the connection's thread.
+ * @param frame The message, without its framing.
+ * @param len The message's length.
+ * @param now When it was received, in nanoseconds.
+ * @return void
+*/
+static void bench_deliver(bench_thread_t_ptr thread, const char *frame, size_t len, uint64_t now) {
+	char header[BENCH_MIN_SIZE];
+	size_t sender = 0;
+	uint32_t seq = 0;
+	uint64_t schedule = 0;
+
+	if (len > sizeof(header) - 1)
+		len = sizeof(header) - 1;
+
+	memcpy(header, frame, len);
+	*(header + len) = '\0';
+
+	if (sscanf(header, "bench %zu %" SCNu32 " %" SCNu64 " ", &sender, &seq, &schedule) != 3 || sender >= sender_count || seq >= sender_messages)
+	{
+		thread->foreign++;
+		return;
+	}
+
+	thread->received++;
+	histogramRecord(&thread->latency, (now > schedule) ? now - schedule : 0);
+
+	if (fanouts != NULL)
+	{
+		bench_fanout_t_ptr fanout = (fanouts + sender * sender_messages + seq);
+		uint64_t last = atomic_load_explicit(&fanout->last, memory_order_relaxed);
+
+		while (now > last && !atomic_compare_exchange_weak_explicit(&fanout->last, &last, now, memory_order_relaxed, memory_order_relaxed));
+
+		atomic_fetch_add_explicit(&fanout->count, 1, memory_order_relaxed);
+	}
+}
+
+/*
+ * @brief Receive everything that's waiting on a connection, and handle every whole message.
+ * @param thread A pointer to the connection's thread.
+ * @param conn A pointer to the connection.
+ * @param cap The size of the connection's receive buffer.
+ * @return void
+*/
+static void bench_receive(bench_thread_t_ptr thread, bench_conn_t_ptr conn, size_t cap) {
+	while (conn->fd >= 0)
+	{
+		ssize_t bytes = recv(conn->fd, conn->in + conn->in_len, cap - conn->in_len, 0);
+
+		if (bytes <= 0)
+		{
+			if (bytes < 0 && errno == EINTR)
+				continue;
+
+			if (bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+				bench_close(thread, conn);
+
+			return;
+		}
+
+		uint64_t now = histogramClock();
+		size_t off = 0;
+
+		conn->in_len += (size_t)bytes;
+
+		while (off < conn->in_len)
+		{
+			char *frame = conn->in + off;
+			size_t left = conn->in_len - off, len = 0;
+
+			if (options.framing == FRAMER_MODE_NEWLINE)
+			{
+				char *end = memchr(frame, '\n', left);
+
+				if (end == NULL)
+					break;
+
+				len = (size_t)(end - frame);
+				off += len + 1;
+			}
+
+			else
+			{
+				uint32_t length = 0;
+
+				if (left < sizeof(length))
+					break;
+
+				memcpy(&length, frame, sizeof(length));
+				len = ntohl(length);
+
+				if (left < sizeof(length) + len)
+				{
+					// A message that can never fit is skipped, as it isn't one of the benchmark's.
+					if (sizeof(length) + len > cap)
+					{
+						thread->foreign++;
+						off = conn->in_len;
+					}
+
+					break;
+				}
+
+				frame += sizeof(length);
+				off += sizeof(length) + len;
+			}
+
+			bench_deliver(thread, frame, len, now);
+		}
+
+		// A full buffer without a whole message in it isn't one of the benchmark's messages either.
+		if (off == 0 && conn->in_len == cap)
+		{
+			thread->foreign++;
+			off = conn->in_len;
+		}
+
+		memmove(conn->in, conn->in + off, conn->in_len - off);
+		conn->in_len -= off;
+	}
+}
+
+/*
+ * @brief A benchmark thread - connect, wait for the others, then send and receive until the run is over.
+ * @param arg A pointer to the thread.
+ * @return NULL.
+*/
+static void *bench_thread(void *arg) {
+	bench_thread_t_ptr thread = (bench_thread_t_ptr)arg;
+	size_t cap = bench_buffer_size();
+	struct epoll_event events[256];
+
+	bench_connect(thread);
+
+	// Wait for everyone to connect, and again for the main thread to pick the start time.
+	pthread_barrier_wait(&barrier);
+	pthread_barrier_wait(&barrier);
+
+	uint64_t send_end = bench_start + (uint64_t)(options.duration * 1e9), end = send_end + (uint64_t)BENCH_DRAIN * 1000000;
+	uint64_t now = 0;
+
+	while ((now = histogramClock()) < end)
+	{
+		if (now < send_end)
+		{
+			double elapsed = (now > bench_start) ? (double)(now - bench_start) * options.rate / 1e9 : 0.0;
+
+			for (size_t i = 0; i < thread->count; ++i)
+			{
+				bench_conn_t_ptr conn = (thread->conns + i);
+
+				if (conn->sender == SIZE_MAX || conn->fd < 0)
+					continue;
+
+				// Send every message that's due, unless the socket is full.
+				size_t due = (size_t)(elapsed + (double)conn->sender / (double)sender_count);
+
+				if (due > sender_messages)
+					due = sender_messages;
+
+				while (bench_flush(thread, conn) && conn->seq < due)
+					bench_build(conn);
+			}
+		}
+
+		int ready = epoll_wait(thread->epoll_fd, events, sizeof(events) / sizeof(*events), 1);
+
+		for (int i = 0; i < ready; ++i)
+			bench_receive(thread, (bench_conn_t_ptr)(events + i)->data.ptr, cap);
+	}
+
+	for (size_t i = 0; i < thread->count; ++i)
+	{
+		if ((thread->conns + i)->fd >= 0)
+			close((thread->conns + i)->fd);
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief Print the benchmark's usage.
+ * @param program The program's name.
+ * @param stream The stream to print to.
+ * @return void
+*/
+static void bench_usage(const char *program, FILE *stream) {
+	fprintf(stream, "Usage: %s [options]\n"
+					"Open many connections to a running proactor_server, send messages on some of them, and measure\n"
+					"the connect rate, the message rate and the latency of every delivery and broadcast.\n\n"
+					"  -H, --host ADDR          the server's IPv4 address (default %s)\n"
+					"  -p, --port PORT          the server's port (default %d)\n"
+					"  -n, --connections N      the number of connections (default %d)\n"
+					"  -t, --threads N          the number of threads (default %d)\n"
+					"  -r, --rate N             the messages every sender sends per second (default %d)\n"
+					"  -s, --size BYTES         the size of every message (default %d, at least %d)\n"
+					"  -S, --senders FRACTION   the fraction of the connections that send (default %.2f)\n"
+					"  -d, --duration SECONDS   how long to send (default %d)\n"
+					"  -f, --framing MODE       newline or length, the same as the server's (default %s)\n"
+					"  -o, --output PATH        the results file (default %s)\n"
+					"  -h, --help               print this help\n",
+					program, options.host, SERVER_PORT, BENCH_CONNECTIONS, BENCH_THREADS, BENCH_RATE, BENCH_SIZE, BENCH_MIN_SIZE,
+					BENCH_SENDERS, BENCH_DURATION, (SERVER_FRAMING == FRAMER_MODE_LENGTH) ? "length" : "newline", BENCH_RESULTS);
+}
+
+/*
+ * @brief Parse the benchmark's command line into its options.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return 0 on success, 1 if the usage was printed, -1 on an invalid argument.
+*/
+static int bench_parse(int argc, char **argv) {
+	static const struct option long_options[] = {
+		{ "host", required_argument, NULL, 'H' },
+		{ "port", required_argument, NULL, 'p' },
+		{ "connections", required_argument, NULL, 'n' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "rate", required_argument, NULL, 'r' },
+		{ "size", required_argument, NULL, 's' },
+		{ "senders", required_argument, NULL, 'S' },
+		{ "duration", required_argument, NULL, 'd' },
+		{ "framing", required_argument, NULL, 'f' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int opt = 0;
+
+	while ((opt = getopt_long(argc, argv, "H:p:n:t:r:s:S:d:f:o:h", long_options, NULL)) != -1)
+	{
+		char *end = NULL;
+		double value = (opt != 'H' && opt != 'f' && opt != 'o' && opt != 'h' && opt != '?') ? strtod(optarg, &end) : 0.0;
+		bool valid = (end == NULL || (end != optarg && *end == '\0' && value >= 0 && value <= 1e9));
+
+		switch (opt)
+		{
+			case 'H':
+			{
+				struct in_addr addr;
+
+				options.host = optarg;
+				valid = (inet_pton(AF_INET, optarg, &addr) == 1);
+				break;
+			}
+
+			case 'p':
+				options.port = (int)value;
+				valid = valid && value >= 1 && value <= 65535;
+				break;
+
+			case 'n':
+				options.connections = (size_t)value;
+				valid = valid && value >= 2;
+				break;
+
+			case 't':
+				options.threads = (size_t)value;
+				valid = valid && value >= 1;
+				break;
+
+			case 'r':
+				options.rate = value;
+				valid = valid && value > 0;
+				break;
+
+			case 's':
+				options.size = (size_t)value;
+				valid = valid && value >= BENCH_MIN_SIZE && value <= SERVER_MAX_FRAME;
+				break;
+
+			case 'S':
+				options.senders = value;
+				valid = valid && value > 0 && value <= 1;
+				break;
+
+			case 'd':
+				options.duration = value;
+				valid = valid && value > 0;
+				break;
+
+			case 'f':
+				options.framing = (strcmp(optarg, "length") == 0) ? FRAMER_MODE_LENGTH : FRAMER_MODE_NEWLINE;
+				valid = (strcmp(optarg, "length") == 0 || strcmp(optarg, "newline") == 0);
+				break;
+
+			case 'o':
+				options.output = optarg;
+				break;
+
+			case 'h':
+				bench_usage(*argv, stdout);
+				return 1;
+
+			default:
+				bench_usage(*argv, stderr);
+				return -1;
+		}
+
+		if (!valid)
+		{
+			fprintf(stderr, "%s Invalid value \"%s\" for -%c.\n", C_PREFIX_ERROR, optarg, opt);
+			return -1;
+		}
+	}
+
+	if (optind < argc)
+	{
+		fprintf(stderr, "%s Unexpected argument \"%s\".\n", C_PREFIX_ERROR, *(argv + optind));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Print a latency histogram's percentiles, to the terminal and to the results file.
+ * @param out The terminal's stream.
+ * @param results The results file's stream.
+ * @param name The latency's name.
+ * @param snapshot A pointer to the histogram's merged snapshot.
+ * @return void
+*/
+static void bench_latency(FILE *out, FILE *results, const char *name, histogram_snapshot_t_ptr snapshot) {
+	uint64_t p50 = histogramPercentile(snapshot, 50.0), p90 = histogramPercentile(snapshot, 90.0);
+	uint64_t p99 = histogramPercentile(snapshot, 99.0), p999 = histogramPercentile(snapshot, 99.9);
+
+	fprintf(out, "%-10s %12" PRIu64 " %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, snapshot->count, (double)p50 / 1000.0, (double)p90 / 1000.0,
+					(double)p99 / 1000.0, (double)p999 / 1000.0, (double)snapshot->max / 1000.0);
+
+	fprintf(results, "%s_count=%" PRIu64 "\n%s_p50_ns=%" PRIu64 "\n%s_p90_ns=%" PRIu64 "\n%s_p99_ns=%" PRIu64 "\n%s_p999_ns=%" PRIu64 "\n%s_max_ns=%" PRIu64 "\n",
+					name, snapshot->count, name, p50, name, p90, name, p99, name, p999, name, snapshot->max);
+}
+
+int main(int argc, char **argv) {
+	int ret = bench_parse(argc, argv);
+
+	// The progress lines are interleaved with the threads' errors, so they're printed right away.
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if (ret != 0)
+		return (ret > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (options.threads > options.connections)
+		options.threads = options.connections;
+
+	sender_count = (size_t)((double)options.connections * options.senders);
+	sender_messages = (size_t)(options.rate * options.duration) + 1;
+
+	if (sender_count == 0)
+	{
+		fprintf(stderr, "%s No connection sends with a sender fraction of %.3f, raise it.\n", C_PREFIX_ERROR, options.senders);
+		return EXIT_FAILURE;
+	}
+
+	// Every connection is a file descriptor, so the limit is raised as far as it goes.
+	struct rlimit limit;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	bench_conn_t_ptr conns = (bench_conn_t_ptr)calloc(options.connections, sizeof(bench_conn_t));
+	bench_thread_t_ptr threads = (bench_thread_t_ptr)calloc(options.threads, sizeof(bench_thread_t));
+	size_t cap = bench_buffer_size();
+
+	if (conns == NULL || threads == NULL)
+	{
+		fprintf(stderr, "%s calloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (sender_count * sender_messages <= BENCH_FANOUT_SLOTS)
+		fanouts = (bench_fanout_t_ptr)calloc(sender_count * sender_messages, sizeof(bench_fanout_t));
+
+	if (fanouts == NULL)
+		fprintf(stderr, "%s Too many messages to track their fan-out, only the delivery latency is measured.\n", C_PREFIX_WARNING);
+
+	for (size_t i = 0; i < options.connections; ++i)
+	{
+		bench_conn_t_ptr conn = (conns + i);
+
+		conn->fd = -1;
+		conn->sender = bench_sender(i);
+		conn->in = (char *)malloc(cap);
+		conn->out = (conn->sender != SIZE_MAX) ? (char *)malloc(sizeof(uint32_t) + options.size + 1) : NULL;
+
+		if (conn->in == NULL || (conn->sender != SIZE_MAX && conn->out == NULL))
+		{
+			fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	fprintf(stdout, "%s Connecting %zu clients to %s:%d from %zu threads, %zu of them sending %.1f messages of %zu bytes per second for %.1f seconds.\n",
+					C_PREFIX_INFO, options.connections, options.host, options.port, options.threads, sender_count, options.rate,
+					options.size, options.duration);
+
+	pthread_barrier_init(&barrier, NULL, (unsigned int)options.threads + 1);
+
+	uint64_t connect_start = histogramClock(), connect_end = connect_start;
+
+	for (size_t i = 0, first = 0; i < options.threads; ++i)
+	{
+		bench_thread_t_ptr thread = (threads + i);
+		size_t count = options.connections / options.threads + ((i < options.connections % options.threads) ? 1 : 0);
+
+		thread->conns = (conns + first);
+		thread->count = count;
+		first += count;
+
+		if ((thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0 || pthread_create(&thread->thread, NULL, bench_thread, thread) != 0)
+		{
+			fprintf(stderr, "%s Starting benchmark thread %zu failed: %s\n", C_PREFIX_ERROR, i, strerror(errno));
+			return EXIT_FAILURE;
+		}
+	}
+
+	pthread_barrier_wait(&barrier);
+
+	uint64_t connect_failed = 0;
+
+	for (size_t i = 0; i < options.threads; ++i)
+	{
+		if ((threads + i)->connected_at > connect_end)
+			connect_end = (threads + i)->connected_at;
+
+		connect_failed += (threads + i)->connect_failed;
+	}
+
+	size_t connected = options.connections - (size_t)connect_failed;
+	double connect_seconds = (double)(connect_end - connect_start) / 1e9;
+
+	fprintf(stdout, "%s Connected %zu of %zu clients in %.3f seconds (%.0f connections per second).\n",
+					C_PREFIX_INFO, connected, options.connections, connect_seconds, (double)connected / connect_seconds);
+
+	if (connected < 2)
+	{
+		fprintf(stderr, "%s At least 2 clients must connect, is the server running?\n", C_PREFIX_ERROR);
+		return EXIT_FAILURE;
+	}
+
+	// Give the server time to add every connection before anything is sent.
+	bench_start = histogramClock() + (uint64_t)BENCH_SETTLE * 1000000;
+	pthread_barrier_wait(&barrier);
+
+	for (size_t i = 0; i < options.threads; ++i)
+	{
+		pthread_join((threads + i)->thread, NULL);
+		close((threads + i)->epoll_fd);
+	}
+
+	pthread_barrier_destroy(&barrier);
+
+	// Merge the threads' counters and histograms.
+	static histogram_snapshot_t delivery, fanout;
+	uint64_t sent = 0, received = 0, foreign = 0, send_blocked = 0, disconnected = 0, fanout_incomplete = 0;
+	histogram_t fanout_histogram;
+
+	memset(&fanout_histogram, 0, sizeof(histogram_t));
+
+	for (size_t i = 0; i < options.threads; ++i)
+	{
+		bench_thread_t_ptr thread = (threads + i);
+
+		sent += thread->sent;
+		received += thread->received;
+		foreign += thread->foreign;
+		send_blocked += thread->send_blocked;
+		disconnected += thread->disconnected;
+		histogramMerge(&delivery, &thread->latency);
+	}
+
+	// A broadcast's fan-out latency is from its schedule to its last delivery, for the broadcasts that reached everyone.
+	if (fanouts != NULL)
+	{
+		for (size_t sender = 0; sender < sender_count; ++sender)
+		{
+			for (size_t seq = 0; seq < sender_messages; ++seq)
+			{
+				bench_fanout_t_ptr slot = (fanouts + sender * sender_messages + seq);
+				uint32_t count = atomic_load_explicit(&slot->count, memory_order_relaxed);
+				uint64_t schedule = bench_schedule(sender, (uint32_t)seq), last = atomic_load_explicit(&slot->last, memory_order_relaxed);
+
+				if (count == 0)
+					continue;
+
+				if (count < connected - 1)
+					fanout_incomplete++;
+
+				else
+					histogramRecord(&fanout_histogram, (last > schedule) ? last - schedule : 0);
+			}
+		}
+
+		histogramMerge(&fanout, &fanout_histogram);
+	}
+
+	uint64_t expected = sent * (uint64_t)(connected - 1);
+
+	FILE *results = fopen(options.output, "w");
+
+	if (results == NULL)
+	{
+		fprintf(stderr, "%s fopen() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stdout, "%s Sent %" PRIu64 " messages (%.1f per second), %" PRIu64 " deliveries of %" PRIu64 " expected (%.1f per second, %.2f%%).\n",
+					C_PREFIX_INFO, sent, (double)sent / options.duration, received, expected, (double)received / options.duration,
+					(expected > 0) ? (double)received * 100.0 / (double)expected : 0.0);
+
+	if (send_blocked > 0 || disconnected > 0 || foreign > 0 || fanout_incomplete > 0)
+		fprintf(stdout, "%s %" PRIu64 " blocked sends, %" PRIu64 " disconnects, %" PRIu64 " foreign messages, %" PRIu64 " broadcasts that didn't reach everyone.\n",
+						C_PREFIX_WARNING, send_blocked, disconnected, foreign, fanout_incomplete);
+
+	fprintf(results, "connections=%zu\nthreads=%zu\nsenders=%zu\nrate=%.1f\nsize=%zu\nduration_s=%.1f\nframing=%s\n",
+					options.connections, options.threads, sender_count, options.rate, options.size, options.duration,
+					(options.framing == FRAMER_MODE_LENGTH) ? "length" : "newline");
+	fprintf(results, "connected=%zu\nconnect_failed=%" PRIu64 "\nconnect_s=%.6f\nconnect_per_sec=%.1f\n",
+					connected, connect_failed, connect_seconds, (double)connected / connect_seconds);
+	fprintf(results, "sent=%" PRIu64 "\nsent_per_sec=%.1f\nsend_blocked=%" PRIu64 "\nexpected=%" PRIu64 "\ndelivered=%" PRIu64 "\ndelivered_per_sec=%.1f\n",
+					sent, (double)sent / options.duration, send_blocked, expected, received, (double)received / options.duration);
+	fprintf(results, "delivery_ratio=%.6f\ndisconnected=%" PRIu64 "\nforeign=%" PRIu64 "\nfanout_incomplete=%" PRIu64 "\n",
+					(expected > 0) ? (double)received / (double)expected : 0.0, disconnected, foreign, fanout_incomplete);
+
+	fprintf(stdout, "%-10s %12s %10s %10s %10s %10s %10s\n", "latency", "count", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+	bench_latency(stdout, results, "delivery", &delivery);
+	bench_latency(stdout, results, "fanout", &fanout);
+
+	fclose(results);
+	fprintf(stdout, "%s Results written to %s.\n", C_PREFIX_INFO, options.output);
+
+	for (size_t i = 0; i < options.connections; ++i)
+	{
+		free((conns + i)->in);
+		free((conns + i)->out);
+	}
+
+	free(fanouts);
+	free(threads);
+	free(conns);
+
+	return EXIT_SUCCESS;
+}
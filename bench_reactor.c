@@ -0,0 +1,401 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Reactor Dispatch Benchmark
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "reactor.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * @brief The largest number of file descriptors registered in the reactor, by default.
+*/
+#define BENCH_MAX_FDS		16384
+
+/*
+ * @brief The smallest number of file descriptors registered in the reactor - every run has 4 times as many as the last one.
+*/
+#define BENCH_MIN_FDS		256
+
+/*
+ * @brief The fraction of the file descriptors that are triggered every round, by default.
+ * @note Every number of file descriptors is also run with a single one triggered per round,
+ * 			which is the bare cost of a wakeup.
+*/
+#define BENCH_FRACTION		0.01
+
+/*
+ * @brief How long every run lasts, at least, in milliseconds.
+*/
+#define BENCH_RUN_TIME		250
+
+/*
+ * @brief The number of rounds every run has, at least.
+*/
+#define BENCH_MIN_ROUNDS	20
+
+/*
+ * @brief The backends the benchmark runs, unless REACTOR_BACKEND picks one.
+*/
+static const reactor_backend_t bench_backends[] = { REACTOR_BACKEND_POLL, REACTOR_BACKEND_EPOLL, REACTOR_BACKEND_URING };
+
+/*
+ * @brief The number of handler calls so far, written by the reactor's thread and read by the main thread.
+*/
+static _Atomic uint64_t dispatched = 0;
+
+/*
+ * @brief The results of a single run.
+*/
+typedef struct _bench_result
+{
+	// The time it took to register every file descriptor, in nanoseconds per file descriptor.
+	double add_ns;
+
+	// The number of rounds.
+	uint64_t rounds;
+
+	// The time of every round, from triggering the file descriptors until all their handlers were called, in microseconds.
+	double round_us;
+
+	// The number of handler calls per second, and the time of each, in nanoseconds.
+	double dispatch_rate, dispatch_ns;
+} bench_result_t;
+
+/*
+ * @brief Get the time of the monotonic clock.
+ * @return The time, in nanoseconds.
+*/
+static uint64_t bench_now(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * @brief Get the name of a reactor backend.
+ * @param backend The backend.
+ * @return The backend's name.
+*/
+static const char *bench_backend_name(reactor_backend_t backend) {
+	return (backend == REACTOR_BACKEND_URING ? "io_uring" : (backend == REACTOR_BACKEND_EPOLL ? "epoll" : "poll"));
+}
+
+/*
+ * @brief The handler of every benchmark file descriptor - read the byte it was triggered with, and count the call.
+ * @param fd The file descriptor.
+ * @param react A pointer to the reactor object.
+ * @return The reactor, or NULL if the file descriptor failed.
+*/
+static void *bench_handler(int fd, void *react) {
+	char buf[64];
+	ssize_t bytes = reactorRecv(react, fd, buf, sizeof(buf));
+
+	if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+		return NULL;
+
+	atomic_fetch_add_explicit(&dispatched, 1, memory_order_release);
+
+	return react;
+}
+
+/*
+ * @brief Run a single dispatch benchmark - a number of registered file descriptors, of which some are triggered every round.
+ * @param backend The reactor's backend.
+ * @param count The number of file descriptors to register, which must be even.
+ * @param active The number of file descriptors to trigger every round.
+ * @param result A pointer to the result.
+ * @return 0 on success, 1 otherwise.
+ * @note Every file descriptor is one end of a socketpair, and both ends are registered, so a byte written
+ * 			to one end triggers the other. Every round triggers the next active file descriptors, in turn.
+*/
+static int bench_run(reactor_backend_t backend, size_t count, size_t active, bench_result_t *result) {
+	int *fds = (int *)malloc(count * sizeof(int));
+	void *react = createReactorBackend(backend);
+
+	if (fds == NULL || react == NULL)
+	{
+		fprintf(stderr, "%s Creating the benchmark's reactor failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		free(fds);
+
+		if (react != NULL)
+			destroyReactor(react);
+
+		return 1;
+	}
+
+	for (size_t i = 0; i < count; i += 2)
+	{
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, (fds + i)) < 0)
+		{
+			fprintf(stderr, "%s socketpair() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+
+			for (size_t j = 0; j < i; ++j)
+				close(*(fds + j));
+
+			free(fds);
+			destroyReactor(react);
+			return 1;
+		}
+	}
+
+	uint64_t start = bench_now();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (addFd(react, *(fds + i), bench_handler) < 0)
+		{
+			fprintf(stderr, "%s addFd() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+
+			// The reactor closes the file descriptors it has, the rest are closed here.
+			for (size_t j = i; j < count; ++j)
+				close(*(fds + j));
+
+			free(fds);
+			destroyReactor(react);
+			return 1;
+		}
+	}
+
+	result->add_ns = (double)(bench_now() - start) / (double)count;
+
+	atomic_store(&dispatched, 0);
+	startReactor(react);
+
+	uint64_t target = 0, rounds = 0, deadline = 0;
+	size_t next = 0;
+
+	start = bench_now();
+	deadline = start + (uint64_t)BENCH_RUN_TIME * 1000000;
+
+	while (rounds < BENCH_MIN_ROUNDS || bench_now() < deadline)
+	{
+		// Trigger the next file descriptors, by writing to their partners (i ^ 1 is the other end of i's pair).
+		for (size_t i = 0; i < active; ++i, next = (next + 1) % count)
+		{
+			if (write(*(fds + (next ^ 1)), "x", 1) != 1)
+			{
+				fprintf(stderr, "%s write() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+				stopReactor(react);
+				destroyReactor(react);
+				free(fds);
+				return 1;
+			}
+		}
+
+		target += active;
+
+		// Wait until every triggered file descriptor was dispatched, yielding the CPU to the reactor meanwhile.
+		while (atomic_load_explicit(&dispatched, memory_order_acquire) < target)
+			sched_yield();
+
+		rounds++;
+	}
+
+	uint64_t elapsed = bench_now() - start;
+
+	result->rounds = rounds;
+	result->round_us = (double)elapsed / (double)rounds / 1000.0;
+	result->dispatch_rate = (double)target * 1e9 / (double)elapsed;
+	result->dispatch_ns = (double)elapsed / (double)target;
+
+	// The reactor closes every file descriptor it has, which are all of them.
+	stopReactor(react);
+	destroyReactor(react);
+	free(fds);
+
+	return 0;
+}
+
+/*
+ * @brief Print the benchmark's usage.
+ * @param program The program's name.
+ * @param stream The stream to print to.
+ * @return void
+*/
+static void bench_usage(const char *program, FILE *stream) {
+	fprintf(stream, "Usage: %s [max fds] [fraction]\n"
+					"Register up to [max fds] file descriptors in a reactor (%d to %d by default, 4 times as many every run),\n"
+					"trigger 1 or a [fraction] of them (0 to 1, default %.2f) every round, and measure the dispatch cost.\n"
+					"Set REACTOR_BACKEND to poll, epoll or uring to run a single backend (all of them by default).\n",
+					program, BENCH_MIN_FDS, BENCH_MAX_FDS, BENCH_FRACTION);
+}
+
+/*
+ * @brief Parse the benchmark's command line and environment.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @param max_fds A pointer to where to store the largest number of file descriptors.
+ * @param fraction A pointer to where to store the fraction of file descriptors triggered every round.
+ * @return 0 on success, 1 if the usage was printed, -1 on an invalid argument.
+*/
+static int bench_parse(int argc, char **argv, size_t *max_fds, double *fraction) {
+	const char *env = getenv("REACTOR_BACKEND");
+	char *end = NULL;
+
+	if (argc > 1 && (strcmp(*(argv + 1), "-h") == 0 || strcmp(*(argv + 1), "--help") == 0))
+	{
+		bench_usage(*argv, stdout);
+		return 1;
+	}
+
+	if (argc > 3)
+	{
+		fprintf(stderr, "%s Unexpected argument \"%s\".\n", C_PREFIX_ERROR, *(argv + 3));
+		bench_usage(*argv, stderr);
+		return -1;
+	}
+
+	if (argc > 1)
+	{
+		errno = 0;
+		*max_fds = (size_t)strtoul(*(argv + 1), &end, 10);
+
+		if (end == *(argv + 1) || *end != '\0' || errno != 0 || **(argv + 1) == '-' || *max_fds < BENCH_MIN_FDS)
+		{
+			fprintf(stderr, "%s Invalid number of file descriptors \"%s\", must be at least %d.\n", C_PREFIX_ERROR, *(argv + 1), BENCH_MIN_FDS);
+			bench_usage(*argv, stderr);
+			return -1;
+		}
+	}
+
+	if (argc > 2)
+	{
+		*fraction = strtod(*(argv + 2), &end);
+
+		if (end == *(argv + 2) || *end != '\0' || !(*fraction > 0.0 && *fraction <= 1.0))
+		{
+			fprintf(stderr, "%s Invalid fraction \"%s\", must be above 0 and at most 1.\n", C_PREFIX_ERROR, *(argv + 2));
+			bench_usage(*argv, stderr);
+			return -1;
+		}
+	}
+
+	if (env != NULL && strcmp(env, "poll") != 0 && strcmp(env, "epoll") != 0 && strcmp(env, "uring") != 0)
+	{
+		fprintf(stderr, "%s Invalid REACTOR_BACKEND \"%s\", must be poll, epoll or uring.\n", C_PREFIX_ERROR, env);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	size_t max_fds = BENCH_MAX_FDS;
+	double fraction = BENCH_FRACTION;
+	const char *env = getenv("REACTOR_BACKEND");
+	struct rlimit limit;
+	int ret = bench_parse(argc, argv, &max_fds, &fraction);
+
+	if (ret != 0)
+		return (ret > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	// Every registered file descriptor is a socket, so the limit is raised as far as it goes, and the runs are capped by it.
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		if (limit.rlim_cur < limit.rlim_max)
+		{
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+
+		if (limit.rlim_cur != RLIM_INFINITY && max_fds > (size_t)limit.rlim_cur - 64)
+		{
+			max_fds = (size_t)limit.rlim_cur - 64;
+			fprintf(stderr, "%s The file descriptor limit caps the benchmark at %zu file descriptors, raise it with \"ulimit -n\".\n",
+							C_PREFIX_WARNING, max_fds);
+		}
+	}
+
+	// Both ends of every socketpair are registered, so the number of file descriptors is even.
+	max_fds &= ~(size_t)1;
+
+	// The reactor's messages would only clutter the table, so it goes to a copy of stdout.
+	FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+
+	if (out == NULL || freopen("/dev/null", "w", stdout) == NULL)
+		return EXIT_FAILURE;
+
+	setvbuf(out, NULL, _IOLBF, 0);
+	setLogLevel(LOG_LEVEL_WARNING);
+
+	fprintf(out, "%s Dispatching %d ms per run, with 1 file descriptor or %.2f%% of them triggered per round.\n",
+					C_PREFIX_INFO, BENCH_RUN_TIME, fraction * 100.0);
+	fprintf(out, "%10s %8s %8s %12s %10s %12s %14s %14s\n", "backend", "fds", "active", "addFd ns", "rounds", "round us", "dispatch/s", "dispatch ns");
+
+	for (size_t b = 0; b < sizeof(bench_backends) / sizeof(*bench_backends); ++b)
+	{
+		reactor_backend_t backend = *(bench_backends + b);
+
+		if (env != NULL && strcmp(env, (backend == REACTOR_BACKEND_URING ? "uring" : bench_backend_name(backend))) != 0)
+			continue;
+
+		// io_uring falls back to epoll when the kernel doesn't have it, which was already measured.
+		if (backend == REACTOR_BACKEND_URING)
+		{
+			void *react = createReactorBackend(backend);
+			bool available = (react != NULL && ((reactor_t_ptr)react)->backend == REACTOR_BACKEND_URING);
+
+			if (react != NULL)
+				destroyReactor(react);
+
+			if (!available)
+			{
+				fprintf(out, "%10s %s\n", bench_backend_name(backend), "not available on this kernel, skipped");
+				continue;
+			}
+		}
+
+		for (size_t count = BENCH_MIN_FDS; count <= max_fds; count *= 4)
+		{
+			size_t actives[2] = { 1, (size_t)((double)count * fraction) };
+
+			for (size_t i = 0; i < 2; ++i)
+			{
+				bench_result_t result = { 0 };
+
+				if ((i > 0 && *(actives + i) <= *actives) || bench_run(backend, count, *(actives + i), &result) != 0)
+					continue;
+
+				fprintf(out, "%10s %8zu %8zu %12.1f %10" PRIu64 " %12.2f %14.0f %14.1f\n", bench_backend_name(backend), count, *(actives + i),
+								result.add_ns, result.rounds, result.round_us, result.dispatch_rate, result.dispatch_ns);
+			}
+
+			// The last run is always at the largest number of file descriptors.
+			if (count < max_fds && count * 4 > max_fds)
+				count = max_fds / 4;
+		}
+	}
+
+	fprintf(out, "%s \"round us\" with 1 active file descriptor is the cost of a wakeup - it grows with the number of file descriptors\n"
+					"%s when the backend scans all of them (poll), and stays flat when it only reports the ready ones (epoll, io_uring).\n",
+					C_PREFIX_INFO, C_PREFIX_INFO);
+
+	fclose(out);
+
+	return EXIT_SUCCESS;
+}
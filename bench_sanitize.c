@@ -0,0 +1,169 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Message Sanitizer Benchmark
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "settings.h"
+#include "sanitizer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief The number of bytes every kernel scans for every message size.
+*/
+#define BENCH_BYTES			(256 * 1024 * 1024)
+
+/*
+ * @brief On average, one byte in this many starts an arrow key sequence.
+*/
+#define BENCH_SEQUENCE_RATE	256
+
+/*
+ * @brief The message sizes the benchmark runs, in bytes.
+*/
+static const size_t bench_sizes[] = { 16, 64, 256, MAX_BUFFER, 65536, 1048576 };
+
+/*
+ * @brief A kernel under test.
+*/
+typedef struct _bench_kernel
+{
+	// The kernel's name.
+	const char *name;
+
+	// The kernel.
+	sanitizer_t kernel;
+} bench_kernel_t;
+
+/*
+ * @brief The kernels the benchmark compares, the first one is the reference.
+*/
+static const bench_kernel_t bench_kernels[] = {
+	{ "scalar", sanitizeArrowKeysScalar },
+	{ "sse2", sanitizeArrowKeysSSE2 },
+	{ "avx2", sanitizeArrowKeysAVX2 }
+};
+
+/*
+ * @brief Get the time of the monotonic clock, in seconds.
+ * @return The time, in seconds.
+*/
+static double bench_time(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/*
+ * @brief Fill a buffer with printable text, with an arrow key sequence every BENCH_SEQUENCE_RATE bytes on average
+ * 			(and a few lone ESC and ESC [ bytes, which must be left alone).
+ * @param buf The buffer.
+ * @param len The size of the buffer.
+ * @return void
+*/
+static void bench_fill(char *buf, size_t len) {
+	for (size_t i = 0; i < len; ++i)
+	{
+		int r = rand();
+
+		if (r % BENCH_SEQUENCE_RATE == 0 && i + 2 < len)
+		{
+			*(buf + i) = 0x1b;
+			*(buf + i + 1) = 0x5b;
+			*(buf + i + 2) = (char)(0x41 + (r / BENCH_SEQUENCE_RATE) % 5);		// 'E' is not an arrow key.
+			i += 2;
+		}
+
+		else if (r % BENCH_SEQUENCE_RATE == 1)
+			*(buf + i) = 0x1b;
+
+		else
+			*(buf + i) = (char)(0x20 + r % 95);
+	}
+}
+
+int main(void) {
+	size_t kernels = sizeof(bench_kernels) / sizeof(*bench_kernels);
+
+	srand(4);
+
+	fprintf(stdout, "%s Scanning %d MB per message size and kernel, the server uses the %s kernel.\n",
+					C_PREFIX_INFO, BENCH_BYTES / (1024 * 1024), sanitizerKernelName());
+	fprintf(stdout, "%10s %10s %12s %10s\n", "size", "kernel", "MB/s", "speedup");
+
+	for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(*bench_sizes); ++s)
+	{
+		size_t size = *(bench_sizes + s);
+		size_t rounds = BENCH_BYTES / size;
+		char *source = (char *)malloc(size), *work = (char *)malloc(size), *reference = (char *)malloc(size);
+		double scalar_rate = 0.0;
+
+		if (source == NULL || work == NULL || reference == NULL)
+		{
+			fprintf(stderr, "%s malloc() failed\n", C_PREFIX_ERROR);
+			free(source);
+			free(work);
+			free(reference);
+			return EXIT_FAILURE;
+		}
+
+		bench_fill(source, size);
+		memcpy(reference, source, size);
+		bench_kernels->kernel(reference, size);
+
+		for (size_t k = 0; k < kernels; ++k)
+		{
+			const bench_kernel_t *kernel = (bench_kernels + k);
+
+			// Every kernel must blank out exactly what the scalar one does.
+			memcpy(work, source, size);
+			kernel->kernel(work, size);
+
+			if (memcmp(work, reference, size) != 0)
+			{
+				fprintf(stderr, "%s The %s kernel disagrees with the scalar one on %zu bytes.\n", C_PREFIX_ERROR, kernel->name, size);
+				free(source);
+				free(work);
+				free(reference);
+				return EXIT_FAILURE;
+			}
+
+			// The sequences are blanked out by the first round, so the rest of them only scan -
+			// which is what the server does with almost every message.
+			double start = bench_time();
+
+			for (size_t r = 0; r < rounds; ++r)
+				kernel->kernel(work, size);
+
+			double rate = ((double)rounds * (double)size / (1024.0 * 1024.0)) / (bench_time() - start);
+
+			if (k == 0)
+				scalar_rate = rate;
+
+			fprintf(stdout, "%10zu %10s %12.1f %9.2fx\n", size, kernel->name, rate, rate / scalar_rate);
+		}
+
+		free(source);
+		free(work);
+		free(reference);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,473 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Proactor Zero-Copy Benchmark
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "proactor.h"
+#include "reactor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * @brief The number of client connections the broadcasts fan out to, by default.
+*/
+#define BENCH_CLIENTS		8
+
+/*
+ * @brief The number of bytes every client receives for every message size and mode.
+*/
+#define BENCH_BYTES_PER_CLIENT	(64 * 1024 * 1024)
+
+/*
+ * @brief The message sizes the benchmark runs, in bytes.
+*/
+static const size_t bench_sizes[] = { 1024, 4096, 16384, 65536, 262144, 1048576 };
+
+/*
+ * @brief A benchmark client - the receiving end of a connection, drained by its own thread.
+*/
+typedef struct _bench_client
+{
+	// The client's socket.
+	int fd;
+
+	// The server's end of the connection, which is added to the proactor.
+	int server_fd;
+
+	// The client's reader thread.
+	pthread_t thread;
+
+	// The number of bytes the client received so far.
+	_Atomic uint64_t received;
+} bench_client_t, *bench_client_t_ptr;
+
+/*
+ * @brief The results of a single run.
+*/
+typedef struct _bench_result
+{
+	// The wall clock time of the run, in seconds.
+	double seconds;
+
+	// The CPU time the process used during the run, in seconds.
+	double cpu_seconds;
+
+	// The CPU time the reactor's thread used during the run, in seconds.
+	double reactor_cpu_seconds;
+
+	// The number of zero-copy sends, and how many of them the kernel copied anyway.
+	uint64_t zc_sends, zc_copied;
+
+	// The number of messages dropped on full queues, should always be 0.
+	uint64_t dropped;
+} bench_result_t;
+
+/*
+ * @brief The proactor of the current run, for the reactor's error queue handler.
+*/
+static PProactor bench_proactor = NULL;
+
+/*
+ * @brief Get the time of a clock, in seconds.
+ * @param clock The clock's identifier.
+ * @return The time, in seconds.
+*/
+static double bench_time(clockid_t clock) {
+	struct timespec now;
+
+	clock_gettime(clock, &now);
+
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/*
+ * @brief A client's reader thread - drains the client's socket until the server closes it.
+ * @param arg A pointer to the client.
+ * @return NULL.
+*/
+static void *bench_reader(void *arg) {
+	bench_client_t_ptr client = (bench_client_t_ptr)arg;
+	char *buf = (char *)malloc(1 << 20);
+
+	if (buf == NULL)
+		return NULL;
+
+	while (true)
+	{
+		ssize_t bytes = recv(client->fd, buf, 1 << 20, 0);
+
+		if (bytes <= 0)
+		{
+			if (bytes < 0 && errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		client->received += (uint64_t)bytes;
+	}
+
+	free(buf);
+
+	return NULL;
+}
+
+/*
+ * @brief The handler of the server's end of a connection - the clients never send, so it only sees them leave.
+ * @param fd The server's end of the connection.
+ * @param react A pointer to the reactor.
+ * @return The reactor object, or NULL once the client left.
+*/
+static void *bench_server_handler(int fd, void *react) {
+	char buf[256];
+	ssize_t bytes = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+
+	if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+		return NULL;
+
+	return react;
+}
+
+/*
+ * @brief The handler of a server end's error queue - hand its zero-copy completions to the proactor, as the server does.
+ * @param fd The server's end of the connection.
+ * @param react A pointer to the reactor.
+ * @return The reactor object.
+*/
+static void *bench_errqueue_handler(int fd, void *react) {
+	completeProactorZeroCopy(bench_proactor, fd);
+
+	return react;
+}
+
+/*
+ * @brief Disconnect benchmark clients - stop their reader threads and close both ends of their connections.
+ * @param clients The clients array.
+ * @param count The number of clients, all of them connected and with a running reader thread.
+ * @return void
+*/
+static void bench_disconnect(bench_client_t_ptr clients, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+	{
+		bench_client_t_ptr client = (clients + i);
+
+		// The reader thread sees the end of the stream, and returns.
+		shutdown(client->fd, SHUT_RDWR);
+		pthread_join(client->thread, NULL);
+		close(client->fd);
+		close(client->server_fd);
+	}
+}
+
+/*
+ * @brief Connect the benchmark clients to a listening socket on the loopback interface.
+ * @param clients The clients array.
+ * @param count The number of clients.
+ * @return 0 on success, 1 otherwise.
+ * @note On failure, the clients that were already connected are disconnected again.
+*/
+static int bench_connect(bench_client_t_ptr clients, size_t count) {
+	struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+	socklen_t addr_len = sizeof(addr);
+	int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, (int)count) < 0 ||
+		getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len) < 0)
+	{
+		fprintf(stderr, "%s Creating the benchmark's listener failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+
+		if (listen_fd >= 0)
+			close(listen_fd);
+
+		return 1;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		bench_client_t_ptr client = (clients + i);
+
+		client->server_fd = -1;
+		client->received = 0;
+
+		int ret = 0;
+
+		if ((client->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 || connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			(client->server_fd = accept(listen_fd, NULL, NULL)) < 0 || (ret = pthread_create(&client->thread, NULL, bench_reader, client)) != 0)
+		{
+			fprintf(stderr, "%s Connecting benchmark client %zu failed: %s\n", C_PREFIX_ERROR, i, strerror((ret != 0) ? ret : errno));
+
+			if (client->fd >= 0)
+				close(client->fd);
+
+			if (client->server_fd >= 0)
+				close(client->server_fd);
+
+			bench_disconnect(clients, i);
+			close(listen_fd);
+			return 1;
+		}
+	}
+
+	close(listen_fd);
+
+	return 0;
+}
+
+/*
+ * @brief Run a single broadcast benchmark - a fixed amount of data in messages of a single size.
+ * @param size The message size, in bytes.
+ * @param zerocopy True to send with MSG_ZEROCOPY, false to copy.
+ * @param count The number of clients.
+ * @param result A pointer to the result.
+ * @return 0 on success, 1 otherwise.
+ * @note The broadcasts are paced, so no client ever has more than half of PROACTOR_QUEUE_LIMIT
+ * 			(or a single message, if it's larger) outstanding, and nothing is dropped.
+ * @note The server's ends are watched by a reactor, as in the server, so the run also shows what
+ * 			the zero-copy completions cost the reactor's thread.
+*/
+static int bench_run(size_t size, bool zerocopy, size_t count, bench_result_t *result) {
+	bench_client_t_ptr clients = (bench_client_t_ptr)calloc(count, sizeof(bench_client_t));
+	char *payload = (char *)malloc(size);
+
+	if (clients == NULL || payload == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		free(clients);
+		free(payload);
+		return 1;
+	}
+
+	memset(payload, 'z', size);
+
+	PProactorMessage message = createProactorMessage(payload, size);
+	PProactor proactor = (PProactor)createProactorPool(1);
+	void *react = createReactor();
+
+	free(payload);
+
+	if (message == NULL || proactor == NULL || react == NULL || bench_connect(clients, count) != 0)
+	{
+		unrefProactorMessage(message);
+
+		if (proactor != NULL)
+			destroyProactor(proactor);
+
+		if (react != NULL)
+			destroyReactor(react);
+
+		free(clients);
+		return 1;
+	}
+
+	setProactorZeroCopy(proactor, zerocopy ? 1 : 0);
+	bench_proactor = proactor;
+	reactorSetErrorQueueHandler(react, bench_errqueue_handler);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		addFd(react, (clients + i)->server_fd, bench_server_handler);
+		addFD2Proactor(proactor, (clients + i)->server_fd, NULL);
+	}
+
+	clockid_t reactor_clock;
+
+	startReactor(react);
+
+	if (!reactorRunning(react) || pthread_getcpuclockid(((reactor_t_ptr)react)->thread, &reactor_clock) != 0)
+		reactor_clock = CLOCK_THREAD_CPUTIME_ID;
+
+	size_t messages = BENCH_BYTES_PER_CLIENT / size;
+	size_t window = (PROACTOR_QUEUE_LIMIT / 2) / size;
+	uint64_t expected = (uint64_t)messages * size;
+
+	if (window == 0)
+		window = 1;
+
+	double start = bench_time(CLOCK_MONOTONIC), cpu_start = bench_time(CLOCK_PROCESS_CPUTIME_ID), reactor_start = bench_time(reactor_clock);
+
+	for (size_t sent = 0; sent < messages; ++sent)
+	{
+		// Wait until the slowest client is within the window.
+		while (true)
+		{
+			uint64_t slowest = expected;
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				uint64_t received = (clients + i)->received;
+
+				if (received < slowest)
+					slowest = received;
+			}
+
+			if ((uint64_t)sent * size - slowest < (uint64_t)window * size)
+				break;
+
+			sched_yield();
+		}
+
+		broadcastProactor(proactor, message);
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		while ((clients + i)->received < expected)
+			sched_yield();
+	}
+
+	result->seconds = bench_time(CLOCK_MONOTONIC) - start;
+	result->cpu_seconds = bench_time(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+	result->reactor_cpu_seconds = bench_time(reactor_clock) - reactor_start;
+
+	cancelProactor(proactor);
+
+	ProactorStats stats;
+
+	getProactorStats(proactor, &stats);
+	result->zc_sends = stats.zc_sends;
+	result->zc_copied = stats.zc_copied;
+	result->dropped = stats.dropped;
+
+	destroyProactor(proactor);
+	unrefProactorMessage(message);
+
+	// The connections are closed below, not by the reactor.
+	stopReactor(react);
+
+	for (size_t i = 0; i < count; ++i)
+		removeFd(react, (clients + i)->server_fd);
+
+	destroyReactor(react);
+	bench_disconnect(clients, count);
+	free(clients);
+
+	return 0;
+}
+
+/*
+ * @brief Print the benchmark's usage.
+ * @param program The program's name.
+ * @param stream The stream to print to.
+ * @return void
+*/
+static void bench_usage(const char *program, FILE *stream) {
+	fprintf(stream, "Usage: %s [clients]\n"
+					"Broadcast %d MB to each of [clients] loopback clients (%d by default) per message size,\n"
+					"once copied and once with MSG_ZEROCOPY, and compare the CPU time the two modes cost.\n",
+					program, BENCH_BYTES_PER_CLIENT / (1024 * 1024), BENCH_CLIENTS);
+}
+
+/*
+ * @brief Parse the benchmark's command line.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @param count A pointer to where to store the number of clients.
+ * @return 0 on success, 1 if the usage was printed, -1 on an invalid argument.
+*/
+static int bench_parse(int argc, char **argv, size_t *count) {
+	char *end = NULL;
+
+	if (argc > 1 && (strcmp(*(argv + 1), "-h") == 0 || strcmp(*(argv + 1), "--help") == 0))
+	{
+		bench_usage(*argv, stdout);
+		return 1;
+	}
+
+	if (argc > 2)
+	{
+		fprintf(stderr, "%s Unexpected argument \"%s\".\n", C_PREFIX_ERROR, *(argv + 2));
+		bench_usage(*argv, stderr);
+		return -1;
+	}
+
+	if (argc > 1)
+	{
+		errno = 0;
+		*count = (size_t)strtoul(*(argv + 1), &end, 10);
+
+		if (end == *(argv + 1) || *end != '\0' || errno != 0 || **(argv + 1) == '-' || *count == 0)
+		{
+			fprintf(stderr, "%s Invalid number of clients \"%s\", must be at least 1.\n", C_PREFIX_ERROR, *(argv + 1));
+			bench_usage(*argv, stderr);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	size_t count = BENCH_CLIENTS;
+	size_t crossover = 0;
+	int ret = bench_parse(argc, argv, &count);
+
+	if (ret != 0)
+		return (ret > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	// The proactor's messages would only clutter the table, so it goes to a copy of stdout.
+	FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+
+	if (out == NULL || freopen("/dev/null", "w", stdout) == NULL || freopen("/dev/null", "w", stderr) == NULL)
+		return EXIT_FAILURE;
+
+	setvbuf(out, NULL, _IOLBF, 0);
+
+	fprintf(out, "%s Broadcasting %d MB to each of %zu loopback clients, per message size and send mode.\n",
+					C_PREFIX_INFO, BENCH_BYTES_PER_CLIENT / (1024 * 1024), count);
+	fprintf(out, "%10s %10s %12s %12s %12s %12s %14s\n", "size", "mode", "MB/s", "CPU ms", "reactor ms", "zc sends", "zc copied");
+
+	for (size_t i = 0; i < sizeof(bench_sizes) / sizeof(*bench_sizes); ++i)
+	{
+		bench_result_t copy = { 0 }, zerocopy = { 0 };
+		size_t size = *(bench_sizes + i);
+		double total_mb = (double)(BENCH_BYTES_PER_CLIENT / size) * (double)size * (double)count / (1024.0 * 1024.0);
+
+		if (bench_run(size, false, count, &copy) != 0 || bench_run(size, true, count, &zerocopy) != 0)
+			return EXIT_FAILURE;
+
+		fprintf(out, "%10zu %10s %12.1f %12.1f %12.1f %12s %14s\n", size, "copy", total_mb / copy.seconds, copy.cpu_seconds * 1000.0,
+						copy.reactor_cpu_seconds * 1000.0, "-", "-");
+		fprintf(out, "%10zu %10s %12.1f %12.1f %12.1f %12" PRIu64 " %14" PRIu64 "\n", size, "zerocopy", total_mb / zerocopy.seconds, zerocopy.cpu_seconds * 1000.0,
+						zerocopy.reactor_cpu_seconds * 1000.0, zerocopy.zc_sends, zerocopy.zc_copied);
+
+		if (copy.dropped > 0 || zerocopy.dropped > 0)
+			fprintf(out, "%s %" PRIu64 " message(s) were dropped, the results aren't comparable.\n", C_PREFIX_WARNING, copy.dropped + zerocopy.dropped);
+
+		if (crossover == 0 && zerocopy.cpu_seconds < copy.cpu_seconds)
+			crossover = size;
+	}
+
+	if (crossover > 0)
+		fprintf(out, "%s Zero-copy first used less CPU at %zu bytes, a good PROACTOR_ZEROCOPY_THRESHOLD for this machine.\n", C_PREFIX_INFO, crossover);
+
+	else
+		fprintf(out, "%s Zero-copy never used less CPU here, keep PROACTOR_ZEROCOPY_THRESHOLD at 0.\n", C_PREFIX_INFO);
+
+	fprintf(out, "%s Loopback delivery copies zero-copy pages anyway (see \"zc copied\"), measure between two hosts for real numbers.\n", C_PREFIX_INFO);
+
+	fclose(out);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,388 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Server Configuration Implementation
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "settings.h"
+#include "config.h"
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/*
+ * @brief The maximum length of a config file line.
+*/
+#define CONFIG_LINE_MAX		512
+
+/*
+ * @brief The types of the knobs' values.
+*/
+typedef enum _config_type
+{
+	CONFIG_TYPE_INT = 0,
+	CONFIG_TYPE_SIZE,
+	CONFIG_TYPE_BOOL,
+	CONFIG_TYPE_FRAMING
+} config_type_t;
+
+/*
+ * @brief A knob of the configuration.
+*/
+typedef struct _config_option
+{
+	// The knob's name, as a command line flag (without the dashes) and as a config file key.
+	const char *name;
+
+	// The knob's environment variable.
+	const char *env;
+
+	// The knob's type, and its offset in the configuration structure.
+	config_type_t type;
+	size_t offset;
+
+	// The knob's valid range, for integer knobs.
+	long long min, max;
+
+	// The knob's description, for the usage.
+	const char *help;
+} config_option_t;
+
+/*
+ * @brief All the knobs of the configuration.
+*/
+static const config_option_t config_options[] = {
+	{ "port", "SERVER_PORT", CONFIG_TYPE_INT, offsetof(server_config_t, port), 1, 65535, "the port the server listens on" },
+	{ "backlog", "MAX_QUEUE", CONFIG_TYPE_INT, offsetof(server_config_t, backlog), 1, INT_MAX, "the listening sockets' backlog" },
+	{ "buffer-size", "MAX_BUFFER", CONFIG_TYPE_SIZE, offsetof(server_config_t, buffer_size), 64, SERVER_MAX_FRAME, "a client's first receive buffer, in bytes" },
+	{ "poll-timeout", "POLL_TIMEOUT", CONFIG_TYPE_INT, offsetof(server_config_t, poll_timeout), -1, INT_MAX, "the reactors' poll timeout in milliseconds, -1 to wait forever" },
+	{ "print-messages", "SERVER_PRINT_MSGS", CONFIG_TYPE_BOOL, offsetof(server_config_t, print_messages), 0, 1, "print the clients' messages" },
+	{ "rcvbuf", "SERVER_RCVBUF", CONFIG_TYPE_INT, offsetof(server_config_t, rcvbuf), 0, INT_MAX, "the sockets' SO_RCVBUF in bytes, 0 for the kernel's default" },
+	{ "sndbuf", "SERVER_SNDBUF", CONFIG_TYPE_INT, offsetof(server_config_t, sndbuf), 0, INT_MAX, "the sockets' SO_SNDBUF in bytes, 0 for the kernel's default" },
+	{ "tcp-nodelay", "SERVER_TCP_NODELAY", CONFIG_TYPE_BOOL, offsetof(server_config_t, tcp_nodelay), 0, 1, "set TCP_NODELAY on the sockets" },
+	{ "reactor-threads", "REACTOR_THREADS", CONFIG_TYPE_SIZE, offsetof(server_config_t, reactor_threads), 0, 4096, "the number of reactor threads, 0 for one per CPU" },
+	{ "proactor-workers", "PROACTOR_WORKERS", CONFIG_TYPE_SIZE, offsetof(server_config_t, proactor_workers), 0, 4096, "the number of proactor workers, 0 for one per CPU" },
+	{ "zerocopy-threshold", "PROACTOR_ZEROCOPY_THRESHOLD", CONFIG_TYPE_SIZE, offsetof(server_config_t, zerocopy_threshold), 0, LLONG_MAX, "the smallest message sent with MSG_ZEROCOPY, 0 to disable it" },
+	{ "framing", "SERVER_FRAMING", CONFIG_TYPE_FRAMING, offsetof(server_config_t, framing), 0, 0, "how the clients' messages are framed" },
+	{ "stats-port", "SERVER_STATS_PORT", CONFIG_TYPE_INT, offsetof(server_config_t, stats_port), 0, 65535, "the loopback port of the statistics endpoint, 0 to disable it" }
+};
+
+/*
+ * @brief The number of knobs of the configuration.
+*/
+#define CONFIG_OPTIONS		(sizeof(config_options) / sizeof(config_options[0]))
+
+/*
+ * @brief The getopt_long() values of --config and --help. The knobs' values are 256 and up, by their index.
+*/
+#define CONFIG_OPT_CONFIG	'c'
+#define CONFIG_OPT_HELP		'h'
+#define CONFIG_OPT_BASE		256
+
+/*
+ * @brief Parse a value of a knob into the configuration.
+ * @param config A pointer to the configuration.
+ * @param option A pointer to the knob.
+ * @param value The value, as a string.
+ * @return 0 on success, -1 if the value is invalid (the configuration isn't changed).
+*/
+static int configSet(server_config_t_ptr config, const config_option_t *option, const char *value) {
+	void *field = (char *)config + option->offset;
+
+	switch (option->type)
+	{
+		case CONFIG_TYPE_BOOL:
+		{
+			if (strcmp(value, "1") == 0 || strcasecmp(value, "yes") == 0 || strcasecmp(value, "on") == 0 || strcasecmp(value, "true") == 0)
+				*(bool *)field = true;
+
+			else if (strcmp(value, "0") == 0 || strcasecmp(value, "no") == 0 || strcasecmp(value, "off") == 0 || strcasecmp(value, "false") == 0)
+				*(bool *)field = false;
+
+			else
+				return -1;
+
+			return 0;
+		}
+
+		case CONFIG_TYPE_FRAMING:
+		{
+			if (strcmp(value, "newline") == 0)
+				*(framer_mode_t *)field = FRAMER_MODE_NEWLINE;
+
+			else if (strcmp(value, "length") == 0)
+				*(framer_mode_t *)field = FRAMER_MODE_LENGTH;
+
+			else
+				return -1;
+
+			return 0;
+		}
+
+		default:
+		{
+			char *end = NULL;
+
+			errno = 0;
+			long long number = strtoll(value, &end, 10);
+
+			if (errno != 0 || end == value || *end != '\0' || number < option->min || number > option->max)
+				return -1;
+
+			if (option->type == CONFIG_TYPE_INT)
+				*(int *)field = (int)number;
+
+			else
+				*(size_t *)field = (size_t)number;
+
+			return 0;
+		}
+	}
+}
+
+/*
+ * @brief Find a knob by its name.
+ * @param name The knob's name.
+ * @return A pointer to the knob, or NULL if there's no such knob.
+*/
+static const config_option_t *configFind(const char *name) {
+	for (size_t i = 0; i < CONFIG_OPTIONS; ++i)
+	{
+		if (strcmp(config_options[i].name, name) == 0)
+			return &config_options[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief Strip the whitespace around a string, in place.
+ * @param str The string.
+ * @return A pointer to the first non-whitespace character of the string.
+*/
+static char *configTrim(char *str) {
+	while (isspace((unsigned char)*str))
+		str++;
+
+	size_t len = strlen(str);
+
+	while (len > 0 && isspace((unsigned char)*(str + len - 1)))
+		*(str + --len) = '\0';
+
+	return str;
+}
+
+void configDefaults(server_config_t_ptr config) {
+	config->port = SERVER_PORT;
+	config->backlog = MAX_QUEUE;
+	config->buffer_size = MAX_BUFFER;
+	config->poll_timeout = POLL_TIMEOUT;
+	config->print_messages = (SERVER_PRINT_MSGS != 0);
+	config->rcvbuf = SERVER_RCVBUF;
+	config->sndbuf = SERVER_SNDBUF;
+	config->tcp_nodelay = (SERVER_TCP_NODELAY != 0);
+	config->reactor_threads = REACTOR_THREADS;
+	config->proactor_workers = PROACTOR_WORKERS;
+	config->zerocopy_threshold = PROACTOR_ZEROCOPY_THRESHOLD;
+	config->framing = SERVER_FRAMING;
+	config->stats_port = SERVER_STATS_PORT;
+}
+
+int configLoadFile(server_config_t_ptr config, const char *path) {
+	FILE *file = fopen(path, "r");
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "%s Can't open config file \"%s\": %s\n", C_PREFIX_ERROR, path, strerror(errno));
+		return -1;
+	}
+
+	char line[CONFIG_LINE_MAX];
+	size_t number = 0;
+	int ret = 0;
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		number++;
+
+		char *key = configTrim(line);
+
+		if (*key == '\0' || *key == '#')
+			continue;
+
+		char *value = strchr(key, '=');
+
+		if (value == NULL)
+		{
+			fprintf(stderr, "%s %s:%zu: expected \"knob = value\".\n", C_PREFIX_ERROR, path, number);
+			ret = -1;
+			break;
+		}
+
+		*value++ = '\0';
+		key = configTrim(key);
+		value = configTrim(value);
+
+		const config_option_t *option = configFind(key);
+
+		if (option == NULL)
+		{
+			fprintf(stderr, "%s %s:%zu: unknown knob \"%s\".\n", C_PREFIX_ERROR, path, number, key);
+			ret = -1;
+			break;
+		}
+
+		if (configSet(config, option, value) != 0)
+		{
+			fprintf(stderr, "%s %s:%zu: invalid value \"%s\" for %s.\n", C_PREFIX_ERROR, path, number, value, key);
+			ret = -1;
+			break;
+		}
+	}
+
+	fclose(file);
+
+	return ret;
+}
+
+void configLoadEnv(server_config_t_ptr config) {
+	for (size_t i = 0; i < CONFIG_OPTIONS; ++i)
+	{
+		const char *value = getenv(config_options[i].env);
+
+		if (value != NULL && configSet(config, &config_options[i], value) != 0)
+			fprintf(stderr, "%s Invalid value \"%s\" for %s, ignoring it.\n", C_PREFIX_WARNING, value, config_options[i].env);
+	}
+}
+
+int configLoad(server_config_t_ptr config, int argc, char **argv) {
+	struct option options[CONFIG_OPTIONS + 3];
+	const char *path = getenv("SERVER_CONFIG");
+
+	for (size_t i = 0; i < CONFIG_OPTIONS; ++i)
+		options[i] = (struct option){ config_options[i].name, required_argument, NULL, CONFIG_OPT_BASE + (int)i };
+
+	options[CONFIG_OPTIONS] = (struct option){ "config", required_argument, NULL, CONFIG_OPT_CONFIG };
+	options[CONFIG_OPTIONS + 1] = (struct option){ "help", no_argument, NULL, CONFIG_OPT_HELP };
+	options[CONFIG_OPTIONS + 2] = (struct option){ NULL, 0, NULL, 0 };
+
+	configDefaults(config);
+
+	// The first pass only looks for the config file and --help, as the file comes before the environment and the flags.
+	int opt = 0;
+
+	opterr = 0;
+
+	while ((opt = getopt_long(argc, argv, "c:h", options, NULL)) != -1)
+	{
+		if (opt == CONFIG_OPT_CONFIG)
+			path = optarg;
+
+		else if (opt == CONFIG_OPT_HELP)
+		{
+			configUsage(argv[0], stdout);
+			return 1;
+		}
+	}
+
+	if (path != NULL && configLoadFile(config, path) != 0)
+		return -1;
+
+	configLoadEnv(config);
+
+	optind = 0;
+	opterr = 1;
+
+	while ((opt = getopt_long(argc, argv, "c:h", options, NULL)) != -1)
+	{
+		if (opt == CONFIG_OPT_CONFIG)
+			continue;
+
+		if (opt < CONFIG_OPT_BASE || opt >= CONFIG_OPT_BASE + (int)CONFIG_OPTIONS)
+		{
+			configUsage(argv[0], stderr);
+			return -1;
+		}
+
+		const config_option_t *option = &config_options[opt - CONFIG_OPT_BASE];
+
+		if (configSet(config, option, optarg) != 0)
+		{
+			fprintf(stderr, "%s Invalid value \"%s\" for --%s.\n", C_PREFIX_ERROR, optarg, option->name);
+			return -1;
+		}
+	}
+
+	if (optind < argc)
+	{
+		fprintf(stderr, "%s Unexpected argument \"%s\".\n", C_PREFIX_ERROR, argv[optind]);
+		configUsage(argv[0], stderr);
+		return -1;
+	}
+
+	return 0;
+}
+
+void configUsage(const char *program, FILE *stream) {
+	static const char *metavars[] = { "N", "N", "yes|no", "newline|length" };
+	char flag[64];
+
+	fprintf(stream, "Usage: %s [options]\n", program);
+	fprintf(stream, "  %-36s %s\n", "-c, --config FILE", "read the knobs from a config file (or SERVER_CONFIG)");
+	fprintf(stream, "  %-36s %s\n", "-h, --help", "print this help and exit");
+
+	for (size_t i = 0; i < CONFIG_OPTIONS; ++i)
+	{
+		snprintf(flag, sizeof(flag), "--%s %s", config_options[i].name, metavars[config_options[i].type]);
+		fprintf(stream, "      %-32s %s (%s)\n", flag, config_options[i].help, config_options[i].env);
+	}
+
+	fprintf(stream, "Every knob can also be set in a config file as \"knob = value\", or by its environment variable.\n");
+	fprintf(stream, "The command line overrides the environment, which overrides the config file.\n");
+}
+
+void configPrint(const server_config_t *config, FILE *stream) {
+	for (size_t i = 0; i < CONFIG_OPTIONS; ++i)
+	{
+		const config_option_t *option = &config_options[i];
+		const void *field = (const char *)config + option->offset;
+
+		fprintf(stream, "%s   %-20s = ", C_PREFIX_INFO, option->name);
+
+		switch (option->type)
+		{
+			case CONFIG_TYPE_INT:
+				fprintf(stream, "%d\n", *(const int *)field);
+				break;
+
+			case CONFIG_TYPE_SIZE:
+				fprintf(stream, "%zu\n", *(const size_t *)field);
+				break;
+
+			case CONFIG_TYPE_BOOL:
+				fprintf(stream, "%s\n", (*(const bool *)field ? "yes" : "no"));
+				break;
+
+			case CONFIG_TYPE_FRAMING:
+				fprintf(stream, "%s\n", (*(const framer_mode_t *)field == FRAMER_MODE_LENGTH ? "length" : "newline"));
+				break;
+		}
+	}
+}
@@ -0,0 +1,124 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Server Configuration Header File
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+
+#include "framer.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * @brief The server's run-time configuration.
+ * @note Every knob starts from its settings.h default, and can be overridden by a config file,
+ * 			an environment variable and a command line flag, in that order (see configLoad()).
+*/
+typedef struct _server_config
+{
+	// The port the server listens on (SERVER_PORT).
+	int port;
+
+	// The listening sockets' backlog (MAX_QUEUE).
+	int backlog;
+
+	// The size of a client's first receive buffer, in bytes (MAX_BUFFER).
+	size_t buffer_size;
+
+	// The reactors' poll timeout, in milliseconds, -1 to wait forever (POLL_TIMEOUT).
+	int poll_timeout;
+
+	// Whether the server prints the clients' messages (SERVER_PRINT_MSGS).
+	bool print_messages;
+
+	// The sockets' SO_RCVBUF and SO_SNDBUF, in bytes, 0 to keep the kernel's default (SERVER_RCVBUF, SERVER_SNDBUF).
+	int rcvbuf, sndbuf;
+
+	// Whether the sockets have TCP_NODELAY set (SERVER_TCP_NODELAY).
+	bool tcp_nodelay;
+
+	// The number of reactor threads, 0 for one per CPU (REACTOR_THREADS).
+	size_t reactor_threads;
+
+	// The number of proactor workers, 0 for one per CPU (PROACTOR_WORKERS).
+	size_t proactor_workers;
+
+	// The smallest message the proactor sends with MSG_ZEROCOPY, 0 to disable it (PROACTOR_ZEROCOPY_THRESHOLD).
+	size_t zerocopy_threshold;
+
+	// How the clients' streams are split into messages (SERVER_FRAMING).
+	framer_mode_t framing;
+
+	// The loopback port of the statistics endpoint, 0 to disable it (SERVER_STATS_PORT).
+	int stats_port;
+} server_config_t, *server_config_t_ptr;
+
+/*
+ * @brief Fill a configuration with the settings.h defaults.
+ * @param config A pointer to the configuration.
+ * @return void
+*/
+void configDefaults(server_config_t_ptr config);
+
+/*
+ * @brief Override a configuration with the knobs of a config file.
+ * @param config A pointer to the configuration.
+ * @param path The config file's path.
+ * @return 0 on success, -1 if the file can't be read or has an invalid line.
+ * @note Every line is either empty, a comment starting with '#', or "knob = value",
+ * 			where the knob is named like its command line flag, without the dashes (e.g. "port = 9034").
+*/
+int configLoadFile(server_config_t_ptr config, const char *path);
+
+/*
+ * @brief Override a configuration with the knobs' environment variables.
+ * @param config A pointer to the configuration.
+ * @return void
+ * @note Every knob's environment variable is named like its settings.h constant (e.g. SERVER_PORT).
+ * 			An invalid value is reported, and the knob keeps its previous value.
+*/
+void configLoadEnv(server_config_t_ptr config);
+
+/*
+ * @brief Build a configuration from all the sources - the defaults, a config file, the environment and the command line.
+ * @param config A pointer to the configuration.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @return 0 on success, 1 if the usage was printed (--help), -1 on an invalid argument or config file.
+ * @note The config file is given by --config (or -c), or by the SERVER_CONFIG environment variable.
+ * 			Every knob has a long flag (e.g. --port 9034 or --port=9034).
+*/
+int configLoad(server_config_t_ptr config, int argc, char **argv);
+
+/*
+ * @brief Print the command line usage.
+ * @param program The program's name.
+ * @param stream The stream to print to.
+ * @return void
+*/
+void configUsage(const char *program, FILE *stream);
+
+/*
+ * @brief Print the effective configuration, a knob per line.
+ * @param config A pointer to the configuration.
+ * @param stream The stream to print to.
+ * @return void
+*/
+void configPrint(const server_config_t *config, FILE *stream);
+
+#endif
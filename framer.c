@@ -0,0 +1,262 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Message Framer Implementation
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "settings.h"
+#include "framer.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * @brief The smallest space a read gets - below it, the buffer is compacted or grown first.
+ * @note A quarter of the buffer's initial size (the framer's chunk), so a partial frame is moved at most
+ * 			once per few reads, rather than a few bytes are received at a time.
+*/
+#define FRAMER_MIN_READ(framer)	((framer)->chunk / 4)
+
+/*
+ * @brief The size of the length header of FRAMER_MODE_LENGTH frames, in bytes.
+*/
+#define FRAMER_LENGTH_HEADER	4
+
+/*
+ * @brief The default allocator, malloc().
+*/
+static void *framerMalloc(void *ctx, size_t size) {
+	(void)ctx;
+
+	return malloc(size);
+}
+
+/*
+ * @brief The default deallocator, free().
+*/
+static void framerFree(void *ctx, void *buf) {
+	(void)ctx;
+
+	free(buf);
+}
+
+/*
+ * @brief Get the largest size the framer's buffer may grow to.
+ * @param framer A pointer to the framer.
+ * @return The size, in bytes - the largest frame, its delimiter or header, and the null terminator.
+*/
+static inline size_t framerLimit(framer_t_ptr framer) {
+	return framer->max_frame + ((framer->mode == FRAMER_MODE_LENGTH) ? FRAMER_LENGTH_HEADER : 2) + 1;
+}
+
+/*
+ * @brief Put back the byte that was replaced by the last frame's null terminator.
+ * @param framer A pointer to the framer.
+ * @return void
+*/
+static inline void framerRestore(framer_t_ptr framer) {
+	if (framer->stash != NULL)
+	{
+		*framer->stash = framer->stash_byte;
+		framer->stash = NULL;
+	}
+}
+
+void framerInit(framer_t_ptr framer, framer_mode_t mode, size_t max_frame, size_t chunk, framer_alloc_t alloc, framer_free_t release, void *ctx) {
+	framer->mode = mode;
+	framer->max_frame = max_frame;
+	framer->chunk = (chunk > 0) ? chunk : MAX_BUFFER;
+	framer->alloc = (alloc != NULL) ? alloc : framerMalloc;
+	framer->release = (release != NULL) ? release : framerFree;
+	framer->ctx = ctx;
+	framer->buf = NULL;
+	framer->capacity = 0;
+	framer->start = 0;
+	framer->end = 0;
+	framer->scanned = 0;
+	framer->stash = NULL;
+	framer->stash_byte = 0;
+}
+
+void framerReset(framer_t_ptr framer) {
+	if (framer->buf != NULL)
+		framer->release(framer->ctx, framer->buf);
+
+	framer->buf = NULL;
+	framer->capacity = 0;
+	framer->start = 0;
+	framer->end = 0;
+	framer->scanned = 0;
+	framer->stash = NULL;
+}
+
+char *framerBuffer(framer_t_ptr framer, size_t *len) {
+	size_t limit = framerLimit(framer);
+
+	framerRestore(framer);
+
+	if (framer->buf == NULL)
+	{
+		size_t capacity = (framer->chunk < limit) ? framer->chunk : limit;
+
+		if ((framer->buf = (char *)framer->alloc(framer->ctx, capacity)) == NULL)
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		framer->capacity = capacity;
+	}
+
+	// The last byte is kept for the null terminator of a frame that ends at the end of the data.
+	if (framer->capacity - 1 - framer->end < FRAMER_MIN_READ(framer) && framer->start > 0)
+	{
+		memmove(framer->buf, framer->buf + framer->start, framer->end - framer->start);
+		framer->end -= framer->start;
+		framer->scanned -= framer->start;
+		framer->start = 0;
+	}
+
+	if (framer->capacity - 1 - framer->end < FRAMER_MIN_READ(framer) && framer->capacity < limit)
+	{
+		size_t capacity = (framer->capacity * 2 < limit) ? framer->capacity * 2 : limit;
+		char *buf = (char *)framer->alloc(framer->ctx, capacity);
+
+		if (buf == NULL)
+		{
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		memcpy(buf, framer->buf + framer->start, framer->end - framer->start);
+		framer->release(framer->ctx, framer->buf);
+
+		framer->buf = buf;
+		framer->capacity = capacity;
+		framer->end -= framer->start;
+		framer->scanned -= framer->start;
+		framer->start = 0;
+	}
+
+	// Only a frame larger than the limit can fill the whole buffer, and framerNext() rejects it first.
+	if (framer->capacity - 1 == framer->end)
+	{
+		errno = EMSGSIZE;
+		return NULL;
+	}
+
+	*len = framer->capacity - 1 - framer->end;
+
+	return framer->buf + framer->end;
+}
+
+void framerCommit(framer_t_ptr framer, size_t len) {
+	framer->end += len;
+}
+
+char *framerNext(framer_t_ptr framer, size_t *len) {
+	framerRestore(framer);
+
+	if (framer->buf == NULL)
+	{
+		errno = EAGAIN;
+		return NULL;
+	}
+
+	size_t avail = framer->end - framer->start;
+	char *frame = NULL;
+
+	if (framer->mode == FRAMER_MODE_LENGTH)
+	{
+		uint32_t length = 0;
+
+		if (avail >= FRAMER_LENGTH_HEADER)
+		{
+			memcpy(&length, framer->buf + framer->start, FRAMER_LENGTH_HEADER);
+			length = ntohl(length);
+
+			if (length > framer->max_frame)
+			{
+				errno = EMSGSIZE;
+				return NULL;
+			}
+
+			if (avail - FRAMER_LENGTH_HEADER >= length)
+			{
+				frame = framer->buf + framer->start + FRAMER_LENGTH_HEADER;
+				framer->start += FRAMER_LENGTH_HEADER + length;
+
+				// The terminator overwrites the next frame's first byte, so it's put back on the next call.
+				framer->stash = framer->buf + framer->start;
+				framer->stash_byte = *framer->stash;
+				*framer->stash = '\0';
+				*len = length;
+
+				return frame;
+			}
+		}
+	}
+
+	else
+	{
+		// Only the bytes that arrived since the last search are searched.
+		size_t from = (framer->scanned > framer->start) ? framer->scanned : framer->start;
+		char *newline = (char *)memchr(framer->buf + from, '\n', framer->end - from);
+
+		if (newline != NULL)
+		{
+			size_t length = (size_t)(newline - (framer->buf + framer->start));
+
+			frame = framer->buf + framer->start;
+			framer->start = framer->scanned = (size_t)(newline - framer->buf) + 1;
+			*newline = '\0';
+
+			if (length > 0 && *(frame + length - 1) == '\r')
+				*(frame + --length) = '\0';
+
+			if (length > framer->max_frame)
+			{
+				errno = EMSGSIZE;
+				return NULL;
+			}
+
+			*len = length;
+
+			return frame;
+		}
+
+		framer->scanned = framer->end;
+
+		// No newline in more than a whole frame and its "\r\n".
+		if (avail > framer->max_frame + 1)
+		{
+			errno = EMSGSIZE;
+			return NULL;
+		}
+	}
+
+	// All the data was consumed, so the buffer goes back until the next read.
+	if (framer->start == framer->end)
+		framerReset(framer);
+
+	errno = EAGAIN;
+	return NULL;
+}
+
+bool framerPending(framer_t_ptr framer) {
+	return (framer->buf != NULL && framer->end > framer->start);
+}
@@ -0,0 +1,155 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Message Framer Header File
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FRAMER_H
+#define _FRAMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * @brief How a stream is split into frames.
+*/
+typedef enum _framer_mode
+{
+	/*
+	 * @brief Every frame ends with a newline ('\n', or "\r\n"), which isn't part of the frame.
+	*/
+	FRAMER_MODE_NEWLINE = 0,
+
+	/*
+	 * @brief Every frame starts with its length, as a 4 byte unsigned integer in network byte order,
+	 * 			which isn't part of the frame.
+	*/
+	FRAMER_MODE_LENGTH
+} framer_mode_t;
+
+/*
+ * @brief An allocator for the framer's buffer.
+ * @param ctx The allocator's context, as given to framerInit().
+ * @param size The requested size, in bytes.
+ * @return A pointer to a buffer of at least size bytes, or NULL on failure.
+*/
+typedef void *(*framer_alloc_t)(void *ctx, size_t size);
+
+/*
+ * @brief A deallocator for the framer's buffer.
+ * @param ctx The allocator's context, as given to framerInit().
+ * @param buf A buffer returned by the allocator.
+ * @return void
+*/
+typedef void (*framer_free_t)(void *ctx, void *buf);
+
+/*
+ * @brief A per-connection stream framer.
+ * @note The connection's data is received straight into the framer's buffer, and whole frames are handed out
+ * 			in place, so a frame is never copied - unless it's split across reads and the buffer has to be
+ * 			compacted or grown to fit it.
+ * @note The buffer is only held while there's a partial frame, so an idle connection holds no memory.
+*/
+typedef struct _framer
+{
+	// The framing mode.
+	framer_mode_t mode;
+
+	// The largest frame the framer accepts, in bytes.
+	size_t max_frame;
+
+	// The size of the buffer when it's first allocated, in bytes.
+	size_t chunk;
+
+	// The buffer's allocator, deallocator and their context.
+	framer_alloc_t alloc;
+	framer_free_t release;
+	void *ctx;
+
+	// The buffer, NULL while the framer holds no data.
+	char *buf;
+
+	// The size of the buffer, in bytes.
+	size_t capacity;
+
+	// The offsets of the first unconsumed byte, and of the end of the received data.
+	size_t start, end;
+
+	// The offset up to which the data was already searched for a newline.
+	size_t scanned;
+
+	// The byte that was replaced by the last frame's null terminator, restored before the data is used again.
+	char *stash;
+	char stash_byte;
+} framer_t, *framer_t_ptr;
+
+/*
+ * @brief Initialize a framer.
+ * @param framer A pointer to the framer.
+ * @param mode The framing mode.
+ * @param max_frame The largest frame the framer accepts, in bytes.
+ * @param chunk The size of the buffer when it's first allocated, in bytes (e.g. MAX_BUFFER).
+ * @param alloc The buffer's allocator, or NULL for malloc().
+ * @param release The buffer's deallocator, or NULL for free().
+ * @param ctx The allocator's context.
+ * @return void
+*/
+void framerInit(framer_t_ptr framer, framer_mode_t mode, size_t max_frame, size_t chunk, framer_alloc_t alloc, framer_free_t release, void *ctx);
+
+/*
+ * @brief Drop the framer's data and release its buffer.
+ * @param framer A pointer to the framer.
+ * @return void
+*/
+void framerReset(framer_t_ptr framer);
+
+/*
+ * @brief Get the space the next read should receive the data into.
+ * @param framer A pointer to the framer.
+ * @param len Where to store the size of the space, in bytes.
+ * @return A pointer to the space, or NULL on failure (errno is set).
+ * @note The buffer is compacted, or grown up to the size of the largest frame, if the space runs low.
+ * @note Invalidates the last frame returned by framerNext().
+*/
+char *framerBuffer(framer_t_ptr framer, size_t *len);
+
+/*
+ * @brief Tell the framer how many bytes were received into the space returned by framerBuffer().
+ * @param framer A pointer to the framer.
+ * @param len The number of bytes received.
+ * @return void
+*/
+void framerCommit(framer_t_ptr framer, size_t len);
+
+/*
+ * @brief Get the next whole frame.
+ * @param framer A pointer to the framer.
+ * @param len Where to store the length of the frame, in bytes.
+ * @return A pointer to the frame, or NULL if there's no whole frame (errno is EAGAIN),
+ * 			or the frame is larger than the largest frame (errno is EMSGSIZE).
+ * @note The frame lives in the framer's buffer, and is null-terminated in place.
+ * 			It stays valid (and writable) until the next call to any of the framer's functions.
+ * @note Once there are no more whole frames, the buffer is released if it's empty.
+*/
+char *framerNext(framer_t_ptr framer, size_t *len);
+
+/*
+ * @brief Check whether the framer holds a partial frame.
+ * @param framer A pointer to the framer.
+ * @return true if there's unconsumed data, false otherwise.
+*/
+bool framerPending(framer_t_ptr framer);
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Latency Histogram Header File
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _HISTOGRAM_H
+#define _HISTOGRAM_H
+
+#include "metrics.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * @brief The number of sub-buckets every power of two is split into, as a power of two.
+ * @note 4 bits give 16 sub-buckets, so a recorded value is off by at most 1/16 (6.25%).
+*/
+#define HISTOGRAM_SUB_BITS		4
+
+/*
+ * @brief The largest value a histogram tells apart, as a power of two - larger values are counted as this.
+ * @note 2^40 nanoseconds are about 18 minutes.
+*/
+#define HISTOGRAM_MAX_BITS		40
+
+/*
+ * @brief The number of sub-buckets per power of two.
+*/
+#define HISTOGRAM_SUB_COUNT		(1 << HISTOGRAM_SUB_BITS)
+
+/*
+ * @brief The number of buckets of a histogram.
+ * @note The values below 2 * HISTOGRAM_SUB_COUNT get a bucket each, and every power of two
+ * 			above them gets HISTOGRAM_SUB_COUNT buckets.
+*/
+#define HISTOGRAM_BUCKETS		(2 * HISTOGRAM_SUB_COUNT + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB_COUNT)
+
+/*
+ * @brief A log-bucketed latency histogram, in the spirit of HdrHistogram.
+ * @note Written by a single thread without locks, like every metric_t, and read by any thread.
+ * 			Every thread records into its own histograms, which are only merged when they're reported.
+ * @note Recording is a bit scan and a counter increment, so it's cheap enough for every event.
+*/
+typedef struct _histogram
+{
+	// The number of recorded values.
+	metric_t count;
+
+	// The largest recorded value.
+	metric_t max;
+
+	// The number of recorded values in every bucket.
+	metric_t buckets[HISTOGRAM_BUCKETS];
+} histogram_t, *histogram_t_ptr;
+
+/*
+ * @brief A merged copy of one or more histograms, taken to compute their percentiles.
+*/
+typedef struct _histogram_snapshot
+{
+	// The number of recorded values.
+	uint64_t count;
+
+	// The largest recorded value.
+	uint64_t max;
+
+	// The number of recorded values in every bucket.
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+} histogram_snapshot_t, *histogram_snapshot_t_ptr;
+
+/*
+ * @brief Read the monotonic clock, for timing the recorded intervals.
+ * @return The clock, in nanoseconds.
+*/
+static inline uint64_t histogramClock(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/*
+ * @brief Get the bucket a value is counted in.
+ * @param value The value.
+ * @return The bucket's index.
+*/
+static inline size_t histogramBucket(uint64_t value) {
+	if (value < 2 * HISTOGRAM_SUB_COUNT)
+		return (size_t)value;
+
+	if (value >= ((uint64_t)1 << HISTOGRAM_MAX_BITS))
+		return HISTOGRAM_BUCKETS - 1;
+
+	// The highest bit picks the power of two, and the HISTOGRAM_SUB_BITS bits below it pick the sub-bucket.
+	unsigned int bits = 63 - (unsigned int)__builtin_clzll(value);
+	size_t sub = (size_t)(value >> (bits - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB_COUNT;
+
+	return 2 * HISTOGRAM_SUB_COUNT + (bits - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB_COUNT + sub;
+}
+
+/*
+ * @brief Get the largest value that's counted in a bucket.
+ * @param bucket The bucket's index.
+ * @return The value.
+*/
+static inline uint64_t histogramBucketValue(size_t bucket) {
+	if (bucket < 2 * HISTOGRAM_SUB_COUNT)
+		return (uint64_t)bucket;
+
+	size_t bits = (bucket - 2 * HISTOGRAM_SUB_COUNT) / HISTOGRAM_SUB_COUNT + HISTOGRAM_SUB_BITS + 1;
+	uint64_t sub = (uint64_t)((bucket - 2 * HISTOGRAM_SUB_COUNT) % HISTOGRAM_SUB_COUNT);
+
+	return ((HISTOGRAM_SUB_COUNT + sub + 1) << (bits - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+/*
+ * @brief Record a value in a histogram, from its writer thread.
+ * @param histogram A pointer to the histogram.
+ * @param value The value, usually in nanoseconds.
+ * @return void
+*/
+static inline void histogramRecord(histogram_t_ptr histogram, uint64_t value) {
+	metricAdd((histogram->buckets + histogramBucket(value)), 1);
+	metricAdd(&histogram->count, 1);
+
+	if (value > metricRead(&histogram->max))
+		metricSet(&histogram->max, value);
+}
+
+/*
+ * @brief Merge a histogram into a snapshot, from any thread.
+ * @param snapshot A pointer to the snapshot, which must start zeroed.
+ * @param histogram A pointer to the histogram.
+ * @return void
+*/
+static inline void histogramMerge(histogram_snapshot_t_ptr snapshot, histogram_t_ptr histogram) {
+	uint64_t max = metricRead(&histogram->max);
+
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	{
+		uint64_t count = metricRead(histogram->buckets + i);
+
+		*(snapshot->buckets + i) += count;
+		snapshot->count += count;
+	}
+
+	if (max > snapshot->max)
+		snapshot->max = max;
+}
+
+/*
+ * @brief Get a percentile of a snapshot.
+ * @param snapshot A pointer to the snapshot.
+ * @param percentile The percentile, between 0 and 100 (e.g. 99.9).
+ * @return The largest value of the bucket the percentile falls in (at most the largest recorded value),
+ * 			or 0 if nothing was recorded.
+*/
+static inline uint64_t histogramPercentile(histogram_snapshot_t_ptr snapshot, double percentile) {
+	uint64_t target = (uint64_t)((double)snapshot->count * percentile / 100.0 + 0.5), seen = 0;
+
+	if (snapshot->count == 0)
+		return 0;
+
+	if (target == 0)
+		target = 1;
+
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+	{
+		if ((seen += *(snapshot->buckets + i)) >= target)
+		{
+			uint64_t value = histogramBucketValue(i);
+
+			return (value < snapshot->max) ? value : snapshot->max;
+		}
+	}
+
+	return snapshot->max;
+}
+
+/*
+ * @brief Time an interval into a histogram, when LATENCY_HISTOGRAMS is set - otherwise, these expand to nothing.
+ * @note LATENCY_START() declares a variable that holds the interval's start, and LATENCY_RECORD() records
+ * 			the time since then, e.g. "LATENCY_START(start); work(); LATENCY_RECORD(&histogram, start);".
+*/
+#if LATENCY_HISTOGRAMS
+	#define LATENCY_START(start)				uint64_t start = histogramClock()
+	#define LATENCY_RECORD(histogram, start)	histogramRecord((histogram), histogramClock() - (start))
+#else
+	#define LATENCY_START(start)				(void)0
+	#define LATENCY_RECORD(histogram, start)	(void)0
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Asynchronous Logger Header File
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LOGGER_H
+#define _LOGGER_H
+
+#include "settings.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * @brief The level of a log message, from the most important to the most verbose.
+ * @note A message is logged only if its level is at most the logger's current level.
+*/
+typedef enum _log_level {
+	/*
+	 * @brief Errors, printed to stderr with C_PREFIX_ERROR.
+	*/
+	LOG_LEVEL_ERROR = 0,
+
+	/*
+	 * @brief Warnings, printed to stderr with C_PREFIX_WARNING.
+	*/
+	LOG_LEVEL_WARNING,
+
+	/*
+	 * @brief Information messages, printed to stdout with C_PREFIX_INFO.
+	*/
+	LOG_LEVEL_INFO,
+
+	/*
+	 * @brief The clients' messages, printed to stdout with C_PREFIX_MESSAGE.
+	*/
+	LOG_LEVEL_MESSAGE
+} log_level_t;
+
+/*
+ * @brief Start the logger's background thread.
+ * @return 0 on success, 1 on failure.
+ * @note The initial level is LOG_LEVEL (settings.h), or the LOG_LEVEL environment variable
+ * 			(error, warning, info or message) if it's set.
+ * @note Until the logger is started (and after it's stopped), logWrite() prints synchronously.
+ * @note The thread inherits the caller's signal mask.
+*/
+int startLogger(void);
+
+/*
+ * @brief Stop the logger's background thread, after it wrote every record that was already queued.
+ * @return void
+*/
+void stopLogger(void);
+
+/*
+ * @brief Change the logger's level, takes effect immediately on all threads.
+ * @param level The new level.
+ * @return void
+ * @note Async signal safe.
+*/
+void setLogLevel(log_level_t level);
+
+/*
+ * @brief Get the logger's current level.
+ * @return The current level.
+*/
+log_level_t getLogLevel(void);
+
+/*
+ * @brief Get the number of records that were dropped because the logger's ring was full.
+ * @return The number of dropped records.
+*/
+uint64_t getLogDropped(void);
+
+/*
+ * @brief Get the number of strings that were cut to fit in a log record, because there was no memory to copy them.
+ * @return The number of truncated strings.
+*/
+uint64_t getLogTruncated(void);
+
+/*
+ * @brief Log a message, without blocking.
+ * @param level The message's level - it's dropped right away if it's above the current level.
+ * @param format A printf() format string, must be a string literal (only a pointer to it is kept).
+ * @param ... The format's arguments.
+ * @return void
+ * @note The caller only copies the arguments into a binary record in a lock-free ring, and the
+ * 			logger's thread formats and writes the records in batches. If the ring is full,
+ * 			the record is dropped and counted, so logging never holds back the caller.
+ * @note Only integer (d, i, u, x, X, o, c with the hh, h, l, ll and z modifiers), pointer (p)
+ * 			and string (s) conversions are supported. Strings are copied into the record,
+ * 			up to LOG_RECORD_TEXT bytes in total, and longer ones are copied onto the heap and freed
+ * 			by the logger's thread, so a message is never cut short unless that allocation fails.
+ * @note The level's prefix is prepended, so the format shouldn't include one.
+*/
+void logWrite(log_level_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Metrics Header File
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * @brief A counter that's written by a single thread at a time, and read by any thread.
+ * @note The counters are kept per thread (a shard or a proactor worker), in blocks aligned to CACHE_LINE_SIZE,
+ * 			so a thread never shares a cache line with another thread's counters, and reading them doesn't
+ * 			slow down the threads that write them. They're only summed up when someone asks for them.
+ * @note As there's a single writer, an update is a relaxed load and store - a plain add, without a locked
+ * 			instruction - and a reader always sees a whole value, never a torn one.
+*/
+typedef _Atomic uint64_t metric_t;
+
+/*
+ * @brief Add to a counter, from its writer thread.
+ * @param metric A pointer to the counter.
+ * @param value The value to add.
+ * @return void
+*/
+static inline void metricAdd(metric_t *metric, uint64_t value) {
+	atomic_store_explicit(metric, atomic_load_explicit(metric, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+/*
+ * @brief Subtract from a counter, from its writer thread.
+ * @param metric A pointer to the counter.
+ * @param value The value to subtract.
+ * @return void
+*/
+static inline void metricSub(metric_t *metric, uint64_t value) {
+	atomic_store_explicit(metric, atomic_load_explicit(metric, memory_order_relaxed) - value, memory_order_relaxed);
+}
+
+/*
+ * @brief Set a counter, from its writer thread.
+ * @param metric A pointer to the counter.
+ * @param value The new value.
+ * @return void
+*/
+static inline void metricSet(metric_t *metric, uint64_t value) {
+	atomic_store_explicit(metric, value, memory_order_relaxed);
+}
+
+/*
+ * @brief Read a counter, from any thread.
+ * @param metric A pointer to the counter.
+ * @return The counter's value.
+*/
+static inline uint64_t metricRead(metric_t *metric) {
+	return atomic_load_explicit(metric, memory_order_relaxed);
+}
+
+#endif
@@ -20,8 +20,13 @@
 #define _PROACTOR_H
 
 #include "settings.h"
+#include "metrics.h"
+#include "histogram.h"
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <sys/types.h>
 
 /********************/
 /* Typedefs Section */
@@ -39,10 +44,109 @@ typedef int (*handler_t)(int);
 /* Structures Section */
 /**********************/
 
+/*
+ * @brief An immutable, reference counted message.
+ * @param refs The number of references to the message.
+ * @param length The length of the message, in bytes.
+ * @param data The message itself.
+ * @note A broadcast puts the message in memory once, and every outbound queue that holds
+ * 			a part of it holds a reference to it, so there's no per-client copy.
+ * @note The message frees itself once its last reference was released.
+*/
+typedef struct _proactor_message {
+	/*
+	 * @brief The number of references to the message.
+	 * @note Updated atomically, as the workers release their references concurrently.
+	*/
+	_Atomic size_t refs;
+
+	/*
+	 * @brief The length of the message, in bytes.
+	*/
+	size_t length;
+
+#if LATENCY_HISTOGRAMS
+	/*
+	 * @brief The monotonic clock when the message was created, in nanoseconds.
+	 * @note The clients' send latency is measured from it.
+	*/
+	uint64_t created;
+#endif
+
+	/*
+	 * @brief The message itself.
+	 * @note Never changes once the message was handed to the proactor, so it's safe to read from any thread.
+	*/
+	char data[];
+} ProactorMessage, *PProactorMessage;
+
+/*
+ * @brief A chunk of data in a file descriptor's outbound queue.
+ * @param next The next chunk in the queue.
+ * @param message The message the chunk refers to.
+ * @param offset The number of bytes of the message that were already sent.
+*/
+typedef struct _proactor_chunk {
+	/*
+	 * @brief The next chunk in the queue.
+	 * @note For the last chunk, this is NULL.
+	*/
+	struct _proactor_chunk *next;
+
+	/*
+	 * @brief The message the chunk refers to.
+	 * @note The chunk holds a reference to the message, which is released once all of it was sent.
+	*/
+	PProactorMessage message;
+
+	/*
+	 * @brief The number of bytes of the message that were already sent.
+	 * @note A chunk stays at the head of the queue until all of it was sent.
+	*/
+	size_t offset;
+} ProactorChunk, *PProactorChunk;
+
+/*
+ * @brief A zero-copy send that the kernel didn't report as done yet.
+ * @param next The next send in the file descriptor's list.
+ * @param seq The send's sequence number, as counted by the kernel for the socket.
+ * @param message The message that was sent.
+ * @note The kernel reads the message's memory after sendmsg() returned, so the send keeps
+ * 			a reference to the message until its completion is read from the socket's error queue.
+*/
+typedef struct _proactor_zerocopy {
+	/*
+	 * @brief The next send in the file descriptor's list.
+	 * @note For the last send, this is NULL.
+	*/
+	struct _proactor_zerocopy *next;
+
+	/*
+	 * @brief The send's sequence number, as counted by the kernel for the socket.
+	*/
+	uint32_t seq;
+
+	/*
+	 * @brief The message that was sent.
+	*/
+	PProactorMessage message;
+} ProactorZeroCopy, *PProactorZeroCopy;
+
 /*
  * @brief A node in the proactor's linked list.
  * @param fd The file descriptor.
  * @param handler The file descriptor's handler.
+ * @param out_head The first chunk in the file descriptor's outbound queue.
+ * @param out_tail The last chunk in the file descriptor's outbound queue.
+ * @param out_bytes The number of bytes waiting in the outbound queue.
+ * @param out_count The number of chunks waiting in the outbound queue.
+ * @param watching A boolean value indicating whether the worker waits for the file descriptor to become writable.
+ * @param dirty A boolean value indicating whether the file descriptor is in the worker's dirty list.
+ * @param dirty_next The next node in the worker's dirty list.
+ * @param zerocopy A boolean value indicating whether the socket has SO_ZEROCOPY enabled.
+ * @param zc_seq The sequence number the kernel gives the socket's next zero-copy send.
+ * @param zc_head The socket's oldest zero-copy send that wasn't completed yet.
+ * @param zc_tail The socket's newest zero-copy send that wasn't completed yet.
  * @param next The next node in the linked list.
 */
 typedef struct _proactor_t_node {
@@ -70,43 +174,443 @@ typedef struct _proactor_t_node {
 		void *handler_ptr;
 	} hdlr;
 
+	/*
+	 * @brief The first chunk in the file descriptor's outbound queue, NULL if the queue is empty.
+	*/
+	PProactorChunk out_head;
+
+	/*
+	 * @brief The last chunk in the file descriptor's outbound queue, NULL if the queue is empty.
+	*/
+	PProactorChunk out_tail;
+
+	/*
+	 * @brief The number of bytes waiting in the outbound queue.
+	 * @note Bounded by PROACTOR_QUEUE_LIMIT, new data is dropped once the queue is full.
+	*/
+	size_t out_bytes;
+
+	/*
+	 * @brief The number of chunks waiting in the outbound queue.
+	*/
+	size_t out_count;
+
+	/*
+	 * @brief A boolean value indicating whether the worker waits for the file descriptor to become writable.
+	 * @note True exactly while the outbound queue isn't empty.
+	*/
+	bool watching;
+
+	/*
+	 * @brief A boolean value indicating whether the file descriptor is in the worker's dirty list,
+	 * 			i.e. it got fresh data that's flushed at the end of the worker's tick.
+	*/
+	bool dirty;
+
+	/*
+	 * @brief The next node in the worker's dirty list.
+	*/
+	struct _proactor_t_node *dirty_next;
+
+	/*
+	 * @brief A boolean value indicating whether the socket has SO_ZEROCOPY enabled.
+	 * @note Such a socket stays in the worker's epoll set for its whole lifetime, so the worker
+	 * 			sees the completions (EPOLLERR) even when it doesn't wait for the socket to become writable.
+	*/
+	bool zerocopy;
+
+	/*
+	 * @brief The sequence number the kernel gives the socket's next zero-copy send.
+	*/
+	uint32_t zc_seq;
+
+	/*
+	 * @brief The socket's oldest zero-copy send that wasn't completed yet, NULL if there's none.
+	*/
+	PProactorZeroCopy zc_head;
+
+	/*
+	 * @brief The socket's newest zero-copy send that wasn't completed yet, NULL if there's none.
+	*/
+	PProactorZeroCopy zc_tail;
+
 	/*
 	 * @brief The next node in the linked list.
 	 * @note For the last node, this is NULL.
 	*/
 	struct _proactor_t_node *next;
+
+	/*
+	 * @brief The previous node in the linked list, so a node is unlinked without walking the list.
+	 * @note For the head node, this is NULL.
+	*/
+	struct _proactor_t_node *prev;
 } ProactorNode, *PProactorNode;
 
+/*
+ * @brief A slab of a worker's client records - PROACTOR_SLAB_NODES nodes in a single allocation.
+ * @param next The worker's next slab.
+ * @param nodes The slab's nodes.
+ * @note A slab is never freed before its worker is destroyed, a free node goes back to the worker's free list.
+*/
+typedef struct _proactor_slab {
+	/*
+	 * @brief The worker's next slab, NULL for the last one.
+	*/
+	struct _proactor_slab *next;
+
+	/*
+	 * @brief The slab's nodes, laid out contiguously.
+	*/
+	ProactorNode nodes[PROACTOR_SLAB_NODES];
+} ProactorSlab, *PProactorSlab;
+
+/*
+ * @brief The type of a job in a proactor worker's queue.
+*/
+typedef enum _proactor_job_type {
+	/*
+	 * @brief Add a file descriptor to the worker's list.
+	*/
+	PROACTOR_JOB_ADD = 0,
+
+	/*
+	 * @brief Remove a file descriptor from the worker's list.
+	*/
+	PROACTOR_JOB_REMOVE,
+
+	/*
+	 * @brief Remove a file descriptor from the worker's list, and close it.
+	*/
+	PROACTOR_JOB_CLOSE,
+
+	/*
+	 * @brief Run the handler of every file descriptor in the worker's list.
+	*/
+	PROACTOR_JOB_RUN,
+
+	/*
+	 * @brief Send a message to a file descriptor, through its outbound queue.
+	*/
+	PROACTOR_JOB_SEND,
+
+	/*
+	 * @brief Send a message to every file descriptor in the worker's list.
+	*/
+	PROACTOR_JOB_BROADCAST,
+
+	/*
+	 * @brief Release a file descriptor's zero-copy sends that another thread read the completions of.
+	*/
+	PROACTOR_JOB_COMPLETE,
+
+	/*
+	 * @brief Stop the worker, after all the jobs before it were done.
+	*/
+	PROACTOR_JOB_STOP
+} ProactorJobType;
+
+/*
+ * @brief A job in a proactor worker's queue.
+ * @param type The job's type.
+ * @param fd The file descriptor to add, remove or close, or the broadcast's sender (-1 for none).
+ * @param handler The file descriptor's handler, for PROACTOR_JOB_ADD.
+ * @param message The message to send, for PROACTOR_JOB_SEND and PROACTOR_JOB_BROADCAST.
+ * @param seq The sequence number of the last completed zero-copy send, for PROACTOR_JOB_COMPLETE.
+ * @param copied The number of completed zero-copy sends the kernel copied anyway, for PROACTOR_JOB_COMPLETE.
+ * @param next The next job in the queue.
+*/
+typedef struct _proactor_job {
+	/*
+	 * @brief The job's type.
+	*/
+	ProactorJobType type;
+
+	/*
+	 * @brief The file descriptor to add, remove or close.
+	 * @note For PROACTOR_JOB_BROADCAST, the file descriptor that doesn't get the message, or -1.
+	*/
+	int fd;
+
+	/*
+	 * @brief The file descriptor's handler, for PROACTOR_JOB_ADD.
+	*/
+	handler_t handler;
+
+	/*
+	 * @brief The message to send, for PROACTOR_JOB_SEND and PROACTOR_JOB_BROADCAST.
+	 * @note The job holds a reference to the message, which is released once the job was done.
+	*/
+	PProactorMessage message;
+
+	/*
+	 * @brief The sequence number of the last completed zero-copy send, for PROACTOR_JOB_COMPLETE.
+	 * @note Every send up to it is done, as the kernel completes the sends in order.
+	*/
+	uint32_t seq;
+
+	/*
+	 * @brief The number of completed zero-copy sends the kernel copied anyway, for PROACTOR_JOB_COMPLETE.
+	*/
+	uint32_t copied;
+
+	/*
+	 * @brief The next job in the queue.
+	 * @note For the last job, this is NULL.
+	*/
+	struct _proactor_job *next;
+} ProactorJob, *PProactorJob;
+
+/*
+ * @brief A proactor worker's counters.
+ * @note Only the worker's thread updates them, except queued_jobs, which is updated under the worker's lock.
+ * 			They can be read from any thread with metricRead(), see metrics.h.
+ * @note Aligned to a cache line, so the workers' counters never share one.
+*/
+typedef struct _proactor_worker_stats {
+	/*
+	 * @brief The number of sendmsg() calls the worker made.
+	*/
+	_Alignas(CACHE_LINE_SIZE) metric_t writes;
+
+	/*
+	 * @brief The total number of bytes the worker wrote to its sockets.
+	*/
+	metric_t bytes_sent;
+
+	/*
+	 * @brief The number of sends the worker dropped because the outbound queue was full.
+	*/
+	metric_t dropped;
+
+	/*
+	 * @brief The number of zero-copy sends the worker made.
+	*/
+	metric_t zc_sends;
+
+	/*
+	 * @brief The number of zero-copy sends the kernel reported as done.
+	*/
+	metric_t zc_completed;
+
+	/*
+	 * @brief The number of zero-copy sends the kernel reported it had to copy anyway (e.g. on loopback).
+	*/
+	metric_t zc_copied;
+
+	/*
+	 * @brief The number of bytes waiting in the outbound queues of all the worker's file descriptors.
+	*/
+	metric_t queued_bytes;
+
+	/*
+	 * @brief The number of jobs waiting in the worker's queue.
+	*/
+	metric_t queued_jobs;
+
+	/*
+	 * @brief The number of nodes in the worker's slabs that are in use.
+	*/
+	metric_t nodes_live;
+
+	/*
+	 * @brief The number of nodes in the worker's slabs that are free.
+	*/
+	metric_t nodes_free;
+
+#if LATENCY_HISTOGRAMS
+	/*
+	 * @brief The time the worker takes to queue a broadcast to all of its clients, in nanoseconds.
+	*/
+	histogram_t fanout_latency;
+
+	/*
+	 * @brief The time from a message's creation until a client's socket took all of it, in nanoseconds.
+	*/
+	histogram_t send_latency;
+#endif
+} ProactorWorkerStats, *PProactorWorkerStats;
+
+/*
+ * @brief A snapshot of proactor workers' counters, see getProactorStats().
+ * @param writes The number of sendmsg() calls.
+ * @param bytes_sent The total number of bytes written to the sockets.
+ * @param dropped The number of sends dropped because an outbound queue was full.
+ * @param zc_sends The number of zero-copy sends.
+ * @param zc_completed The number of zero-copy sends the kernel reported as done.
+ * @param zc_copied The number of zero-copy sends the kernel had to copy anyway.
+ * @param queued_bytes The number of bytes waiting in the outbound queues.
+ * @param queued_jobs The number of jobs waiting in the workers' queues.
+ * @param nodes_live The number of client records in use.
+ * @param nodes_free The number of client records allocated and free.
+*/
+typedef struct _proactor_stats {
+	uint64_t writes;
+	uint64_t bytes_sent;
+	uint64_t dropped;
+	uint64_t zc_sends;
+	uint64_t zc_completed;
+	uint64_t zc_copied;
+	uint64_t queued_bytes;
+	uint64_t queued_jobs;
+	uint64_t nodes_live;
+	uint64_t nodes_free;
+} ProactorStats, *PProactorStats;
+
+/*
+ * @brief A proactor worker - a long-lived thread that owns a share of the proactor's file descriptors.
+ * @note A file descriptor always belongs to the worker at index (fd % workers), so its handler
+ * 			is never run by two threads at the same time.
+ * @note Only the worker's thread touches its linked list, everything else goes through its queue.
+ * @note The worker sleeps in epoll_wait() on its wakeup eventfd and on every file descriptor
+ * 			that has data waiting in its outbound queue, so slow clients are flushed as soon as they
+ * 			become writable, without holding back the rest of them.
+*/
+typedef struct _proactor_worker {
+	/*
+	 * @brief The worker's thread identifier.
+	*/
+	pthread_t thread;
+
+	/*
+	 * @brief The proactor the worker belongs to.
+	*/
+	struct _proactor_t *proactor;
+
+	/*
+	 * @brief The worker's head node, stores a linked list of file descriptors and their handlers.
+	*/
+	PProactorNode head;
+
+	/*
+	 * @brief The worker's file descriptor table - the node of file descriptor fd is at index fd / worker_count,
+	 * 			NULL if there's none.
+	 * @note A worker owns the file descriptors whose remainder by worker_count is its index, so the table stays dense.
+	 * 			It doubles its size whenever a file descriptor doesn't fit, like the reactor's slot table.
+	*/
+	PProactorNode *table;
+
+	/*
+	 * @brief The number of entries in the worker's file descriptor table.
+	*/
+	size_t table_size;
+
+	/*
+	 * @brief The first job in the worker's queue, NULL if the queue is empty.
+	*/
+	PProactorJob queue_head;
+
+	/*
+	 * @brief The last job in the worker's queue, NULL if the queue is empty.
+	*/
+	PProactorJob queue_tail;
+
+	/*
+	 * @brief A boolean value indicating whether the worker was woken up for the jobs in its queue.
+	 * @note PROACTOR_JOB_COMPLETE jobs don't wake the worker up, so the queue may hold jobs without it.
+	*/
+	bool queue_woken;
+
+	/*
+	 * @brief Protects the worker's queue.
+	*/
+	pthread_mutex_t lock;
+
+	/*
+	 * @brief An eventfd that is written whenever a job is added to an empty queue.
+	*/
+	int wake_fd;
+
+	/*
+	 * @brief The worker's epoll instance, watches wake_fd and every file descriptor with a backlog.
+	*/
+	int epoll_fd;
+
+	/*
+	 * @brief The node whose handler is currently running on the worker, NULL if none.
+	 * @note Lets sendProactor() find the node in O(1) when it's called from a handler.
+	*/
+	PProactorNode current;
+
+	/*
+	 * @brief The first node in the worker's dirty list, NULL if no file descriptor has fresh data.
+	*/
+	PProactorNode dirty_head;
+
+	/*
+	 * @brief The worker's slabs of client records, NULL until the first file descriptor is added.
+	*/
+	PProactorSlab slabs;
+
+	/*
+	 * @brief The first free node in the worker's slabs, free nodes are linked through their next field.
+	*/
+	PProactorNode free_nodes;
+
+	/*
+	 * @brief The time the dirty list must be flushed by, in milliseconds of the monotonic clock.
+	 * @note Set to PROACTOR_FLUSH_LATENCY after the dirty list became non-empty.
+	*/
+	uint64_t flush_deadline;
+
+	/*
+	 * @brief A boolean value indicating whether a dirty file descriptor has PROACTOR_MAX_BATCH chunks queued,
+	 * 			in which case the worker flushes without waiting for the latency bound.
+	*/
+	bool batch_full;
+
+	/*
+	 * @brief The worker's counters, can be read from any thread at any time.
+	*/
+	ProactorWorkerStats stats;
+} ProactorWorker, *PProactorWorker;
+
 /*
  * @brief The proactor's structure.
- * @param thread The proactor's thread identifier.
- * @param head The proactor's head node, stores a linked list of file descriptors and their handlers.
- * @param isRunning A boolean value indicating whether the proactor is running.
+ * @param workers The proactor's worker pool.
+ * @param worker_count The number of workers in the pool.
+ * @param isRunning A boolean value indicating whether the worker pool is running.
  * @param size The proactor's size, i.e. the number of file descriptors in the proactor.
+ * @param zerocopy_threshold The minimum size of a message that is sent with MSG_ZEROCOPY, 0 if disabled.
+ * @param drain_timeout How long the workers keep flushing their backlogged sockets once they're stopped, in milliseconds.
 */
 typedef struct _proactor_t {
 	/*
-	 * @brief The proactor's thread identifier.
+	 * @brief The proactor's worker pool.
 	*/
-	pthread_t thread;
+	PProactorWorker workers;
 
 	/*
-	 * @brief The proactor's head node, stores a linked list of file descriptors and their handlers.
+	 * @brief The number of workers in the pool.
 	*/
-	PProactorNode head;
+	size_t worker_count;
 
 	/*
-	 * @brief A boolean value indicating whether the proactor is running.
-	 * @note The value is set to true in runProactor() and to false in cancelProactor().
+	 * @brief A boolean value indicating whether the worker pool is running.
+	 * @note The value is set to true in createProactor() and to false in cancelProactor().
+	 * @note Atomic, as the reactors' threads read it in runProactor() and broadcastProactor()
+	 * 			while the shutdown path clears it from another thread.
 	*/
-	bool isRunning;
+	_Atomic bool isRunning;
 
 	/*
 	 * @brief The proactor's size, i.e. the number of file descriptors in the proactor.
-	 * @note The value is incremented in addFD2Proactor() and decremented in removeHandler().
-	 * 			The value is used to determine whether the proactor is empty.
+	 * @note The value is updated by the workers, when they add or remove a file descriptor.
+	 * @note The value is used to determine whether the proactor is empty.
+	*/
+	_Atomic int size;
+
+	/*
+	 * @brief The minimum size of a message that is sent with MSG_ZEROCOPY, 0 if zero-copy sends are disabled.
+	 * @note Set by createProactor() from PROACTOR_ZEROCOPY_THRESHOLD, or by setProactorZeroCopy().
 	*/
-	int size;
+	size_t zerocopy_threshold;
+
+	/*
+	 * @brief How long the workers keep flushing their backlogged sockets once they're stopped, in milliseconds.
+	 * @note Set by drainProactor(), 0 by cancelProactor().
+	*/
+	unsigned int drain_timeout;
 } Proactor, *PProactor;
 
 
@@ -115,43 +619,238 @@ typedef struct _proactor_t {
 /********************************/
 
 /*
- * @brief Creates a new proactor.
+ * @brief Creates a new proactor, and starts its worker pool.
  * @return A pointer to the new proactor, or NULL on failure.
  * @note The proactor must be freed using the function destroyProactor.
+ * @note The pool has PROACTOR_WORKERS workers by default, which can be overridden at run time
+ * 			by the PROACTOR_WORKERS environment variable.
+ * @note Zero-copy sends use PROACTOR_ZEROCOPY_THRESHOLD, which can be overridden at run time
+ * 			by the PROACTOR_ZEROCOPY_THRESHOLD environment variable.
 */
 void *createProactor();
 
 /*
- * @brief Runs a proactor.
+ * @brief Creates a new proactor with a specific number of workers, and starts its worker pool.
+ * @param workers The number of workers, 0 means one per online CPU.
+ * @return A pointer to the new proactor, or NULL on failure.
+ * @note The proactor must be freed using the function destroyProactor.
+*/
+void *createProactorPool(size_t workers);
+
+/*
+ * @brief Runs a proactor - runs the handler of every file descriptor once, on the worker pool.
  * @param this A pointer to the proactor.
  * @return 0 on success, 1 on failure.
+ * @note The run is only enqueued, so this function never blocks the calling thread,
+ * 			and it's safe to call it from any thread. Running an empty proactor does nothing.
 */
 int runProactor(void *this);
 
 /*
- * @brief Cancels a proactor.
+ * @brief Cancels a proactor - stops its worker pool, after all the enqueued jobs were done.
  * @param this A pointer to the proactor.
  * @return 0 on success, 1 on failure.
+ * @note Whatever the sockets don't accept right away is dropped, see drainProactor().
 */
 int cancelProactor(void *this);
 
+/*
+ * @brief Drains a proactor - stops its worker pool after all the enqueued jobs were done,
+ * 			and the outbound queues were sent or the timeout passed.
+ * @param this A pointer to the proactor.
+ * @param timeout How long the workers may keep waiting for slow sockets to become writable, in milliseconds.
+ * @return 0 on success, 1 on failure.
+ * @note Blocks until every worker stopped, at most about timeout milliseconds after the last job was done.
+*/
+int drainProactor(void *this, unsigned int timeout);
+
 /*
  * @brief Adds a file descriptor to a proactor.
  * @param this A pointer to the proactor.
  * @param fd The file descriptor.
  * @param handler The file descriptor's handler.
  * @return 0 on success, 1 on failure.
+ * @note The addition is enqueued to the file descriptor's worker, it's safe to call it from any thread.
 */
 int addFD2Proactor(void *this, int fd, handler_t handler);
 
+/*
+ * @brief Adds a batch of file descriptors to a proactor, all with the same handler.
+ * @param this A pointer to the proactor.
+ * @param fds The file descriptors.
+ * @param count The number of file descriptors.
+ * @param handler The file descriptors' handler.
+ * @return 0 on success, 1 on failure.
+ * @note Every worker gets its share of the batch in a single enqueue, so the whole batch costs
+ * 			a lock and at most one wakeup per worker, instead of per file descriptor.
+ * @note On failure, some of the file descriptors may have been added already.
+*/
+int addFDs2Proactor(void *this, const int *fds, size_t count, handler_t handler);
+
 /*
  * @brief Removes a file descriptor from a proactor.
  * @param this A pointer to the proactor.
  * @param fd The file descriptor.
  * @return 0 on success, 1 on failure.
+ * @note The removal is enqueued to the file descriptor's worker, it's safe to call it from any thread.
 */
 int removeHandler(void *this, int fd);
 
+/*
+ * @brief Removes a file descriptor from a proactor, and closes it once its worker let go of it.
+ * @param this A pointer to the proactor.
+ * @param fd The file descriptor.
+ * @return 0 on success, 1 on failure.
+ * @note Like removeHandler(), the removal is enqueued to the file descriptor's worker, which closes it right after.
+ * 			Closing it on the caller's thread instead would let the number be reused by a new connection,
+ * 			while the worker still sends the old one's queued data to it.
+ * @note On failure, the file descriptor is left open, as its worker may still use it.
+*/
+int closeHandler(void *this, int fd);
+
+/*
+ * @brief Sends data to a file descriptor of the proactor, without blocking.
+ * @param this A pointer to the proactor.
+ * @param fd The file descriptor.
+ * @param buf The data to send.
+ * @param len The length of the data, in bytes.
+ * @return The number of bytes accepted (len) on success, -1 on failure with errno set.
+ * @note Whatever the socket doesn't accept right away is kept in the file descriptor's outbound queue,
+ * 			and flushed by its worker once the socket becomes writable.
+ * @note When the outbound queue already holds PROACTOR_QUEUE_LIMIT bytes, the data is dropped
+ * 			and errno is set to ENOBUFS. Data is always dropped as a whole, never in the middle.
+ * @note It's safe to call it from any thread. From the file descriptor's own handler, the data is queued
+ * 			right away; from any other thread, a copy of the data is enqueued to the file descriptor's worker
+ * 			and the return value only means that the copy was enqueued.
+ * @note The data goes out with the rest of the file descriptor's queue, in a single sendmsg() call,
+ * 			once the worker finished its current batch of jobs.
+*/
+ssize_t sendProactor(void *this, int fd, const void *buf, size_t len);
+
+/*
+ * @brief Sends a message to every file descriptor of the proactor, without blocking.
+ * @param this A pointer to the proactor.
+ * @param message The message to send.
+ * @return 0 on success, 1 on failure.
+ * @note Every worker takes its own reference to the message, and so does every outbound queue that
+ * 			keeps a part of it, so the message is never copied. The caller keeps its own reference.
+ * @note The broadcast is only enqueued, so this function never blocks the calling thread,
+ * 			and it's safe to call it from any thread.
+*/
+int broadcastProactor(void *this, PProactorMessage message);
+
+/*
+ * @brief Sends a message to every file descriptor of the proactor except its sender, without blocking.
+ * @param this A pointer to the proactor.
+ * @param message The message to send.
+ * @param sender The file descriptor that doesn't get the message.
+ * @return 0 on success, 1 on failure.
+ * @note Works like broadcastProactor() - the message is shared by all the recipients, never copied.
+*/
+int relayProactor(void *this, PProactorMessage message, int sender);
+
+/*
+ * @brief Sets the zero-copy threshold of a proactor.
+ * @param this A pointer to the proactor.
+ * @param threshold The minimum size of a message that is sent with MSG_ZEROCOPY, 0 to disable zero-copy sends.
+ * @return 0 on success, 1 on failure.
+ * @note SO_ZEROCOPY is enabled on a socket when it's added, so the threshold must be set before
+ * 			the file descriptors are added to the proactor.
+ * @note Smaller messages are cheaper to copy than to pin and track, so they're always sent normally.
+*/
+int setProactorZeroCopy(void *this, size_t threshold);
+
+/*
+ * @brief Reads the zero-copy completions from a socket's error queue, and hands them to the socket's worker.
+ * @param this A pointer to the proactor.
+ * @param fd The file descriptor.
+ * @return 0 on success (even if there were no completions), 1 on failure.
+ * @note The completions raise POLLERR for every poller of the socket until they're read, so a reactor that
+ * 			watches the socket reads them as soon as they arrive, instead of waiting for the worker to.
+ * @note Must be called from the thread that adds and removes the file descriptor, so the completions reach
+ * 			the worker before the file descriptor is removed, and never apply to a later connection that reuses it.
+*/
+int completeProactorZeroCopy(void *this, int fd);
+
+/*
+ * @brief Takes a snapshot of a proactor's counters, summed over all of its workers.
+ * @param this A pointer to the proactor.
+ * @param stats A pointer to the snapshot to fill.
+ * @return 0 on success, 1 on failure.
+ * @note Safe to call from any thread while the proactor runs. Every counter is read on its own,
+ * 			so the snapshot isn't atomic as a whole - it's exact once the workers were stopped.
+*/
+int getProactorStats(void *this, PProactorStats stats);
+
+/*
+ * @brief Takes a snapshot of a single proactor worker's counters.
+ * @param this A pointer to the proactor.
+ * @param worker The worker's index, below the proactor's worker_count.
+ * @param stats A pointer to the snapshot to fill.
+ * @return 0 on success, 1 on failure.
+ * @note Safe to call from any thread while the proactor runs, like getProactorStats().
+*/
+int getProactorWorkerStats(void *this, size_t worker, PProactorStats stats);
+
+/*
+ * @brief Gets the number of workers in a proactor's pool.
+ * @param this A pointer to the proactor.
+ * @return The number of workers, 0 if the proactor is NULL.
+*/
+size_t getProactorWorkerCount(void *this);
+
+/*
+ * @brief Checks whether a proactor's workers are running.
+ * @param this A pointer to the proactor.
+ * @return true from createProactor() until cancelProactor() or drainProactor(), false otherwise.
+*/
+bool isProactorRunning(void *this);
+
+#if LATENCY_HISTOGRAMS
+/*
+ * @brief Merges all the workers' latency histograms into snapshots.
+ * @param this A pointer to the proactor.
+ * @param fanout A pointer to the snapshot of the broadcast fan-out latency, which must start zeroed.
+ * @param send A pointer to the snapshot of the send latency, which must start zeroed.
+ * @return 0 on success, 1 on failure.
+ * @note Safe to call from any thread while the proactor runs, like getProactorStats().
+*/
+int getProactorLatency(void *this, histogram_snapshot_t_ptr fanout, histogram_snapshot_t_ptr send);
+#endif
+
+/*
+ * @brief Creates a new immutable message, with a single reference owned by the caller.
+ * @param data The message's data, which is copied into the message.
+ * @param length The length of the data, in bytes.
+ * @return A pointer to the new message, or NULL on failure.
+ * @note The message must be released using the function unrefProactorMessage.
+*/
+PProactorMessage createProactorMessage(const void *data, size_t length);
+
+/*
+ * @brief Creates a new message whose data is filled in by the caller, with a single reference owned by the caller.
+ * @param length The length of the data, in bytes.
+ * @return A pointer to the new message, or NULL on failure.
+ * @note The data may only be written before the message is handed to the proactor, as it's immutable from then on.
+ * 			This lets the caller build the message in place, instead of building it elsewhere and copying it.
+ * @note The message must be released using the function unrefProactorMessage.
+*/
+PProactorMessage allocProactorMessage(size_t length);
+
+/*
+ * @brief Takes another reference to a message.
+ * @param message A pointer to the message.
+ * @return The same message.
+*/
+PProactorMessage refProactorMessage(PProactorMessage message);
+
+/*
+ * @brief Releases a reference to a message, and frees it if it was the last one.
+ * @param message A pointer to the message, may be NULL.
+ * @return void
+*/
+void unrefProactorMessage(PProactorMessage message);
+
 /*
  * @brief Destroys a proactor.
  * @param this A pointer to the proactor.
@@ -18,172 +18,946 @@
 
 #include "reactor.h"
 #include "proactor.h"
+#include "framer.h"
+#include "logger.h"
+#include "sanitizer.h"
+#include "config.h"
+#include "metrics.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <errno.h>
 #include <signal.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
-// The reactor pointer.
-void *reactor = NULL;
+/*
+ * @brief A shard's counters.
+ * @note Only the shard's reactor thread updates them, and they can be read from any thread with metricRead().
+ * @note Aligned to a cache line, so the shards' counters never share one.
+*/
+typedef struct _server_shard_stats
+{
+	// The number of clients the shard accepted in its lifetime, and the number of them that left since.
+	_Alignas(CACHE_LINE_SIZE) metric_t accepted;
+	metric_t closed;
+
+	// The number of clients that were disconnected for being idle, and for sending a message that's too large.
+	metric_t idle_reaped;
+	metric_t oversized;
+
+	// The total number of bytes and messages received from the shard's clients in its lifetime.
+	metric_t bytes_received;
+	metric_t messages_received;
+} server_shard_stats_t, *server_shard_stats_t_ptr;
+
+/*
+ * @brief A reactor shard - an event loop thread with its own listening socket,
+ * 			handler table and statistics.
+ * @note All the shards listen on SERVER_PORT with SO_REUSEPORT, so the kernel
+ * 			spreads the incoming connections between them.
+ * @note All the shards share the proactor, so a broadcast reaches the clients of every shard.
+*/
+typedef struct _server_shard
+{
+	// The shard's index in the shards array.
+	size_t id;
+
+	// The shard's listening socket.
+	int listen_fd;
+
+	// The shard's reactor, runs in its own thread.
+	void *reactor;
+
+	// The receive buffer pool's statistics, taken from the shard's reactor when it's destroyed.
+	uint64_t buffer_hits, buffer_misses;
+
+	// The largest number of receive buffers the shard had in use at the same time.
+	size_t buffer_high_water;
+
+	// The shard's counters, written by its reactor thread and read by the statistics endpoint.
+	server_shard_stats_t stats;
+} server_shard_t, *server_shard_t_ptr;
 
-// The proactor pointer.
+/*
+ * @brief A sample of the server's totals, taken by the statistics endpoint to compute its rates.
+*/
+typedef struct _server_stats_sample
+{
+	// The first shard's reactor clock when the sample was taken, in milliseconds.
+	uint64_t time;
+
+	// The totals of all the shards and proactor workers.
+	uint64_t messages_received;
+	uint64_t bytes_received;
+	uint64_t bytes_sent;
+	uint64_t dropped;
+} server_stats_sample_t, *server_stats_sample_t_ptr;
+
+/*
+ * @brief A client's state, kept in an array indexed by the client's file descriptor.
+ * @note Only the client's reactor thread touches it.
+*/
+typedef struct _server_client
+{
+	// The client's stream framer, which takes its buffer from the reactor's pool.
+	framer_t framer;
+
+	// The client's idle timer, in the reactor's timing wheel.
+	reactor_timer_t idle;
+
+	// The reactor's clock when the client last sent something, in milliseconds.
+	uint64_t last_active;
+} server_client_t, *server_client_t_ptr;
+
+// The proactor pointer, shared by all the shards.
 void *proactor = NULL;
 
-// The number of clients connected to the server in its lifetime.
-uint32_t client_count = 0;
+// The shards array.
+server_shard_t_ptr shards = NULL;
+
+// The number of shards in the shards array.
+size_t shard_count = 0;
+
+// Maps every file descriptor the server owns to the shard that owns it.
+server_shard_t_ptr *fd_owner = NULL;
+
+// The number of entries in the fd_owner array, i.e. the file descriptor limit of the process.
+size_t fd_owner_size = 0;
 
-// The total number of bytes received from clients in the server's lifetime.
-uint64_t total_bytes_received = 0;
+// Every client's state, indexed by file descriptor like fd_owner.
+server_client_t_ptr fd_client = NULL;
 
-// The total number of bytes sent to clients in the server's lifetime.
-uint64_t total_bytes_sent = 0;
+// The server's run-time configuration, loaded once in main() and read-only afterwards.
+server_config_t config;
 
-// A message to send to clients via the proactor.
-char *message = "This is a message from the server! "
-				"A client has sent a message to the server, "
-				"and the server is sending this message back "
-				"to the client via the proactor.\n";
+// The statistics endpoint's timer, and its last two samples (the older one first), only used by the first shard's reactor.
+reactor_timer_t stats_timer;
+server_stats_sample_t stats_samples[2];
 
-int main(void) {
+// The first shard's reactor clock when the server started, in milliseconds.
+uint64_t server_start = 0;
+
+/*
+ * @brief Apply the configured socket options to a socket.
+ * @param fd The socket file descriptor.
+ * @return void
+ * @note A failure is only a warning, as the socket still works with the kernel's defaults.
+*/
+static void socket_tune(int fd) {
+	int nodelay = config.tcp_nodelay ? 1 : 0;
+
+	if (config.rcvbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &config.rcvbuf, sizeof(int)) < 0)
+		logWrite(LOG_LEVEL_WARNING, "setsockopt(SO_RCVBUF) failed: %s\n", strerror(errno));
+
+	if (config.sndbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &config.sndbuf, sizeof(int)) < 0)
+		logWrite(LOG_LEVEL_WARNING, "setsockopt(SO_SNDBUF) failed: %s\n", strerror(errno));
+
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int)) < 0)
+		logWrite(LOG_LEVEL_WARNING, "setsockopt(TCP_NODELAY) failed: %s\n", strerror(errno));
+}
+
+/*
+ * @brief Create a non-blocking listening socket on the configured port.
+ * @return The socket file descriptor on success, -1 otherwise.
+ * @note The socket has SO_REUSEPORT set, so every shard can bind its own socket to the same port.
+ * @note The socket options are set before listen(), so the receive buffer's window scale is
+ * 			negotiated in the handshake, and the accepted sockets inherit them.
+*/
+static int create_listener(void) {
 	struct sockaddr_in server_addr = {
 		.sin_family = AF_INET,
-		.sin_port = htons(SERVER_PORT),
+		.sin_port = htons((uint16_t)config.port),
 		.sin_addr.s_addr = INADDR_ANY
 	};
 
 	int server_fd = -1, reuse = 1;
 
-	fprintf(stdout, "%s", C_INFO_LICENSE);
-
-	signal(SIGINT, signal_handler);
-
-	fprintf(stdout, "%s Starting server...\n", C_PREFIX_INFO);
-
-	if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+	// The socket is non-blocking, so server_handler() can drain it until there are no more pending connections.
+	if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
 	{
 		fprintf(stderr, "%s socket() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		return EXIT_FAILURE;
+		return -1;
 	}
 
 	if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int)) < 0)
 	{
 		fprintf(stderr, "%s setsockopt(SO_REUSEADDR) failed: %s\n", C_PREFIX_ERROR, strerror(errno));
 		close(server_fd);
-		return EXIT_FAILURE;
+		return -1;
 	}
 
+	if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(int)) < 0)
+	{
+		fprintf(stderr, "%s setsockopt(SO_REUSEPORT) failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		close(server_fd);
+		return -1;
+	}
+
+	socket_tune(server_fd);
+
 	if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
 	{
 		fprintf(stderr, "%s bind() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
 		close(server_fd);
-		return EXIT_FAILURE;
+		return -1;
 	}
 
-	if (listen(server_fd, MAX_QUEUE) < 0)
+	if (listen(server_fd, config.backlog) < 0)
 	{
 		fprintf(stderr, "%s listen() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
 		close(server_fd);
-		return EXIT_FAILURE;
+		return -1;
 	}
 
-	fprintf(stdout, "%s Server started successfully.\n", C_PREFIX_INFO);
+	return server_fd;
+}
 
-	fprintf(stdout, "%s Server configuration:\n", C_PREFIX_INFO);
-	fprintf(stdout, "%s Server is set to %s\033[0;37m.\n", C_PREFIX_INFO, (SERVER_PRINT_MSGS ? "\033[0;32mprint messages" : "\033[0;31mnot print messages"));
+/*
+ * @brief The handler of a client's error queue - hand its zero-copy completions to the client's proactor worker.
+ * @param fd The client's file descriptor.
+ * @param react A pointer to the client's reactor.
+ * @return The reactor object, so the client is kept.
+ * @note Runs on the shard's reactor thread, which is also the one that releases the client,
+ * 			so the completions always reach the worker before the client's removal.
+*/
+static void *client_errqueue_handler(int fd, void *react) {
+	completeProactorZeroCopy(proactor, fd);
 
-	fprintf(stdout, "%s Server listening on port \033[0;32m%d\033[0;37m.\n", C_PREFIX_INFO, SERVER_PORT);
+	return react;
+}
 
-	reactor = createReactor();
+/*
+ * @brief A handler for the signalfd, in the first shard's reactor.
+ * @param fd The signalfd file descriptor.
+ * @param react The reactor.
+ * @return The reactor.
+ * @note SIGUSR1 and SIGUSR2 make the log more or less verbose. SIGINT and SIGTERM stop the reactor,
+ * 			and main() then shuts the server down - all of it outside of signal context.
+*/
+static void *signal_fd_handler(int fd, void *react) {
+	struct signalfd_siginfo info;
 
-	if (reactor == NULL)
+	while (read(fd, &info, sizeof(info)) == sizeof(info))
+	{
+		log_level_t level = getLogLevel();
+
+		switch (info.ssi_signo)
+		{
+			case SIGUSR1:
+				if (level < LOG_LEVEL_MESSAGE)
+					setLogLevel(level + 1);
+
+				break;
+
+			case SIGUSR2:
+				if (level > LOG_LEVEL_ERROR)
+					setLogLevel(level - 1);
+
+				break;
+
+			default:
+				logWrite(LOG_LEVEL_INFO, "Got %s, shutting down.\n", strsignal((int)info.ssi_signo));
+				stopReactor(react);
+				break;
+		}
+	}
+
+	return react;
+}
+
+/*
+ * @brief Find the shard that owns a file descriptor.
+ * @param fd The file descriptor.
+ * @return A pointer to the shard, or NULL if the file descriptor isn't owned by any shard.
+*/
+static server_shard_t_ptr shard_of(int fd) {
+	if (fd < 0 || (size_t)fd >= fd_owner_size)
+		return NULL;
+
+	return *(fd_owner + fd);
+}
+
+/*
+ * @brief Set up a shard - its listening socket and reactor.
+ * @param shard A pointer to the shard.
+ * @param id The shard's index in the shards array.
+ * @return 0 on success, 1 otherwise.
+ * @note On failure, whatever was already handed to the reactor is released by shard_destroy().
+*/
+static int shard_setup(server_shard_t_ptr shard, size_t id) {
+	shard->id = id;
+
+	if ((shard->reactor = createReactor()) == NULL)
 	{
 		fprintf(stderr, "%s createReactor() failed: %s\n", C_PREFIX_ERROR, strerror(ENOSPC));
-		close(server_fd);
+		return 1;
+	}
+
+	reactorSetPollTimeout(shard->reactor, config.poll_timeout);
+	reactorSetErrorQueueHandler(shard->reactor, client_errqueue_handler);
+
+	if ((shard->listen_fd = create_listener()) < 0)
+		return 1;
+
+	if ((size_t)shard->listen_fd >= fd_owner_size)
+	{
+		fprintf(stderr, "%s Shard %zu listening socket is above the file descriptor limit.\n", C_PREFIX_ERROR, id);
+		close(shard->listen_fd);
+		return 1;
+	}
+
+	if (addFd(shard->reactor, shard->listen_fd, server_handler) < 0)
+	{
+		fprintf(stderr, "%s addFd() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		close(shard->listen_fd);
+		return 1;
+	}
+
+	*(fd_owner + shard->listen_fd) = shard;
+
+	fprintf(stdout, "%s Shard %zu listening on port \033[0;32m%d\033[0;37m (file descriptor %d).\n", C_PREFIX_INFO, id, config.port, shard->listen_fd);
+
+	return 0;
+}
+
+/*
+ * @brief Destroy a shard - stop its reactor, close all of its sockets and free its memory.
+ * @param shard A pointer to the shard.
+ * @return void
+*/
+static void shard_destroy(server_shard_t_ptr shard) {
+	if (shard->reactor != NULL)
+	{
+		reactor_buffer_stats_t buffers = { 0 };
+
+		if (reactorRunning(shard->reactor))
+			stopReactor(shard->reactor);
+
+		// The clients' partial messages go back to the pool before it's unmapped.
+		for (size_t fd = 0; fd < fd_owner_size; ++fd)
+		{
+			if (*(fd_owner + fd) == shard)
+				framerReset(&(fd_client + fd)->framer);
+		}
+
+		reactorBufferStats(shard->reactor, &buffers);
+
+		shard->buffer_hits += buffers.hits;
+		shard->buffer_misses += buffers.misses + buffers.oversized;
+		shard->buffer_high_water = buffers.high_water;
+
+		destroyReactor(shard->reactor);
+		shard->reactor = NULL;
+	}
+}
+
+/*
+ * @brief Build the message that relays a client's message to the other clients.
+ * @param frame The client's message, without its framing.
+ * @param len The length of the message, in bytes.
+ * @return A pointer to the relay message, or NULL on failure.
+ * @note The message is framed the same way the clients frame theirs, and built right in the proactor message,
+ * 			which all the recipients share - so the payload is copied once, however many clients get it.
+*/
+static PProactorMessage relay_message(const char *frame, size_t len) {
+	size_t header = (config.framing == FRAMER_MODE_LENGTH) ? sizeof(uint32_t) : 0;
+	size_t trailer = (config.framing == FRAMER_MODE_NEWLINE) ? 1 : 0;
+	PProactorMessage relay = allocProactorMessage(header + len + trailer);
+
+	if (relay == NULL)
+		return NULL;
+
+	if (config.framing == FRAMER_MODE_LENGTH)
+	{
+		uint32_t length = htonl((uint32_t)len);
+
+		memcpy(relay->data, &length, sizeof(length));
+	}
+
+	memcpy(relay->data + header, frame, len);
+
+	if (trailer > 0)
+		*(relay->data + header + len) = '\n';
+
+	return relay;
+}
+
+/*
+ * @brief Release everything a client holds, and close its socket.
+ * @param react A pointer to the client's reactor.
+ * @param fd The client's file descriptor.
+ * @return void
+ * @note The client must already be out of the reactor, or about to be (its handler returns NULL).
+ * @note The socket is only shut down here, its proactor worker closes it once it dropped the client's queued data -
+ * 			until then, the number can't be reused by a new client that would get the old one's data.
+*/
+static void client_release(void *react, int fd) {
+	server_client_t_ptr client = (fd_client + fd);
+
+	server_shard_t_ptr shard = shard_of(fd);
+
+	*(fd_owner + fd) = NULL;
+
+	if (shard != NULL)
+		metricAdd(&shard->stats.closed, 1);
+
+	reactorTimerCancel(react, &client->idle);
+	framerReset(&client->framer);
+
+	// Remove the client from the proactor, which closes the socket.
+	shutdown(fd, SHUT_RDWR);
+	closeHandler(proactor, fd);
+}
+
+/*
+ * @brief The handler of a client's idle timer - disconnect the client if it was silent for SERVER_IDLE_TIMEOUT.
+ * @param react A pointer to the client's reactor.
+ * @param timer A pointer to the client's idle timer.
+ * @return void
+ * @note The timer isn't re-armed on every message, that would cost a wheel update per read. Instead, the
+ * 			handler checks when the client was last active, and arms the timer again for the rest of the timeout.
+*/
+static void client_idle_handler(void *react, reactor_timer_t_ptr timer) {
+	server_client_t_ptr client = (server_client_t_ptr)timer->arg;
+	int fd = (int)(client - fd_client);
+	uint64_t idle = reactorNow(react) - client->last_active;
+
+	if (idle < SERVER_IDLE_TIMEOUT)
+	{
+		reactorTimerArm(react, timer, SERVER_IDLE_TIMEOUT - idle, 0);
+		return;
+	}
+
+	logWrite(LOG_LEVEL_WARNING, "Client %d was idle for %llu seconds, disconnecting it.\n", fd, (unsigned long long)(idle / 1000));
+	metricAdd(&shard_of(fd)->stats.idle_reaped, 1);
+
+	removeFd(react, fd);
+	client_release(react, fd);
+}
+
+/*
+ * @brief Take a sample of the server's totals.
+ * @param react A pointer to the first shard's reactor, whose clock times the sample.
+ * @param sample A pointer to the sample to fill.
+ * @return void
+*/
+static void stats_sample(void *react, server_stats_sample_t_ptr sample) {
+	ProactorStats proactor_stats = { 0 };
+
+	memset(sample, 0, sizeof(server_stats_sample_t));
+	sample->time = reactorNow(react);
+
+	for (size_t i = 0; i < shard_count; ++i)
+	{
+		sample->messages_received += metricRead(&(shards + i)->stats.messages_received);
+		sample->bytes_received += metricRead(&(shards + i)->stats.bytes_received);
+	}
+
+	getProactorStats(proactor, &proactor_stats);
+	sample->bytes_sent = proactor_stats.bytes_sent;
+	sample->dropped = proactor_stats.dropped;
+}
+
+/*
+ * @brief The handler of the statistics timer - take a new sample every SERVER_STATS_INTERVAL.
+ * @param react A pointer to the first shard's reactor.
+ * @param timer A pointer to the statistics timer.
+ * @return void
+*/
+static void stats_timer_handler(void *react, reactor_timer_t_ptr timer) {
+	(void)timer;
+
+	*stats_samples = *(stats_samples + 1);
+	stats_sample(react, (stats_samples + 1));
+}
+
+/*
+ * @brief Get the rate of a counter between the last two samples.
+ * @param older The counter's value in the older sample.
+ * @param newer The counter's value in the newer sample.
+ * @return The rate, per second.
+*/
+static double stats_rate(uint64_t older, uint64_t newer) {
+	uint64_t elapsed = (stats_samples + 1)->time - stats_samples->time;
+
+	return (elapsed > 0 && stats_samples->time > 0) ? (double)(newer - older) * 1000.0 / (double)elapsed : 0.0;
+}
+
+#if LATENCY_HISTOGRAMS
+/*
+ * @brief Render a latency histogram's percentiles as a JSON field.
+ * @param json The stream to render to.
+ * @param name The field's name.
+ * @param snapshot A pointer to the histogram's merged snapshot.
+ * @param last Whether this is the last field of its object.
+ * @return void
+*/
+static void stats_latency(FILE *json, const char *name, histogram_snapshot_t_ptr snapshot, bool last) {
+	fprintf(json, "    \"%s\": { \"count\": %lu, \"p50\": %lu, \"p99\": %lu, \"p999\": %lu, \"max\": %lu }%s\n", name,
+					snapshot->count, histogramPercentile(snapshot, 50.0), histogramPercentile(snapshot, 99.0),
+					histogramPercentile(snapshot, 99.9), snapshot->max, (last ? "" : ","));
+}
+#endif
+
+/*
+ * @brief Render the server's statistics as JSON.
+ * @param react A pointer to the first shard's reactor.
+ * @param len A pointer to where to store the length of the rendered statistics.
+ * @return The rendered statistics, which must be freed with free(), or NULL on failure.
+ * @note The counters are summed up only now, from every shard's and proactor worker's own counters.
+*/
+static char *stats_render(void *react, size_t *len) {
+	server_stats_sample_t_ptr older = stats_samples, newer = (stats_samples + 1);
+	server_stats_sample_t now;
+	uint64_t accepted = 0, closed = 0, idle_reaped = 0, oversized = 0;
+	ProactorStats proactor_stats = { 0 };
+	char *body = NULL;
+	FILE *json = open_memstream(&body, len);
+
+	if (json == NULL)
+		return NULL;
+
+	for (size_t i = 0; i < shard_count; ++i)
+	{
+		server_shard_stats_t_ptr stats = &(shards + i)->stats;
+
+		accepted += metricRead(&stats->accepted);
+		closed += metricRead(&stats->closed);
+		idle_reaped += metricRead(&stats->idle_reaped);
+		oversized += metricRead(&stats->oversized);
+	}
+
+	// The totals are taken right now, and the rates over the last sampling interval.
+	stats_sample(react, &now);
+	getProactorStats(proactor, &proactor_stats);
+
+	fprintf(json, "{\n  \"uptime_ms\": %lu,\n", now.time - server_start);
+	fprintf(json, "  \"connections\": { \"active\": %lu, \"accepted\": %lu, \"closed\": %lu, \"idle_reaped\": %lu },\n",
+					accepted - closed, accepted, closed, idle_reaped);
+	fprintf(json, "  \"messages\": { \"received\": %lu, \"received_per_sec\": %.1f, \"oversized\": %lu },\n",
+					now.messages_received, stats_rate(older->messages_received, newer->messages_received), oversized);
+	fprintf(json, "  \"bytes\": { \"received\": %lu, \"received_per_sec\": %.1f, \"sent\": %lu, \"sent_per_sec\": %.1f },\n",
+					now.bytes_received, stats_rate(older->bytes_received, newer->bytes_received),
+					now.bytes_sent, stats_rate(older->bytes_sent, newer->bytes_sent));
+	fprintf(json, "  \"drops\": { \"queue_full\": %lu, \"queue_full_per_sec\": %.1f, \"log_records\": %lu },\n",
+					now.dropped, stats_rate(older->dropped, newer->dropped), getLogDropped());
+	fprintf(json, "  \"proactor\": { \"writes\": %lu, \"zerocopy_sends\": %lu, \"zerocopy_copied\": %lu, \"queued_jobs\": %lu, \"queued_bytes\": %lu },\n",
+					proactor_stats.writes, proactor_stats.zc_sends, proactor_stats.zc_copied, proactor_stats.queued_jobs, proactor_stats.queued_bytes);
+
+#if LATENCY_HISTOGRAMS
+	// Every shard and worker records into its own histograms, so they're merged here, like the counters.
+	histogram_snapshot_t dispatch = { 0 }, handler = { 0 }, fanout = { 0 }, send = { 0 };
+
+	for (size_t i = 0; i < shard_count; ++i)
+		reactorLatency((shards + i)->reactor, &dispatch, &handler);
+
+	getProactorLatency(proactor, &fanout, &send);
+
+	fprintf(json, "  \"latency_ns\": {\n");
+	stats_latency(json, "dispatch", &dispatch, false);
+	stats_latency(json, "handler", &handler, false);
+	stats_latency(json, "fanout", &fanout, false);
+	stats_latency(json, "send", &send, true);
+	fprintf(json, "  },\n");
+#endif
+
+	fprintf(json, "  \"shards\": [");
+
+	for (size_t i = 0; i < shard_count; ++i)
+	{
+		server_shard_stats_t_ptr stats = &(shards + i)->stats;
+
+		fprintf(json, "%s\n    { \"id\": %zu, \"active\": %lu, \"messages_received\": %lu, \"bytes_received\": %lu }", (i > 0 ? "," : ""), i,
+						metricRead(&stats->accepted) - metricRead(&stats->closed), metricRead(&stats->messages_received),
+						metricRead(&stats->bytes_received));
+	}
+
+	fprintf(json, "\n  ],\n  \"workers\": [");
+
+	for (size_t i = 0; i < getProactorWorkerCount(proactor); ++i)
+	{
+		getProactorWorkerStats(proactor, i, &proactor_stats);
+
+		fprintf(json, "%s\n    { \"id\": %zu, \"queued_jobs\": %lu, \"queued_bytes\": %lu, \"bytes_sent\": %lu, \"dropped\": %lu }", (i > 0 ? "," : ""), i,
+						proactor_stats.queued_jobs, proactor_stats.queued_bytes, proactor_stats.bytes_sent, proactor_stats.dropped);
+	}
+
+	fprintf(json, "\n  ]\n}\n");
+
+	if (fclose(json) != 0)
+	{
+		free(body);
+		return NULL;
+	}
+
+	return body;
+}
+
+/*
+ * @brief A handler for a statistics endpoint connection - answer its request and close it.
+ * @param fd The connection's file descriptor.
+ * @param react A pointer to the first shard's reactor.
+ * @return NULL once the request was answered, the reactor if it didn't arrive yet.
+ * @note The requests are tiny and local, so the whole request is expected in a single read,
+ * 			and the whole response is sent in a single call.
+*/
+static void *stats_client_handler(int fd, void *react) {
+	char request[1024];
+	ssize_t bytes_read = reactorRecv(react, fd, request, sizeof(request) - 1);
+
+	if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		return react;
+
+	if (bytes_read <= 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	*(request + bytes_read) = '\0';
+
+	char header[256];
+	char *body = NULL;
+	size_t body_len = 0;
+
+	if (strncmp(request, "GET /stats ", 11) == 0 || strncmp(request, "GET / ", 6) == 0)
+		body = stats_render(react, &body_len);
+
+	int header_len = snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+								(body != NULL ? "200 OK" : "404 Not Found"), (body != NULL ? "application/json" : "text/plain"),
+								(body != NULL ? body_len : 10));
+
+	struct iovec iov[2] = {
+		{ .iov_base = header, .iov_len = (size_t)header_len },
+		{ .iov_base = (body != NULL ? body : "Not Found\n"), .iov_len = (body != NULL ? body_len : 10) }
+	};
+
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+	size_t total = iov->iov_len + (iov + 1)->iov_len;
+	int sndbuf = (int)total;
+
+	// The response is sent at once, so the socket's buffer is made large enough for it (the kernel's default is 16 KB).
+	if (total > 16384)
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(int));
+
+	ssize_t bytes_sent = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+	if (bytes_sent < 0 || (size_t)bytes_sent < total)
+		logWrite(LOG_LEVEL_WARNING, "Statistics response was cut short (%zd of %zu bytes).\n", bytes_sent, total);
+
+	free(body);
+	close(fd);
+
+	return NULL;
+}
+
+/*
+ * @brief A handler for the statistics endpoint's listening socket.
+ * @param fd The listening socket's file descriptor.
+ * @param react A pointer to the first shard's reactor.
+ * @return The reactor.
+*/
+static void *stats_handler(int fd, void *react) {
+	int client_fd = -1;
+
+	while ((client_fd = reactorAccept(react, fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0 || errno == EINTR || errno == ECONNABORTED)
+	{
+		if (client_fd >= 0 && addFd(react, client_fd, stats_client_handler) < 0)
+		{
+			logWrite(LOG_LEVEL_ERROR, "addFd() failed: %s\n", strerror(errno));
+			close(client_fd);
+		}
+	}
+
+	if (errno != EAGAIN && errno != EWOULDBLOCK)
+		logWrite(LOG_LEVEL_ERROR, "accept() failed: %s\n", strerror(errno));
+
+	return react;
+}
+
+/*
+ * @brief Start the statistics endpoint in a reactor - a loopback listening socket and the sampling timer.
+ * @param react A pointer to the reactor, which must not be running yet.
+ * @return void
+ * @note The endpoint is optional, so a failure is only a warning.
+*/
+static void stats_start(void *react) {
+	struct sockaddr_in stats_addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons((uint16_t)config.stats_port),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+	};
+
+	int stats_fd = -1, reuse = 1;
+
+	if (config.stats_port == 0)
+		return;
+
+	if ((stats_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) == -1)
+	{
+		fprintf(stderr, "%s Statistics endpoint: socket() failed: %s\n", C_PREFIX_WARNING, strerror(errno));
+		return;
+	}
+
+	if (setsockopt(stats_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int)) < 0 ||
+		bind(stats_fd, (struct sockaddr *)&stats_addr, sizeof(stats_addr)) < 0 ||
+		listen(stats_fd, 16) < 0)
+	{
+		fprintf(stderr, "%s Statistics endpoint on port %d is disabled: %s\n", C_PREFIX_WARNING, config.stats_port, strerror(errno));
+		close(stats_fd);
+		return;
+	}
+
+	// The reactor owns the listening socket from here on, and closes it when it's destroyed.
+	if (addFd(react, stats_fd, stats_handler) < 0)
+	{
+		fprintf(stderr, "%s Statistics endpoint on port %d is disabled: %s\n", C_PREFIX_WARNING, config.stats_port, strerror(errno));
+		close(stats_fd);
+		return;
+	}
+
+	stats_sample(react, (stats_samples + 1));
+	reactorTimerInit(&stats_timer, stats_timer_handler, NULL);
+	reactorTimerArm(react, &stats_timer, SERVER_STATS_INTERVAL, SERVER_STATS_INTERVAL);
+
+	fprintf(stdout, "%s Statistics endpoint on \033[0;32mhttp://127.0.0.1:%d/stats\033[0;37m.\n", C_PREFIX_INFO, config.stats_port);
+}
+
+int main(int argc, char **argv) {
+	struct rlimit limit;
+
+	fprintf(stdout, "%s", C_INFO_LICENSE);
+
+	switch (configLoad(&config, argc, argv))
+	{
+		case 0:
+			break;
+
+		case 1:
+			return EXIT_SUCCESS;
+
+		default:
+			return EXIT_FAILURE;
+	}
+
+	sigset_t signal_set;
+
+	sigemptyset(&signal_set);
+	sigaddset(&signal_set, SIGINT);
+	sigaddset(&signal_set, SIGTERM);
+	sigaddset(&signal_set, SIGUSR1);
+	sigaddset(&signal_set, SIGUSR2);
+
+	// The signals are blocked in every thread, as they're only read from the signalfd, by the first shard's reactor.
+	// A signal that arrives before the signalfd is created stays pending until then.
+	pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
+
+	fprintf(stdout, "%s Starting server...\n", C_PREFIX_INFO);
+
+	// A count of 0 means one per online CPU, which is resolved here so the printed configuration is the effective one.
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (config.reactor_threads == 0)
+		config.reactor_threads = (cpus > 0) ? (size_t)cpus : 1;
+
+	if (config.proactor_workers == 0)
+		config.proactor_workers = (cpus > 0) ? (size_t)cpus : 1;
+
+	if (getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur > FD_OWNER_MAX)
+		fd_owner_size = FD_OWNER_MAX;
+
+	else
+		fd_owner_size = (size_t)limit.rlim_cur;
+
+	fd_owner = (server_shard_t_ptr *)calloc(fd_owner_size, sizeof(server_shard_t_ptr));
+	fd_client = (server_client_t_ptr)calloc(fd_owner_size, sizeof(server_client_t));
+	// The shards' counters are aligned to a cache line, so the array must be too.
+	if ((shards = (server_shard_t_ptr)aligned_alloc(CACHE_LINE_SIZE, config.reactor_threads * sizeof(server_shard_t))) != NULL)
+		memset(shards, 0, config.reactor_threads * sizeof(server_shard_t));
+
+	if (fd_owner == NULL || fd_client == NULL || shards == NULL)
+	{
+		fprintf(stderr, "%s calloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		free(fd_owner);
+		free(fd_client);
+		free(shards);
 		return EXIT_FAILURE;
 	}
 
-	proactor = createProactor();
+	shard_count = config.reactor_threads;
 
-	if (proactor == NULL)
+	// From here on, the hot paths only queue their messages, and the logger's thread prints them.
+	if (startLogger() != 0)
+		fprintf(stderr, "%s The logger couldn't start, logging synchronously.\n", C_PREFIX_WARNING);
+
+	if ((proactor = createProactorPool(config.proactor_workers)) == NULL)
 	{
-		fprintf(stderr, "%s createProactor() failed: %s\n", C_PREFIX_ERROR, strerror(ENOSPC));
-		close(server_fd);
-		free(reactor);
+		fprintf(stderr, "%s createProactorPool() failed: %s\n", C_PREFIX_ERROR, strerror(ENOSPC));
+		stopLogger();
+		free(shards);
+		free(fd_owner);
+		free(fd_client);
 		return EXIT_FAILURE;
 	}
 
-	fprintf(stdout, "%s Adding server socket to reactor...\n", C_PREFIX_INFO);
+	setProactorZeroCopy(proactor, config.zerocopy_threshold);
 
-	addFd(reactor, server_fd, server_handler);
+	for (size_t i = 0; i < shard_count; ++i)
+	{
+		if (shard_setup((shards + i), i) != 0)
+		{
+			for (size_t j = 0; j <= i; ++j)
+				shard_destroy(shards + j);
+
+			destroyProactor(proactor);
+			stopLogger();
+			free(shards);
+			free(fd_owner);
+			free(fd_client);
+			return EXIT_FAILURE;
+		}
+	}
 
-	if (((reactor_t_ptr)reactor)->head == NULL)
+	int signal_fd = signalfd(-1, &signal_set, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	// The reactor owns the signalfd from here on, and closes it when it's destroyed.
+	if (signal_fd < 0 || addFd(shards->reactor, signal_fd, signal_fd_handler) < 0)
 	{
-		fprintf(stderr, "%s addFd() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		close(server_fd);
-		free(reactor);
-		free(proactor);
+		fprintf(stderr, "%s %s failed: %s\n", C_PREFIX_ERROR, (signal_fd < 0 ? "signalfd()" : "addFd()"), strerror(errno));
+
+		if (signal_fd >= 0)
+			close(signal_fd);
+
+		for (size_t i = 0; i < shard_count; ++i)
+			shard_destroy(shards + i);
+
+		destroyProactor(proactor);
+		stopLogger();
+		free(shards);
+		free(fd_owner);
+		free(fd_client);
 		return EXIT_FAILURE;
 	}
 
-	fprintf(stdout, "%s Server socket added to reactor successfully.\n", C_PREFIX_INFO);
+	server_start = reactorNow(shards->reactor);
+	stats_start(shards->reactor);
 
-	startReactor(reactor);
-	WaitFor(reactor);
+	fprintf(stdout, "%s Server started successfully.\n", C_PREFIX_INFO);
+
+	fprintf(stdout, "%s Server configuration:\n", C_PREFIX_INFO);
+	configPrint(&config, stdout);
+	fprintf(stdout, "%s Server is sanitizing messages with the \033[0;32m%s\033[0;37m kernel.\n", C_PREFIX_INFO, sanitizerKernelName());
+	fprintf(stdout, "%s Server is framing messages up to %d bytes each.\n", C_PREFIX_INFO, SERVER_MAX_FRAME);
+
+	fprintf(stdout, "%s Server listening on port \033[0;32m%d\033[0;37m.\n", C_PREFIX_INFO, config.port);
+
+	for (size_t i = 0; i < shard_count; ++i)
+		startReactor((*(shards + i)).reactor);
+
+	// The first shard's reactor stops once it reads SIGINT or SIGTERM from the signalfd.
+	WaitFor(shards->reactor);
 
-	signal_handler();
+	server_shutdown();
 
 	return EXIT_SUCCESS;
 }
 
-void signal_handler() {
+void server_shutdown(void) {
 	fprintf(stdout, "%s%s Server shutting down...\n", MACRO_CLEANUP, C_PREFIX_INFO);
 	
-	if (reactor != NULL)
+	if (shards != NULL)
 	{
+		// Nothing is read from the clients from here on, so the proactor only has to send what it already has.
+		for (size_t i = 0; i < shard_count; ++i)
+		{
+			server_shard_t_ptr shard = (shards + i);
+
+			if (reactorRunning(shard->reactor))
+				stopReactor(shard->reactor);
+		}
+
+		// Stop accepting right away - new connections are refused, rather than left in the backlog until the drain ends.
+		for (size_t i = 0; i < shard_count; ++i)
+		{
+			server_shard_t_ptr shard = (shards + i);
+
+			if (shard->reactor == NULL || shard->listen_fd < 0)
+				continue;
+
+			removeFd(shard->reactor, shard->listen_fd);
+			close(shard->listen_fd);
+			*(fd_owner + shard->listen_fd) = NULL;
+			shard->listen_fd = -1;
+		}
+
+		uint64_t client_count = 0, total_bytes_received = 0, total_messages_received = 0;
+		ProactorStats proactor_stats = { 0 };
+
 		if (proactor != NULL)
 		{
-			fprintf(stdout, "%s Cancelling all proactor operations...\n", C_PREFIX_INFO);
+			fprintf(stdout, "%s Sending the clients' pending data (up to %d ms)...\n", C_PREFIX_INFO, SERVER_DRAIN_TIMEOUT);
 
-			if (((PProactor)proactor)->isRunning)
-				cancelProactor(proactor);
+			// The workers' counters are only stable once they were stopped.
+			if (isProactorRunning(proactor))
+				drainProactor(proactor, SERVER_DRAIN_TIMEOUT);
 
-			fprintf(stdout, "%s Proactor operations cancelled successfully.\n", C_PREFIX_INFO);
+			getProactorStats(proactor, &proactor_stats);
 
 			destroyProactor(proactor);
-		}
+			proactor = NULL;
 
-		if (((reactor_t_ptr)reactor)->running)
-			stopReactor(reactor);
+			fprintf(stdout, "%s Proactor stopped successfully.\n", C_PREFIX_INFO);
+		}
 
 		fprintf(stdout, "%s Closing all sockets and freeing memory...\n", C_PREFIX_INFO);
 
-		reactor_node_ptr curr = ((reactor_t_ptr)reactor)->head;
-		reactor_node_ptr prev = NULL;
+		for (size_t i = 0; i < shard_count; ++i)
+			shard_destroy(shards + i);
+
+		// Nothing logs anymore, so whatever is still queued is printed before the statistics.
+		stopLogger();
+
+		fprintf(stdout, "%s Memory cleanup complete, may the force be with you.\n", C_PREFIX_INFO);
+		fprintf(stdout, "%s Statistics:\n", C_PREFIX_INFO);
 
-		while (curr != NULL)
+		for (size_t i = 0; i < shard_count; ++i)
 		{
-			prev = curr;
-			curr = curr->next;
+			server_shard_t_ptr shard = (shards + i);
 
-			close(prev->fd);
-			free(prev);
+			fprintf(stdout, "%s Shard %zu: %lu clients, %lu messages and %lu bytes received.\n", C_PREFIX_INFO,
+							shard->id, metricRead(&shard->stats.accepted), metricRead(&shard->stats.messages_received),
+							metricRead(&shard->stats.bytes_received));
+			fprintf(stdout, "%s Shard %zu receive buffers: %lu pool hits, %lu misses, at most %zu in use.\n", C_PREFIX_INFO,
+							shard->id, shard->buffer_hits, shard->buffer_misses, shard->buffer_high_water);
+
+			client_count += metricRead(&shard->stats.accepted);
+			total_bytes_received += metricRead(&shard->stats.bytes_received);
+			total_messages_received += metricRead(&shard->stats.messages_received);
 		}
 
-		free(reactor);
+		uint64_t total_bytes_sent = proactor_stats.bytes_sent;
 
-		fprintf(stdout, "%s Memory cleanup complete, may the force be with you.\n", C_PREFIX_INFO);
-		fprintf(stdout, "%s Statistics:\n", C_PREFIX_INFO);
-		fprintf(stdout, "%s Client count in this session: %d\n", C_PREFIX_INFO, client_count);
+		fprintf(stdout, "%s Client count in this session: %lu\n", C_PREFIX_INFO, client_count);
+		fprintf(stdout, "%s Total messages received in this session: %lu\n", C_PREFIX_INFO, total_messages_received);
 		fprintf(stdout, "%s Total bytes received in this session: %lu bytes (%lu KB / %lu MB).\n", C_PREFIX_INFO, 
 						total_bytes_received, total_bytes_received / 1024, (total_bytes_received / 1024) / 1024);
 		fprintf(stdout, "%s Total bytes sent in this session: %lu bytes (%lu KB / %lu MB).\n", C_PREFIX_INFO, 
 						total_bytes_sent, total_bytes_sent / 1024, (total_bytes_sent / 1024) / 1024);
+		fprintf(stdout, "%s Total send calls in this session: %lu (%lu zero-copy, %lu of them copied by the kernel)\n", C_PREFIX_INFO,
+						proactor_stats.writes, proactor_stats.zc_sends, proactor_stats.zc_copied);
+		fprintf(stdout, "%s Total messages dropped on full client queues: %lu\n", C_PREFIX_INFO, proactor_stats.dropped);
+		fprintf(stdout, "%s Proactor client records at shutdown: %lu live, %lu free.\n", C_PREFIX_INFO,
+						proactor_stats.nodes_live, proactor_stats.nodes_free);
+		fprintf(stdout, "%s Log records dropped on a full logger ring: %lu\n", C_PREFIX_INFO, getLogDropped());
+		fprintf(stdout, "%s Log strings cut short for lack of memory: %lu\n", C_PREFIX_INFO, getLogTruncated());
 
 		if (client_count > 0)
 		{
@@ -194,145 +968,207 @@ void signal_handler() {
 							total_bytes_sent / client_count, (total_bytes_sent / client_count) / 1024, 
 							((total_bytes_sent / client_count) / 1024) / 1024);
 		}
+
+		free(shards);
+		free(fd_owner);
+		free(fd_client);
 	}
 
 	else
 		fprintf(stdout, "%s Reactor wasn't created, no memory cleanup needed.\n", C_PREFIX_INFO);
 
 	fprintf(stdout, "%s Server is now offline, goodbye.\n", C_PREFIX_INFO);
-
-	exit(EXIT_SUCCESS);
 }
 
 void *client_handler(int fd, void *react) {
-	char *buf = (char *)calloc(MAX_BUFFER, sizeof(char));
-
-	if (buf == NULL)
-	{
-		fprintf(stderr, "%s calloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		close(fd);
-		return NULL;
-	}
+	server_shard_t_ptr shard = shard_of(fd);
+	server_client_t_ptr client = (fd_client + fd);
+	framer_t_ptr framer = &client->framer;
 
-	int bytes_read = recv(fd, buf, MAX_BUFFER, 0);
+	// In edge-triggered mode the readiness is reported only once, so the socket is drained
+	// until EAGAIN, or until the read budget is used up and the rest waits for the next pass.
+	bool drain = reactorEdgeTriggered(react);
+	size_t budget = reactorReadBudget(react), total = 0;
+	void *ret = react;
 
-	if (bytes_read <= 0)
+	do
 	{
-		if (bytes_read < 0)
-			fprintf(stderr, "%s recv() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		size_t space = 0;
 
-		else
-			fprintf(stdout, "%s Client %d disconnected.\n", C_PREFIX_WARNING, fd);
+		// The data is received right after the partial message of the previous read, if there is one.
+		char *buf = framerBuffer(framer, &space);
 
-		// Remove the client from the proactor.
-		removeHandler(proactor, fd);
-		
-		free(buf);
-		close(fd);
-		return NULL;
-	}
+		if (buf == NULL)
+		{
+			logWrite(LOG_LEVEL_ERROR, "framerBuffer() failed: %s\n", strerror(errno));
+			ret = NULL;
+			break;
+		}
 
-	total_bytes_received += bytes_read;
+		ssize_t bytes_read = reactorRecv(react, fd, buf, space);
 
-	// Make sure the buffer is null-terminated, so we can print it.
-	if (bytes_read < MAX_BUFFER)
-		*(buf + bytes_read) = '\0';
+		if (bytes_read <= 0)
+		{
+			// The socket is non-blocking, so a wakeup without data isn't an error.
+			if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+				break;
 
-	else
-		*(buf + MAX_BUFFER - 1) = '\0';
+			if (bytes_read < 0)
+				logWrite(LOG_LEVEL_ERROR, "recv() failed: %s\n", strerror(errno));
 
-	// Remove the arrow keys from the buffer, as they are not printable and mess up the output,
-	// and replace them with spaces, so the rest of the message won't cut off.
-	for (int i = 0; i < bytes_read - 3; i++)
-	{
-		if ((*(buf + i) == 0x1b) && (*(buf + i + 1) == 0x5b) && (*(buf + i + 2) == 0x41 || *(buf + i + 2) == 0x42 || *(buf + i + 2) == 0x43 || *(buf + i + 2)== 0x44))
-		{
-			*(buf + i) = 0x20;
-			*(buf + i + 1) = 0x20;
-			*(buf + i + 2) = 0x20;
+			else
+				logWrite(LOG_LEVEL_WARNING, "Client %d disconnected.\n", fd);
 
-			i += 2;
+			ret = NULL;
+			break;
 		}
-	}
 
-	// Print the message to the server.
-	// We don't need to print it if the server is not configured to print messages.
-	if (SERVER_PRINT_MSGS)
-		fprintf(stdout, "%s Client %d: %s\n", C_PREFIX_MESSAGE, fd, buf);
+		metricAdd(&shard->stats.bytes_received, (uint64_t)bytes_read);
+		client->last_active = reactorNow(react);
+		total += (size_t)bytes_read;
 
-	free(buf);
+		framerCommit(framer, (size_t)bytes_read);
 
-	// Send a response to all clients using the proactor thread, error checking is done inside the function.
-	int ret = runProactor(proactor);
+		size_t len = 0;
+		char *frame = NULL;
 
-	if (ret == 1)
-	{
-		fprintf(stderr, "%s Proactor error: %s\n", C_PREFIX_ERROR, strerror(errno));
-		return NULL;
-	}
+		// Every whole message is handled in place, the rest stays in the framer for the next read.
+		while ((frame = framerNext(framer, &len)) != NULL)
+		{
+			// Remove the arrow keys from the message, as they are not printable and mess up the output,
+			// and replace them with spaces, so the rest of the message won't cut off.
+			sanitizeArrowKeys(frame, len);
+			metricAdd(&shard->stats.messages_received, 1);
+
+			// Print the message to the server.
+			// We don't need to print it if the server is not configured to print messages.
+			if (config.print_messages)
+				logWrite(LOG_LEVEL_MESSAGE, "Client %d: %s\n", fd, frame);
+
+			// Relay the message to the other clients of all the shards, using the proactor's workers.
+			// The relay is only enqueued, so the reactor goes on right away.
+			PProactorMessage relay = relay_message(frame, len);
+
+			if (relay == NULL || relayProactor(proactor, relay, fd) == 1)
+			{
+				logWrite(LOG_LEVEL_ERROR, "Proactor error: %s\n", strerror(errno));
+				unrefProactorMessage(relay);
+				client_release(react, fd);
+				return NULL;
+			}
+
+			// The workers hold their own references, the message is freed once the last client flushed it.
+			unrefProactorMessage(relay);
+		}
 
-	// This prevents memory leaks when we cancel the reactor thread. We know it's stupid, but it works.
-	pthread_join(((PProactor)proactor)->thread, NULL);
+		if (errno == EMSGSIZE)
+		{
+			logWrite(LOG_LEVEL_WARNING, "Client %d sent a message larger than %d bytes, disconnecting it.\n", fd, SERVER_MAX_FRAME);
+			metricAdd(&shard->stats.oversized, 1);
+			ret = NULL;
+			break;
+		}
 
-	return react;
+		// The budget is used up, so there might be more data - the reactor calls us again.
+		if (drain && total >= budget)
+			ret = REACTOR_RESCHEDULE;
+	} while (drain && total < budget);
+
+	if (ret == NULL)
+		client_release(react, fd);
+
+	return ret;
 }
 
 void *server_handler(int fd, void *react) {
+	server_shard_t_ptr shard = shard_of(fd);
 	struct sockaddr_in client_addr;
 	socklen_t client_len = sizeof(client_addr);
 
-	reactor_t_ptr reactor = (reactor_t_ptr)react;
-
 	// Sanity check.
-	if (reactor == NULL)
+	if (react == NULL)
 	{
 		fprintf(stderr, "%s Server handler error: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
 		return NULL;
 	}
 
-	int client_fd = accept(fd, (struct sockaddr *)&client_addr, &client_len);
+	int accepted[SERVER_ACCEPT_BUDGET];
+	size_t count = 0;
 
-	// Sanity check, as accept() can return -1 on error.
-	if (client_fd < 0)
+	// Drain the pending connections, up to the budget - whatever is left wakes the reactor up again.
+	while (count < SERVER_ACCEPT_BUDGET)
 	{
-		fprintf(stderr, "%s accept() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		return NULL;
-	}
+		client_len = sizeof(client_addr);
 
-	fprintf(stdout, "%s Client %s:%d connected, Reference ID: %d\n", C_PREFIX_INFO, inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), client_fd);
+		int client_fd = reactorAccept(react, fd, (struct sockaddr *)&client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
 
-	// Add the client to the reactor.
-	addFd(reactor, client_fd, client_handler);
+		// Sanity check, as reactorAccept() can return -1 on error.
+		if (client_fd < 0)
+		{
+			// The client gave up before it was accepted, the next one might still be there.
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
 
-	// Add FD to the proactor, so we can send messages back to the client.
-	addFD2Proactor(proactor, client_fd, fds_handler);
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				logWrite(LOG_LEVEL_ERROR, "accept() failed: %s\n", strerror(errno));
 
-	client_count++;
+			break;
+		}
 
-	return react;
-}
+		// The client can't be tracked, so it's dropped.
+		if ((size_t)client_fd >= fd_owner_size)
+		{
+			logWrite(LOG_LEVEL_WARNING, "Client %d is above the file descriptor limit, dropping it.\n", client_fd);
+			close(client_fd);
+			continue;
+		}
 
-int fds_handler(int fd) {
-	// Sanity check for the file descriptor itself, as the proactor doesn't check it - it relies on the reactor to do so.
-	if (fd < 0)
-	{
-		fprintf(stderr, "%s Proactor failed: Invalid file descriptor.\n", C_PREFIX_ERROR);
-		removeHandler(proactor, fd);
-		return 1;
+		logWrite(LOG_LEVEL_INFO, "Client %s:%d connected to shard %zu, Reference ID: %d\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), shard->id, client_fd);
+
+		*(fd_owner + client_fd) = shard;
+		*(accepted + count++) = client_fd;
+
+		server_client_t_ptr client = (fd_client + client_fd);
+
+		socket_tune(client_fd);
+		framerInit(&client->framer, config.framing, SERVER_MAX_FRAME, config.buffer_size, reactorBufferAlloc, reactorBufferFree, react);
+		reactorTimerInit(&client->idle, client_idle_handler, client);
+		client->last_active = reactorNow(react);
+
+		if (SERVER_IDLE_TIMEOUT > 0)
+			reactorTimerArm(react, &client->idle, SERVER_IDLE_TIMEOUT, 0);
 	}
 
-	int bytes_sent = send(fd, message, strlen(message), 0);
+	// Add the clients to the reactor. A client that can't be added is dropped, and the rest of the batch is still added.
+	size_t added = 0, next = 0;
 
-	// Fatal error - remove the client from the proactor and stop the proactor immediately.
-	if (bytes_sent < 0)
+	while (next < count)
 	{
-		fprintf(stderr, "%s send() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		removeHandler(proactor, fd);
-		return 1;
+		size_t batch = addFds(react, (accepted + next), count - next, client_handler);
+
+		memmove((accepted + added), (accepted + next), batch * sizeof(int));
+		added += batch;
+		next += batch;
+
+		if (next < count)
+		{
+			int client_fd = *(accepted + next++);
+			server_client_t_ptr client = (fd_client + client_fd);
+
+			logWrite(LOG_LEVEL_ERROR, "addFd() failed for client %d, dropping it: %s\n", client_fd, strerror(errno));
+			reactorTimerCancel(react, &client->idle);
+			framerReset(&client->framer);
+			*(fd_owner + client_fd) = NULL;
+			close(client_fd);
+		}
 	}
 
-	// We don't need to check if the client disconnected, as the reactor will handle that automatically.
-	total_bytes_sent += bytes_sent;
+	// Add the clients to the proactor, so we can send messages back to them.
+	// The clients have no handler, as they only receive the broadcasts.
+	addFDs2Proactor(proactor, accepted, added, NULL);
 
-	return 0;
-}
\ No newline at end of file
+	metricAdd(&shard->stats.accepted, added);
+
+	// The budget is used up, so there might be more pending connections - the reactor calls us again.
+	return (count == SERVER_ACCEPT_BUDGET) ? REACTOR_RESCHEDULE : react;
+}
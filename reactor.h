@@ -20,11 +20,17 @@
 #define _REACTOR_H
 
 #include "settings.h"
+#include "histogram.h"
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <stdatomic.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
 
 /********************/
 /* Typedefs Section */
@@ -37,16 +43,26 @@
  * @return A pointer to something that the handler may return.
  * @note Returning NULL means something went wrong with the file descriptor, and as a result,
  * 			the reactor will automaticly remove the problamtic file descriptor from the list.
+ * @note Returning REACTOR_RESCHEDULE means the handler stopped at its budget with more data pending,
+ * 			and it should be called again even if no new event arrives (see reactorReadBudget()).
 */
 typedef void *(*handler_t_reactor)(int fd, void *react);
 
 /*
- * @brief A node in the reactor linked list.
+ * @brief A handler's return value, telling the reactor that the file descriptor still has pending data.
+ * @note In edge-triggered mode, the reactor calls the handler again after the current batch of events,
+ * 			before it waits for new ones. The other modes report the file descriptor as ready again anyway,
+ * 			so there it's the same as any other non-NULL value.
+*/
+#define REACTOR_RESCHEDULE	((void *)-1)
+
+/*
+ * @brief An entry in the reactor's handler table.
  */
 typedef struct _reactor_node reactor_node, *reactor_node_ptr;
 
 /*
- * @brief A reactor object - a linked list of file descriptors and their handlers.
+ * @brief A reactor object - a table of file descriptors and their handlers.
  */
 typedef struct _reactor_t reactor_t, *reactor_t_ptr;
 
@@ -55,19 +71,130 @@ typedef struct _reactor_t reactor_t, *reactor_t_ptr;
 */
 typedef struct pollfd pollfd_t, *pollfd_t_ptr;
 
+/*
+ * @brief An epoll_event object, used to receive ready events from epoll_wait().
+*/
+typedef struct epoll_event epoll_event_t, *epoll_event_t_ptr;
+
+/*
+ * @brief The I/O multiplexing backend used by the reactor.
+ * @note REACTOR_BACKEND_POLL keeps a persistent pollfd table, and passes all of it to poll() on every iteration.
+ * @note REACTOR_BACKEND_EPOLL registers every file descriptor once with epoll_ctl(),
+ * 			and each wakeup only touches the ready file descriptors.
+ * @note REACTOR_BACKEND_URING arms a multishot io_uring request for every file descriptor once,
+ * 			so accepted connections and received data are delivered without further syscalls.
+ * 			Handlers must use reactorAccept() and reactorRecv() with this backend.
+*/
+typedef enum _reactor_backend
+{
+	REACTOR_BACKEND_POLL = 0,
+	REACTOR_BACKEND_EPOLL,
+	REACTOR_BACKEND_URING
+} reactor_backend_t;
+
+/*
+ * @brief The io_uring state of a reactor - the mapped rings and the provided buffers.
+ * @note The structure is private to the reactor library.
+*/
+typedef struct _reactor_uring reactor_uring_t, *reactor_uring_t_ptr;
+
+/*
+ * @brief A size class of the reactor's receive buffer pool.
+*/
+typedef struct _reactor_buffer_class reactor_buffer_class_t, *reactor_buffer_class_t_ptr;
+
+/*
+ * @brief The reactor's receive buffer pool - fixed size buffers in a few size classes,
+ * 			carved from a single contiguous arena.
+*/
+typedef struct _reactor_buffer_pool reactor_buffer_pool_t, *reactor_buffer_pool_t_ptr;
+
+/*
+ * @brief A snapshot of the reactor's buffer pool counters, see reactorBufferStats().
+*/
+typedef struct _reactor_buffer_stats reactor_buffer_stats_t, *reactor_buffer_stats_t_ptr;
+
+/*
+ * @brief A link in a doubly linked list of timers.
+*/
+typedef struct _reactor_timer_link reactor_timer_link_t, *reactor_timer_link_t_ptr;
+
+/*
+ * @brief A timer of the reactor's timing wheel.
+ * @note Timers are intrusive - the caller owns their memory, so arming and cancelling never allocate.
+*/
+typedef struct _reactor_timer reactor_timer_t, *reactor_timer_t_ptr;
+
+/*
+ * @brief The reactor's hierarchical timing wheel.
+*/
+typedef struct _reactor_timer_wheel reactor_timer_wheel_t, *reactor_timer_wheel_t_ptr;
+
+/*
+ * @brief A handler function for a timer.
+ * @param react Pointer to the reactor object.
+ * @param timer Pointer to the timer that expired.
+ * @return void
+ * @note Called on the reactor's thread, after the file descriptors' handlers of the same iteration.
+ * 			The handler may arm or cancel any timer (including its own), and add or remove file descriptors.
+*/
+typedef void (*handler_t_timer)(void *react, reactor_timer_t_ptr timer);
+
+/*
+ * @brief The number of levels of the timing wheel.
+*/
+#define REACTOR_TIMER_LEVELS	4
+
+/*
+ * @brief The number of slots in every level of the timing wheel.
+ * @note Must be 64, as every level keeps a 64 bit map of its non-empty slots.
+*/
+#define REACTOR_TIMER_SLOTS		64
+
+/*
+ * @brief The number of bits of a tick every level of the timing wheel covers.
+*/
+#define REACTOR_TIMER_BITS		6
+
+/*
+ * @brief The kinds of changes other threads can queue to a reactor.
+*/
+typedef enum _reactor_command_type
+{
+	/*
+	 * @brief Add a file descriptor, as addFd() does.
+	*/
+	REACTOR_COMMAND_ADD = 0,
+
+	/*
+	 * @brief Remove a file descriptor, as removeFd() does.
+	*/
+	REACTOR_COMMAND_REMOVE,
+
+	/*
+	 * @brief Replace a file descriptor's handler, as modifyFd() does.
+	*/
+	REACTOR_COMMAND_MODIFY
+} reactor_command_type_t;
+
+/*
+ * @brief A change to the reactor's file descriptors, queued by another thread.
+*/
+typedef struct _reactor_command reactor_command_t, *reactor_command_t_ptr;
 
 /**********************/
 /* Structures Section */
 /**********************/
 
 /*
- * @brief A node in the reactor linked list.
+ * @brief An entry in the reactor's handler table.
+ * @note Entries are stored densely, in the same order as the pollfd array.
  */
 struct _reactor_node
 {
 	/*
 	 * @brief The file descriptor.
-	 * @note The first node is always the listening socket.
+	 * @note The first entry is always the listening socket.
 	*/
 	int fd;
 
@@ -80,7 +207,7 @@ struct _reactor_node
 	{
 		/*
 		 * @brief The file descriptor's handler.
-		 * @note The first node is always the listening socket, and its handler is always
+		 * @note The first entry is always the listening socket, and its handler is always
 		 * 			to accept a new connection and add it to the reactor.
 		*/
 		handler_t_reactor handler;
@@ -93,42 +220,448 @@ struct _reactor_node
 	} hdlr;
 
 	/*
-	 * @brief The next node in the linked list.
-	 * @note For the last node, this is NULL.
+	 * @brief The registration's generation, unique for every addFd() call.
+	 * @note Only used with REACTOR_BACKEND_URING, to discard completions of removed file descriptors.
+	*/
+	unsigned int generation;
+
+	/*
+	 * @brief The multishot io_uring request armed for the file descriptor (accept, recv or poll).
+	 * @note Only used with REACTOR_BACKEND_URING.
+	*/
+	unsigned char request;
+
+	/*
+	 * @brief Whether the multishot io_uring request is still armed.
+	 * @note Only used with REACTOR_BACKEND_URING.
+	*/
+	bool armed;
+
+	/*
+	 * @brief Whether the file descriptor is in the reactor's reschedule list.
+	 * @note Used in edge-triggered mode, and by REACTOR_BACKEND_URING while the overflow holds data.
+	*/
+	bool rescheduled;
+
+	/*
+	 * @brief Received data the handler didn't consume yet, NULL if there's none.
+	 * @note Only used with REACTOR_BACKEND_URING - the provided buffer is recycled after every completion,
+	 * 			so the rest of it is copied here, and reactorRecv() serves it before anything else.
 	*/
-	reactor_node_ptr next;
+	char *overflow;
+
+	/*
+	 * @brief The number of bytes in the overflow, and how many of them were consumed.
+	*/
+	size_t overflow_len, overflow_off;
+
+	/*
+	 * @brief Whether the receive request ended (end of file or an error) behind the overflow's data.
+	 * @note overflow_res holds its result (0 or -errno), which reactorRecv() reports once the overflow is drained.
+	*/
+	bool overflow_end;
+	int overflow_res;
 };
 
 /*
- * @brief A reactor object - a linked list of file descriptors and their handlers.
+ * @brief A size class of the reactor's receive buffer pool.
+ * @note Free buffers are linked through their first bytes, so the free list needs no memory of its own.
+*/
+struct _reactor_buffer_class
+{
+	/*
+	 * @brief The size of every buffer in the class, in bytes.
+	*/
+	size_t size;
+
+	/*
+	 * @brief The offset of the class's first buffer in the arena.
+	*/
+	size_t offset;
+
+	/*
+	 * @brief The first free buffer of the class, NULL if all of them are in use.
+	*/
+	void *free_head;
+
+	/*
+	 * @brief The number of requests that were served from the class.
+	*/
+	uint64_t hits;
+
+	/*
+	 * @brief The number of requests for the class that found it empty, and fell back to malloc().
+	*/
+	uint64_t misses;
+};
+
+/*
+ * @brief A link in a doubly linked list of timers.
+ * @note Every slot of the wheel is a circular list, with a link of its own as its head.
+*/
+struct _reactor_timer_link
+{
+	/*
+	 * @brief The next and previous links in the list.
+	*/
+	reactor_timer_link_t_ptr next, prev;
+};
+
+/*
+ * @brief A timer of the reactor's timing wheel.
+ * @note Must be initialized with reactorTimerInit() before it's armed.
+*/
+struct _reactor_timer
+{
+	/*
+	 * @brief The timer's link in its slot of the wheel.
+	 * @note Must be the first member, so a link can be cast back to its timer.
+	*/
+	reactor_timer_link_t link;
+
+	/*
+	 * @brief The tick in which the timer expires.
+	*/
+	uint64_t expires;
+
+	/*
+	 * @brief The timer's period in ticks, or 0 for a one-shot timer.
+	*/
+	uint64_t period;
+
+	/*
+	 * @brief The timer's handler.
+	*/
+	handler_t_timer handler;
+
+	/*
+	 * @brief The caller's argument, the reactor doesn't touch it.
+	*/
+	void *arg;
+
+	/*
+	 * @brief The index of the timer's slot in the wheel, or -1 while it's being expired.
+	*/
+	int slot;
+
+	/*
+	 * @brief Whether the timer is armed.
+	*/
+	bool armed;
+};
+
+/*
+ * @brief The reactor's hierarchical timing wheel.
+ * @note Level L has REACTOR_TIMER_SLOTS slots of 64^L ticks each, so arming and cancelling a timer is O(1),
+ * 			and a timer only moves down a level when its slot's time comes (at most REACTOR_TIMER_LEVELS - 1 times).
+ * @note The wheel covers 2^24 ticks (46 hours with the default tick), later timers wait on its last level.
+*/
+struct _reactor_timer_wheel
+{
+	/*
+	 * @brief The last tick that was expired.
+	*/
+	uint64_t tick;
+
+	/*
+	 * @brief The monotonic clock in milliseconds, taken once per iteration after the reactor woke up.
+	*/
+	uint64_t now;
+
+	/*
+	 * @brief The number of armed timers.
+	*/
+	size_t count;
+
+	/*
+	 * @brief A bit map of the non-empty slots of every level.
+	*/
+	uint64_t occupied[REACTOR_TIMER_LEVELS];
+
+	/*
+	 * @brief The slots' list heads, level by level.
+	*/
+	reactor_timer_link_t slots[REACTOR_TIMER_LEVELS * REACTOR_TIMER_SLOTS];
+};
+
+/*
+ * @brief A change to the reactor's file descriptors, queued by another thread.
+*/
+struct _reactor_command
+{
+	/*
+	 * @brief The kind of change.
+	*/
+	reactor_command_type_t type;
+
+	/*
+	 * @brief The file descriptor.
+	*/
+	int fd;
+
+	/*
+	 * @brief The new handler, unused by REACTOR_COMMAND_REMOVE.
+	*/
+	handler_t_reactor handler;
+
+	/*
+	 * @brief The command that was queued before this one.
+	*/
+	reactor_command_t_ptr next;
+};
+
+/*
+ * @brief The reactor's receive buffer pool.
+ * @note The pool belongs to the reactor's thread - only handlers may use it, so it needs no locking.
+ * @note The arena is mapped on the first request, so a reactor that never receives costs nothing.
+*/
+struct _reactor_buffer_pool
+{
+	/*
+	 * @brief The arena all the buffers are carved from, NULL until the first request.
+	*/
+	char *arena;
+
+	/*
+	 * @brief The size of the arena, in bytes.
+	*/
+	size_t arena_size;
+
+	/*
+	 * @brief A boolean value indicating whether the arena is backed by huge pages (MAP_HUGETLB).
+	*/
+	bool hugepages;
+
+	/*
+	 * @brief A boolean value indicating whether mapping the arena failed, so every request goes to malloc() from then on.
+	 * @note Set on the first failure, so the mapping isn't retried (and reported) on every request.
+	*/
+	bool disabled;
+
+	/*
+	 * @brief The pool's size classes, from the smallest to the largest.
+	*/
+	reactor_buffer_class_t classes[REACTOR_BUFFER_CLASSES];
+
+	/*
+	 * @brief The number of requests larger than the largest class, served by malloc().
+	*/
+	uint64_t oversized;
+
+	/*
+	 * @brief The number of buffers currently in use, pooled or not.
+	*/
+	size_t in_use;
+
+	/*
+	 * @brief The largest number of buffers that were in use at the same time.
+	*/
+	size_t high_water;
+};
+
+/*
+ * @brief A snapshot of the reactor's buffer pool counters.
+*/
+struct _reactor_buffer_stats
+{
+	/*
+	 * @brief The number of requests that were served from the pool, in all the classes.
+	*/
+	uint64_t hits;
+
+	/*
+	 * @brief The number of requests that found their class empty, and fell back to malloc().
+	*/
+	uint64_t misses;
+
+	/*
+	 * @brief The number of requests larger than the largest class, served by malloc().
+	*/
+	uint64_t oversized;
+
+	/*
+	 * @brief The number of buffers currently in use, pooled or not.
+	*/
+	size_t in_use;
+
+	/*
+	 * @brief The largest number of buffers that were in use at the same time.
+	*/
+	size_t high_water;
+};
+
+/*
+ * @brief A reactor object - a table of file descriptors and their handlers.
+ * @note The handler table (nodes) and the pollfd array (fds) are kept in step:
+ * 			entry i of both arrays always describes the same file descriptor.
+ * @note The slots array maps a file descriptor to its index in both arrays,
+ * 			so dispatch, addition and removal are all O(1).
+ * @note Removal moves the last entry into the removed entry's place (swap-remove),
+ * 			so the arrays stay dense and never need to be rebuilt.
  */
 struct _reactor_t
 {
 	/*
 	 * @brief The thread in which the reactor is running.
-	 * @note The thread is created in startReactor() and deleted in stopReactor().
-	 * 			The thread function is reactorRun().
+	 * @note The thread is created in startReactor() and joined in stopReactor() or WaitFor(),
+	 * 			only valid while has_thread is set. The thread function is reactorRun().
 	*/
 	pthread_t thread;
 
 	/*
-	 * @brief The first node in the linked list.
-	 * @note The first node is always the listening socket.
+	 * @brief A boolean value indicating whether the thread field holds a live thread.
+	 * @note Stored with release after pthread_create() and cleared after the join, so any thread
+	 * 			may check it (with acquire) before it reads the thread field.
+	*/
+	_Atomic bool has_thread;
+
+	/*
+	 * @brief A pointer to the dense array of handler table entries.
+	 * @note The first entry is always the listening socket.
 	*/
-	reactor_node_ptr head;
+	reactor_node_ptr nodes;
 
 	/*
-	 * @brief A pointer to an array of pollfd structures.
-	 * @note The array is allocated and freed in reactorRun().
-	 * @note The array is used in reactorRun() to call poll().
+	 * @brief A pointer to the dense array of pollfd structures.
+	 * @note The array is kept in step with the nodes array, and passed as is to poll().
 	*/
 	pollfd_t_ptr fds;
 
+	/*
+	 * @brief A pointer to an array that maps a file descriptor to its index in nodes and fds.
+	 * @note Unregistered file descriptors are mapped to -1.
+	*/
+	int *slots;
+
+	/*
+	 * @brief The number of registered file descriptors.
+	*/
+	size_t size;
+
+	/*
+	 * @brief The number of entries allocated in the nodes and fds arrays.
+	*/
+	size_t capacity;
+
+	/*
+	 * @brief The number of entries allocated in the slots array.
+	*/
+	size_t slots_size;
+
+	/*
+	 * @brief The I/O multiplexing backend of the reactor.
+	 * @note The backend is chosen in createReactor() and can't be changed afterwards.
+	*/
+	reactor_backend_t backend;
+
+	/*
+	 * @brief The epoll instance file descriptor.
+	 * @note Only used with REACTOR_BACKEND_EPOLL, otherwise it's -1.
+	 * @note Every file descriptor is registered once in addFd(), and unregistered when it's removed.
+	*/
+	int epoll_fd;
+
+	/*
+	 * @brief A pointer to an array of REACTOR_MAX_EVENTS epoll_event structures.
+	 * @note Only used with REACTOR_BACKEND_EPOLL, otherwise it's NULL.
+	 * @note The array is allocated once in createReactor() and reused by every epoll_wait() call.
+	*/
+	epoll_event_t_ptr events;
+
+	/*
+	 * @brief A pointer to the io_uring state of the reactor.
+	 * @note Only used with REACTOR_BACKEND_URING, otherwise it's NULL.
+	*/
+	reactor_uring_t_ptr uring;
+
+	/*
+	 * @brief A pointer to the array of file descriptors whose handlers must be called again without a new event.
+	 * @note Used in edge-triggered mode, and by REACTOR_BACKEND_URING. The array grows geometrically, and is never shrunk.
+	*/
+	int *resched;
+
+	/*
+	 * @brief The number of file descriptors in the reschedule list.
+	*/
+	size_t resched_count;
+
+	/*
+	 * @brief The number of file descriptors the reschedule list can hold.
+	*/
+	size_t resched_capacity;
+
+	/*
+	 * @brief The handler that reads a socket's error queue, or NULL to discard its messages.
+	 * @note See reactorSetErrorQueueHandler().
+	*/
+	handler_t_reactor errqueue_handler;
+
+	/*
+	 * @brief The reactor's receive buffer pool, used through reactorBufferAlloc() and reactorBufferFree().
+	*/
+	reactor_buffer_pool_t buffers;
+
+	/*
+	 * @brief Whether the file descriptors are registered with EPOLLET.
+	 * @note Only set with REACTOR_BACKEND_EPOLL, when REACTOR_EDGE_TRIGGERED (or its environment variable) is set.
+	*/
+	bool edge_triggered;
+
+	/*
+	 * @brief The number of bytes a handler should read from its file descriptor per call.
+	 * @note See reactorReadBudget().
+	*/
+	size_t read_budget;
+
+	/*
+	 * @brief The longest the reactor waits for events, in milliseconds, -1 to wait forever.
+	 * @note POLL_TIMEOUT by default, see reactorSetPollTimeout().
+	*/
+	int poll_timeout;
+
+#if LATENCY_HISTOGRAMS
+	/*
+	 * @brief The monotonic clock when the reactor's last wait returned, in nanoseconds.
+	*/
+	uint64_t woke;
+
+	/*
+	 * @brief The time from the wakeup until a handler is called, in nanoseconds.
+	 * @note Grows with the number of ready file descriptors that were handled before it in the same wakeup.
+	*/
+	histogram_t dispatch_latency;
+
+	/*
+	 * @brief The time a handler runs, in nanoseconds.
+	*/
+	histogram_t handler_latency;
+#endif
+
+	/*
+	 * @brief The reactor's timing wheel, used through reactorTimerArm() and reactorTimerCancel().
+	 * @note The poll timeout is cut short to the wheel's next expiry.
+	*/
+	reactor_timer_wheel_t timers;
+
+	/*
+	 * @brief The queue of changes other threads made to the file descriptors, newest first.
+	 * @note A lock-free stack - producers push with a compare-and-swap, and the reactor's thread takes the
+	 * 			whole stack with a single exchange between iterations, and applies it oldest first.
+	*/
+	_Atomic(reactor_command_t_ptr) commands;
+
+	/*
+	 * @brief An eventfd that wakes the reactor up when the command queue stops being empty.
+	 * @note Registered in the handler table when the reactor starts.
+	*/
+	int wake_fd;
+
 	/*
 	 * @brief A boolean value indicating whether the reactor is running.
 	 * @note The value is set to true in startReactor() and to false in stopReactor().
+	 * @note Atomic, as stopReactor() clears it from another thread while the reactor's thread reads it.
 	*/
-	bool running;
+	_Atomic bool running;
 };
 
 
@@ -137,12 +670,31 @@ struct _reactor_t
 /********************************/
 
 /*
- * @brief Create a reactor object - a linked list of file descriptors and their handlers.
+ * @brief Create a reactor object - a table of file descriptors and their handlers.
  * @return A pointer to the created object, or NULL if failed.
- * @note The returned pointer must be freed.
+ * @note The returned pointer must be freed with destroyReactor().
+ * @note The backend is REACTOR_BACKEND by default, and can be overridden at run time
+ * 			by setting the REACTOR_BACKEND environment variable to "poll", "epoll" or "uring".
  */
 void *createReactor();
 
+/*
+ * @brief Create a reactor object that uses a specific I/O multiplexing backend.
+ * @param backend The backend to use.
+ * @return A pointer to the created object, or NULL if failed.
+ * @note The returned pointer must be freed with destroyReactor().
+ * @note If io_uring is requested but isn't available, the reactor falls back to epoll.
+ */
+void *createReactorBackend(reactor_backend_t backend);
+
+/*
+ * @brief Destroy a reactor object - stop it if it's running, close all of its
+ * 			file descriptors and free all the memory it allocated.
+ * @param react A pointer to the reactor object.
+ * @return void
+ */
+void destroyReactor(void *react);
+
 /*
  * @brief Start executing the reactor, in a new thread.
  * @param react A pointer to the reactor object.
@@ -151,9 +703,13 @@ void *createReactor();
 void startReactor(void *react);
 
 /*
- * @brief Stop the reactor - delete the thread.
+ * @brief Stop the reactor - its thread finishes the current iteration and returns.
  * @param react A pointer to the reactor object.
  * @return void
+ * @note The thread isn't cancelled, it's woken up through the reactor's eventfd, so no handler
+ * 			is ever interrupted halfway. The call returns once the thread was joined.
+ * @note A handler may stop its own reactor, in which case the call returns right away,
+ * 			and the thread is joined by WaitFor().
  */
 void stopReactor(void *react);
 
@@ -162,15 +718,207 @@ void stopReactor(void *react);
  * @param react A pointer to the reactor object.
  * @param fd The file descriptor to add.
  * @param handler The handler function to call when the file descriptor is ready.
- * @return void
+ * @return 0 on success, -1 on failure (errno is set).
+ * @note Safe to call from any thread. While the reactor runs, a call from another thread is queued,
+ * 			and applied by the reactor's thread before its next wait - then 0 only means that the
+ * 			addition was queued, and a failure to register the file descriptor is only reported.
+ */
+int addFd(void *react, int fd, handler_t_reactor handler);
+
+/*
+ * @brief Add a batch of file descriptors to the reactor, all with the same handler.
+ * @param react A pointer to the reactor object.
+ * @param fds The file descriptors to add.
+ * @param count The number of file descriptors.
+ * @param handler The handler function to call when a file descriptor is ready.
+ * @return The number of file descriptors that were added, from the start of the batch - count on success.
+ * 			Otherwise, the next one is the one that couldn't be added (errno is set), and the rest weren't tried.
+ * @note The handler table grows once for the whole batch, instead of once per file descriptor.
+ * @note Safe to call from any thread, and another thread queues the whole batch with a single compare-and-swap
+ * 			(then the returned number was only queued, as with addFd()).
  */
-void addFd(void *react, int fd, handler_t_reactor handler);
+size_t addFds(void *react, const int *fds, size_t count, handler_t_reactor handler);
 
 /*
  * @brief Wait for the reactor to finish.
  * @param react A pointer to the reactor object.
  * @return void
+ * @note The reactor finishes when stopReactor() is called, or on a fatal error.
  */
 void WaitFor(void *react);
 
+/*
+ * @brief Receive data from a file descriptor, from within its handler.
+ * @param react A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @param buf The buffer to receive the data into.
+ * @param len The size of the buffer.
+ * @return The number of bytes received, 0 if the peer closed the connection, or -1 on error (errno is set).
+ * @note With the io_uring backend, the data was already received by the kernel into a provided buffer,
+ * 			and it's only copied here - no syscall is made. Once the received data is consumed, it fails with EAGAIN.
+ * 			Data the handler leaves behind is kept for its next call, which the reactor makes on its next iteration.
+ * @note With the other backends, this is a plain recv().
+ */
+ssize_t reactorRecv(void *react, int fd, void *buf, size_t len);
+
+/*
+ * @brief Accept a connection on a listening socket, from within its handler.
+ * @param react A pointer to the reactor object.
+ * @param fd The listening socket.
+ * @param addr Where to store the peer's address, may be NULL.
+ * @param addrlen The size of addr, updated with the address' actual size, may be NULL.
+ * @param flags SOCK_NONBLOCK and/or SOCK_CLOEXEC, as in accept4().
+ * @return The new connection's file descriptor, or -1 on error (errno is set).
+ * @note With the io_uring backend, the connection was already accepted by a multishot accept request,
+ * 			and it's only handed out here. A second call in the same handler fails with EAGAIN.
+ * @note With the other backends, this is a plain accept4().
+ */
+int reactorAccept(void *react, int fd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+
+/*
+ * @brief Set the handler the reactor calls when a healthy socket only reports messages in its error queue.
+ * @param react A pointer to the reactor object.
+ * @param handler The handler, which must read the socket's error queue, or NULL to have the reactor discard it.
+ * @return void
+ * @note The error queue holds the MSG_ZEROCOPY completions of whoever sends on the socket (e.g. a proactor),
+ * 			and raises POLLERR for every poller of the socket until it's read. The reactor reads it as soon
+ * 			as it's reported, so it never spins on it. A handler that returns NULL removes the file descriptor.
+ * @note Must be called before the reactor starts.
+ */
+void reactorSetErrorQueueHandler(void *react, handler_t_reactor handler);
+
+/*
+ * @brief Get a receive buffer from the reactor's buffer pool, from within a handler.
+ * @param react A pointer to the reactor object.
+ * @param size The requested size, in bytes.
+ * @return A pointer to a buffer of at least size bytes, or NULL on failure.
+ * @note The buffer comes from the smallest size class that fits, and isn't zeroed.
+ * 			If the class is empty, or the size is larger than the largest class, it comes from malloc().
+ * @note The pool isn't thread safe - only the reactor's own thread may use it.
+ */
+void *reactorBufferAlloc(void *react, size_t size);
+
+/*
+ * @brief Return a buffer to the reactor's buffer pool.
+ * @param react A pointer to the reactor object.
+ * @param buf A buffer returned by reactorBufferAlloc() of the same reactor, may be NULL.
+ * @note The pool isn't thread safe - only the reactor's own thread may use it.
+ */
+void reactorBufferFree(void *react, void *buf);
+
+/*
+ * @brief Get a snapshot of the reactor's buffer pool counters.
+ * @param react A pointer to the reactor object.
+ * @param stats A pointer to the snapshot to fill.
+ * @return void
+ * @note The counters aren't atomic - call it from the reactor's own thread, or after the reactor stopped.
+ */
+void reactorBufferStats(void *react, reactor_buffer_stats_t_ptr stats);
+
+/*
+ * @brief Check whether the reactor runs in edge-triggered mode.
+ * @param react A pointer to the reactor object.
+ * @return true if the file descriptors are registered with EPOLLET, false otherwise.
+ * @note In edge-triggered mode, a readiness event is reported only once, so a handler must read until
+ * 			recv() fails with EAGAIN, or return REACTOR_RESCHEDULE once it used up its read budget.
+ */
+bool reactorEdgeTriggered(void *react);
+
+/*
+ * @brief Get the number of bytes a handler should read from its file descriptor per call.
+ * @param react A pointer to the reactor object.
+ * @return The read budget, in bytes.
+ * @note The budget keeps a single busy connection from starving the others. A handler that reaches it
+ * 			returns REACTOR_RESCHEDULE, and continues after every other ready file descriptor had its turn.
+ */
+size_t reactorReadBudget(void *react);
+
+/*
+ * @brief Set the longest the reactor waits for events.
+ * @param react A pointer to the reactor object.
+ * @param timeout The timeout in milliseconds, or -1 to wait forever.
+ * @return void
+ * @note Overrides POLL_TIMEOUT. Must be called before the reactor starts.
+ */
+void reactorSetPollTimeout(void *react, int timeout);
+
+/*
+ * @brief Remove a file descriptor from the reactor.
+ * @param react A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @return void
+ * @note The file descriptor isn't closed, this is the caller's responsibility.
+ * @note A handler removes its own file descriptor by returning NULL.
+ * @note Safe to call from any thread. A call from another thread is applied asynchronously, so the caller
+ * 			must not close the file descriptor (which may then be reused) until the reactor applies it.
+ */
+void removeFd(void *react, int fd);
+
+/*
+ * @brief Replace the handler of a file descriptor of the reactor.
+ * @param react A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @param handler The new handler function.
+ * @return void
+ * @note Safe to call from any thread, as addFd().
+ */
+void modifyFd(void *react, int fd, handler_t_reactor handler);
+
+/*
+ * @brief Initialize a timer.
+ * @param timer A pointer to the timer.
+ * @param handler The timer's handler.
+ * @param arg The caller's argument, stored in the timer.
+ * @return void
+ */
+void reactorTimerInit(reactor_timer_t_ptr timer, handler_t_timer handler, void *arg);
+
+/*
+ * @brief Arm a timer, from the reactor's thread.
+ * @param react A pointer to the reactor object.
+ * @param timer A pointer to an initialized timer. If it's already armed, it's re-armed.
+ * @param delay The time until the timer expires, in milliseconds.
+ * @param period The time between the following expiries in milliseconds, or 0 for a one-shot timer.
+ * @return void
+ * @note O(1). The times are rounded up to whole ticks of REACTOR_TIMER_TICK milliseconds.
+ * @note The timer must stay valid until it expires (for a one-shot timer) or it's cancelled.
+ */
+void reactorTimerArm(void *react, reactor_timer_t_ptr timer, uint64_t delay, uint64_t period);
+
+/*
+ * @brief Cancel a timer, from the reactor's thread.
+ * @param react A pointer to the reactor object.
+ * @param timer A pointer to the timer, does nothing if it isn't armed.
+ * @return void
+ * @note O(1).
+ */
+void reactorTimerCancel(void *react, reactor_timer_t_ptr timer);
+
+/*
+ * @brief Get the reactor's clock.
+ * @param react A pointer to the reactor object.
+ * @return The monotonic clock in milliseconds, as of the time the reactor last woke up.
+ * @note Taken once per iteration, so it costs nothing to call it from every handler.
+ */
+uint64_t reactorNow(void *react);
+
+/*
+ * @brief Check whether the reactor's thread is running.
+ * @param react A pointer to the reactor object, may be NULL.
+ * @return true from startReactor() until stopReactor() or WaitFor(), false otherwise.
+ */
+bool reactorRunning(void *react);
+
+#if LATENCY_HISTOGRAMS
+/*
+ * @brief Merge the reactor's latency histograms into snapshots.
+ * @param react A pointer to the reactor object.
+ * @param dispatch A pointer to the snapshot of the dispatch latency.
+ * @param handler A pointer to the snapshot of the handler latency.
+ * @return void
+ * @note Safe to call from any thread while the reactor runs - the histograms' buckets are atomic.
+ */
+void reactorLatency(void *react, histogram_snapshot_t_ptr dispatch, histogram_snapshot_t_ptr handler);
+#endif
+
 #endif
\ No newline at end of file
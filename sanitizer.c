@@ -0,0 +1,187 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Message Sanitizer Implementation
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "sanitizer.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SANITIZER_X86 1
+#else
+#define SANITIZER_X86 0
+#endif
+
+/*
+ * @brief The size from which sanitizeArrowKeys() uses the AVX2 kernel - below it, a 32 byte block
+ * 			doesn't make up for the AVX2 setup (see bench_sanitize).
+*/
+#define SANITIZER_AVX2_MIN	256
+
+/*
+ * @brief The kernel sanitizeArrowKeys() uses, picked when the program loads.
+*/
+static sanitizer_t sanitizer_kernel = sanitizeArrowKeysScalar;
+
+/*
+ * @brief The kernel sanitizeArrowKeys() uses for buffers shorter than SANITIZER_AVX2_MIN.
+*/
+static sanitizer_t sanitizer_short_kernel = sanitizeArrowKeysScalar;
+
+/*
+ * @brief The name of the kernel sanitizeArrowKeys() uses.
+*/
+static const char *sanitizer_name = "scalar";
+
+/*
+ * @brief Blank out the sequence at every set bit of a match mask.
+ * @param buf The buffer, at the position of the mask's first bit.
+ * @param mask The match mask - bit i is set if a sequence starts at buf + i.
+ * @return The number of sequences that were blanked out.
+ * @note Sequences never overlap (ESC is neither '[' nor an arrow letter), so the bits are independent.
+*/
+static inline size_t sanitizerBlank(char *buf, uint32_t mask) {
+	size_t count = 0;
+
+	while (mask != 0)
+	{
+		memset(buf + __builtin_ctz(mask), ' ', 3);
+		mask &= mask - 1;
+		++count;
+	}
+
+	return count;
+}
+
+size_t sanitizeArrowKeysScalar(char *buf, size_t len) {
+	size_t count = 0;
+
+	for (size_t i = 0; i + 2 < len; ++i)
+	{
+		if (*(buf + i) == 0x1b && *(buf + i + 1) == 0x5b && *(buf + i + 2) >= 0x41 && *(buf + i + 2) <= 0x44)
+		{
+			memset(buf + i, ' ', 3);
+			i += 2;
+			++count;
+		}
+	}
+
+	return count;
+}
+
+#if SANITIZER_X86
+__attribute__((target("sse2")))
+size_t sanitizeArrowKeysSSE2(char *buf, size_t len) {
+	// Too short for a single block, or a CPU without SSE2.
+	if (len < 18 || !__builtin_cpu_supports("sse2"))
+		return sanitizeArrowKeysScalar(buf, len);
+
+	const __m128i esc = _mm_set1_epi8(0x1b), bracket = _mm_set1_epi8(0x5b);
+	const __m128i low = _mm_set1_epi8(0x41), high = _mm_set1_epi8(0x44);
+	size_t count = 0, i = 0;
+
+	// Every block checks the 3 bytes of a sequence with 3 overlapping loads, so a block needs 2 more bytes.
+	for (; i + 18 <= len; i += 16)
+	{
+		__m128i first = _mm_loadu_si128((const __m128i *)(buf + i));
+		__m128i second = _mm_loadu_si128((const __m128i *)(buf + i + 1));
+		__m128i third = _mm_loadu_si128((const __m128i *)(buf + i + 2));
+
+		__m128i match = _mm_and_si128(_mm_cmpeq_epi8(first, esc), _mm_cmpeq_epi8(second, bracket));
+		match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_max_epu8(third, low), third));
+		match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_min_epu8(third, high), third));
+
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+
+		if (mask != 0)
+			count += sanitizerBlank(buf + i, mask);
+	}
+
+	return count + sanitizeArrowKeysScalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2")))
+size_t sanitizeArrowKeysAVX2(char *buf, size_t len) {
+	// Too short for a single block, or a CPU without AVX2.
+	if (len < 34 || !__builtin_cpu_supports("avx2"))
+		return sanitizeArrowKeysSSE2(buf, len);
+
+	const __m256i esc = _mm256_set1_epi8(0x1b), bracket = _mm256_set1_epi8(0x5b);
+	const __m256i low = _mm256_set1_epi8(0x41), high = _mm256_set1_epi8(0x44);
+	size_t count = 0, i = 0;
+
+	for (; i + 34 <= len; i += 32)
+	{
+		__m256i first = _mm256_loadu_si256((const __m256i *)(buf + i));
+		__m256i second = _mm256_loadu_si256((const __m256i *)(buf + i + 1));
+		__m256i third = _mm256_loadu_si256((const __m256i *)(buf + i + 2));
+
+		__m256i match = _mm256_and_si256(_mm256_cmpeq_epi8(first, esc), _mm256_cmpeq_epi8(second, bracket));
+		match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_max_epu8(third, low), third));
+		match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_min_epu8(third, high), third));
+
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+
+		if (mask != 0)
+			count += sanitizerBlank(buf + i, mask);
+	}
+
+	// Clearing the upper halves avoids the AVX to SSE transition penalty (not done by the compiler without -O).
+	_mm256_zeroupper();
+
+	// The SSE2 kernel takes the last block and a half, and the scalar one whatever is left after it.
+	return count + sanitizeArrowKeysSSE2(buf + i, len - i);
+}
+
+/*
+ * @brief Pick the fastest kernel the CPU supports, once, when the program loads.
+ * @return void
+*/
+__attribute__((constructor))
+static void sanitizerInit(void) {
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("sse2"))
+	{
+		sanitizer_kernel = sanitizer_short_kernel = sanitizeArrowKeysSSE2;
+		sanitizer_name = "sse2";
+	}
+
+	if (__builtin_cpu_supports("avx2"))
+	{
+		sanitizer_kernel = sanitizeArrowKeysAVX2;
+		sanitizer_name = "avx2";
+	}
+}
+#else
+size_t sanitizeArrowKeysSSE2(char *buf, size_t len) {
+	return sanitizeArrowKeysScalar(buf, len);
+}
+
+size_t sanitizeArrowKeysAVX2(char *buf, size_t len) {
+	return sanitizeArrowKeysScalar(buf, len);
+}
+#endif
+
+size_t sanitizeArrowKeys(char *buf, size_t len) {
+	return (len < SANITIZER_AVX2_MIN) ? sanitizer_short_kernel(buf, len) : sanitizer_kernel(buf, len);
+}
+
+const char *sanitizerKernelName(void) {
+	return sanitizer_name;
+}
@@ -0,0 +1,66 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Message Sanitizer Header File
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SANITIZER_H
+#define _SANITIZER_H
+
+#include <stddef.h>
+
+/*
+ * @brief A sanitizer kernel - blanks out every arrow key escape sequence in a buffer.
+ * @param buf The buffer.
+ * @param len The number of bytes in the buffer.
+ * @return The number of sequences that were blanked out.
+*/
+typedef size_t (*sanitizer_t)(char *buf, size_t len);
+
+/*
+ * @brief Replace every arrow key escape sequence (ESC [ A, B, C or D) in a buffer with spaces,
+ * 			so it doesn't mess up the terminal and the rest of the message isn't cut off.
+ * @param buf The buffer.
+ * @param len The number of bytes in the buffer.
+ * @return The number of sequences that were blanked out.
+ * @note Uses the fastest kernel the CPU supports (AVX2, SSE2 or scalar), picked once when the program loads.
+ * 			Short buffers skip the AVX2 kernel, as a single 32 byte block doesn't pay for its setup.
+*/
+size_t sanitizeArrowKeys(char *buf, size_t len);
+
+/*
+ * @brief The scalar kernel of sanitizeArrowKeys(), a byte at a time.
+*/
+size_t sanitizeArrowKeysScalar(char *buf, size_t len);
+
+/*
+ * @brief The SSE2 kernel of sanitizeArrowKeys(), 16 bytes at a time.
+ * @note Falls back to the scalar kernel on CPUs (or architectures) without SSE2.
+*/
+size_t sanitizeArrowKeysSSE2(char *buf, size_t len);
+
+/*
+ * @brief The AVX2 kernel of sanitizeArrowKeys(), 32 bytes at a time.
+ * @note Falls back to the SSE2 kernel on CPUs (or architectures) without AVX2.
+*/
+size_t sanitizeArrowKeysAVX2(char *buf, size_t len);
+
+/*
+ * @brief Get the name of the kernel sanitizeArrowKeys() uses.
+ * @return "avx2", "sse2" or "scalar".
+*/
+const char *sanitizerKernelName(void);
+
+#endif
@@ -33,13 +33,27 @@
 	#endif /* __STDC_VERSION__ */
 #endif /* !_XOPEN_SOURCE && !_POSIX_C_SOURCE */
 
+/*
+ * The reactor and the server rely on Linux-specific interfaces (epoll, eventfd, SO_REUSEPORT),
+ * so the GNU extensions are requested on top of the POSIX ones.
+*/
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE
+#endif /* !_GNU_SOURCE */
+
 /********************/
 /* Settings Section */
 /********************/
 
+/*
+ * The settings below are compile-time defaults. The server's tuning knobs can be overridden
+ * at run time by a config file, environment variables and command line flags (see config.h).
+*/
+
 /*
  * @brief The port on which the server listens.
  * @note The default port is 9034.
+ * @note Can be overridden at run time with --port or the SERVER_PORT environment variable.
 */
 #define SERVER_PORT 		9034
 
@@ -47,12 +61,24 @@
  * @brief The maximum number of clients that can connect to the server.
  * @note The default number is 16384 clients.
  * @note For alot of OSes this is above the hard-limit.
+ * @note Used as the listening sockets' backlog, and can be overridden at run time with --backlog
+ * 			or the MAX_QUEUE environment variable.
 */
 #define MAX_QUEUE 			16384
 
+/*
+ * @brief The maximum number of connections the server accepts in a single wakeup of its listening socket.
+ * @note The default number is 64 connections.
+ * @note The listening socket is drained until it has no more pending connections or the budget is spent,
+ * 			so a connection storm doesn't cost a reactor iteration per client, nor starve the connected clients.
+*/
+#define SERVER_ACCEPT_BUDGET	64
+
 /*
  * @brief The maximum number of bytes that can be read from a socket.
  * @note The default number is 2048 bytes.
+ * @note The size a client's receive buffer starts at, which can be overridden at run time with --buffer-size
+ * 			or the MAX_BUFFER environment variable. The io_uring provided buffers always use this size.
 */
 #define MAX_BUFFER 			2048
 
@@ -61,6 +87,7 @@
  * @note The default timeout is -1.
  * @note A timeout of 0 means that poll() will return immediately.
  * @note A timeout of -1 means that poll() will wait forever.
+ * @note Can be overridden at run time with --poll-timeout or the POLL_TIMEOUT environment variable.
 */
 #define POLL_TIMEOUT 		-1
 
@@ -69,9 +96,310 @@
  * @note The default value is 1.
  * @note A value of 0 means that the server won't print any incoming messages.
  * @note A value of 1 means that the server will print every incoming message.
+ * @note Can be overridden at run time with --print-messages or the SERVER_PRINT_MSGS environment variable.
 */
 #define SERVER_PRINT_MSGS	1
 
+/*
+ * @brief The size of the sockets' kernel receive buffer (SO_RCVBUF), in bytes.
+ * @note The default value is 0, which keeps the kernel's default (and its auto-tuning).
+ * @note Set on the listening sockets, so the accepted sockets inherit it before the handshake ends.
+ * @note Can be overridden at run time with --rcvbuf or the SERVER_RCVBUF environment variable.
+*/
+#define SERVER_RCVBUF		0
+
+/*
+ * @brief The size of the sockets' kernel send buffer (SO_SNDBUF), in bytes.
+ * @note The default value is 0, which keeps the kernel's default (and its auto-tuning).
+ * @note Can be overridden at run time with --sndbuf or the SERVER_SNDBUF environment variable.
+*/
+#define SERVER_SNDBUF		0
+
+/*
+ * @brief Defines whether the clients' sockets have TCP_NODELAY set.
+ * @note The default value is 1.
+ * @note The proactor already batches every client's queued messages into a single sendmsg() call,
+ * 			so Nagle's algorithm would only hold the last one back.
+ * @note Can be overridden at run time with --tcp-nodelay or the SERVER_TCP_NODELAY environment variable.
+*/
+#define SERVER_TCP_NODELAY	1
+
+/*
+ * @brief Defines how the server splits a client's stream into messages.
+ * @note The default framing is FRAMER_MODE_NEWLINE (see framer.h).
+ * @note FRAMER_MODE_NEWLINE means that every message ends with a newline.
+ * @note FRAMER_MODE_LENGTH means that every message starts with its length, as a 4 byte integer in network byte order.
+ * @note Can be overridden at run time with --framing or the SERVER_FRAMING environment variable (newline or length).
+*/
+#define SERVER_FRAMING		FRAMER_MODE_NEWLINE
+
+/*
+ * @brief The largest message a client may send, in bytes.
+ * @note The default size is 64 KB.
+ * @note A client that sends a larger message is disconnected.
+*/
+#define SERVER_MAX_FRAME	65536
+
+/*
+ * @brief The time a client may stay silent before the server disconnects it, in milliseconds.
+ * @note The default timeout is 300000 milliseconds (5 minutes).
+ * @note A timeout of 0 means that idle clients are never disconnected.
+ * @note Dead connections (a peer that crashed, or a NAT mapping that expired) never report an error
+ * 			on their own, so this is what releases their file descriptors.
+*/
+#define SERVER_IDLE_TIMEOUT		300000
+
+/*
+ * @brief The time the server keeps sending the clients' pending data once it's shutting down, in milliseconds.
+ * @note The default timeout is 5000 milliseconds (5 seconds).
+ * @note Clients that don't read their data in time lose the rest of it, so a shutdown never hangs on them.
+*/
+#define SERVER_DRAIN_TIMEOUT	5000
+
+/*
+ * @brief The loopback port of the server's live statistics endpoint.
+ * @note The default port is 9035.
+ * @note A port of 0 disables the endpoint.
+ * @note The endpoint only listens on 127.0.0.1, and answers "GET /stats" with the server's counters as JSON,
+ * 			e.g. "curl http://127.0.0.1:9035/stats".
+ * @note Can be overridden at run time with --stats-port or the SERVER_STATS_PORT environment variable.
+*/
+#define SERVER_STATS_PORT	9035
+
+/*
+ * @brief The interval over which the statistics endpoint computes its rates (messages and bytes per second), in milliseconds.
+ * @note The default interval is 1000 milliseconds.
+*/
+#define SERVER_STATS_INTERVAL	1000
+
+/*
+ * @brief The size of a cache line, in bytes.
+ * @note The default size is 64 bytes, as on x86-64 and most ARM64 machines.
+ * @note Every thread's counters are aligned to it, so two threads never write to the same cache line (see metrics.h).
+*/
+#define CACHE_LINE_SIZE		64
+
+/*
+ * @brief Defines whether the latency histograms are compiled in.
+ * @note The default value is 1.
+ * @note A value of 1 means that the reactors time every dispatch (from the wakeup) and every handler,
+ * 			and the proactor's workers time every broadcast fan-out and every client's send (from the
+ * 			message's creation), each into its own thread's histograms (see histogram.h).
+ * 			The statistics endpoint reports their p50, p99 and p99.9.
+ * @note A value of 0 removes the timing and the histograms altogether, e.g. "make CFLAGS+=-DLATENCY_HISTOGRAMS=0".
+*/
+#ifndef LATENCY_HISTOGRAMS
+	#define LATENCY_HISTOGRAMS	1
+#endif
+
+/*
+ * @brief Defines the default I/O multiplexing backend of the reactor.
+ * @note The default backend is REACTOR_BACKEND_EPOLL.
+ * @note REACTOR_BACKEND_POLL means that the reactor keeps a persistent pollfd table (removals swap the last entry in),
+ * 			and passes all of it to poll() every iteration.
+ * @note REACTOR_BACKEND_EPOLL means that the reactor registers every file descriptor once with epoll.
+ * @note REACTOR_BACKEND_URING means that every file descriptor gets a single multishot io_uring request,
+ * 			and falls back to epoll if io_uring isn't available.
+ * @note The backend can be overridden at run time with the REACTOR_BACKEND environment variable (poll, epoll or uring).
+*/
+#define REACTOR_BACKEND		REACTOR_BACKEND_EPOLL
+
+/*
+ * @brief The maximum number of ready events the reactor handles per epoll_wait() call.
+ * @note The default number is 1024 events.
+ * @note Only used by the epoll backend.
+*/
+#define REACTOR_MAX_EVENTS	1024
+
+/*
+ * @brief Whether the epoll backend registers the file descriptors with EPOLLET (edge-triggered).
+ * @note The default is 0 (level-triggered).
+ * @note Can be overridden at run time with the REACTOR_EDGE_TRIGGERED environment variable (0 or 1).
+ * @note Edge-triggered mode saves the wakeups of file descriptors that weren't drained yet,
+ * 			but every handler must read until EAGAIN (or its read budget).
+*/
+#define REACTOR_EDGE_TRIGGERED	0
+
+/*
+ * @brief The number of bytes a handler reads from a single file descriptor before it yields to the others.
+ * @note The default size is 64 KB.
+ * @note Only the edge-triggered mode drains a file descriptor, the others read once per event.
+*/
+#define REACTOR_READ_BUDGET		65536
+
+/*
+ * @brief The resolution of the reactor's timers, in milliseconds.
+ * @note The default resolution is 10 milliseconds.
+ * @note Timers are rounded up to whole ticks, and the timing wheel covers 2^24 ticks (46 hours by default).
+*/
+#define REACTOR_TIMER_TICK		10
+
+/*
+ * @brief The number of submission queue entries of the reactor's io_uring instance.
+ * @note The default number is 1024 entries, the completion queue is 4 times bigger.
+ * @note Only used by the io_uring backend.
+*/
+#define REACTOR_URING_ENTRIES	1024
+
+/*
+ * @brief The number of MAX_BUFFER sized buffers the reactor provides to io_uring for multishot receives.
+ * @note The default number is 1024 buffers. Must be a power of 2, and up to 32768.
+ * @note Only used by the io_uring backend.
+*/
+#define REACTOR_URING_BUFFERS	1024
+
+/*
+ * @brief The most received data the reactor holds for a single file descriptor whose handler didn't consume it.
+ * @note The default size is 256 KB.
+ * @note Only used by the io_uring backend, which recycles every provided buffer right after its completion.
+ * 			A connection that goes over the limit is failed - its handler's next reactorRecv() returns ENOBUFS.
+*/
+#define REACTOR_URING_OVERFLOW	262144
+
+/*
+ * @brief The initial number of entries in the reactor's handler table.
+ * @note The default number is 64 entries.
+ * @note The table doubles its size whenever it's full, so this only saves a few reallocations.
+*/
+#define REACTOR_INITIAL_CAPACITY	64
+
+/*
+ * @brief The size of the smallest receive buffer size class, in bytes.
+ * @note The default size is 512 bytes.
+ * @note Every following class doubles the size of the previous one.
+*/
+#define REACTOR_BUFFER_MIN_SIZE		512
+
+/*
+ * @brief The number of receive buffer size classes in every reactor's buffer pool.
+ * @note The default number is 6 classes (512 bytes to 16 KB).
+ * @note Larger requests bypass the pool and fall back to malloc().
+*/
+#define REACTOR_BUFFER_CLASSES		6
+
+/*
+ * @brief The number of buffers in every size class of the reactor's buffer pool.
+ * @note The default number is 64 buffers, about 2 MB per reactor with the default classes - a single huge page.
+ * @note When a class runs out of buffers, requests fall back to malloc() and are counted as misses.
+*/
+#define REACTOR_BUFFER_COUNT		64
+
+/*
+ * @brief Back the reactor's buffer pool with huge pages (MAP_HUGETLB).
+ * @note The default value is 0 (disabled).
+ * @note Requires reserved huge pages (/proc/sys/vm/nr_hugepages). If there are none,
+ * 			the pool falls back to regular pages and asks for transparent huge pages instead.
+*/
+#define REACTOR_BUFFER_HUGEPAGES	0
+
+/*
+ * @brief The number of reactor threads (shards) the server runs.
+ * @note The default number is 1 thread.
+ * @note A value of 0 means one thread per online CPU.
+ * @note Every shard has its own listening socket on SERVER_PORT (bound with SO_REUSEPORT),
+ * 			its own reactor and statistics, and the kernel spreads the clients between them.
+ * @note Can be overridden at run time with --reactor-threads or the REACTOR_THREADS environment variable.
+*/
+#define REACTOR_THREADS		1
+
+/*
+ * @brief The maximum number of file descriptors the server tracks.
+ * @note The default number is 1048576 file descriptors.
+ * @note The server tracks up to the process's file descriptor limit, but never more than this.
+*/
+#define FD_OWNER_MAX		1048576
+
+/*
+ * @brief The number of worker threads in the proactor's pool.
+ * @note The default number is 2 workers.
+ * @note A value of 0 means one worker per online CPU.
+ * @note Every file descriptor belongs to a single worker, so its handler never runs on two threads at once.
+ * @note Can be overridden at run time with --proactor-workers or the PROACTOR_WORKERS environment variable.
+*/
+#define PROACTOR_WORKERS	2
+
+/*
+ * @brief The maximum number of bytes waiting in a single client's outbound queue.
+ * @note The default size is 256 KB.
+ * @note Once a client's queue is full, new data for it is dropped, so a slow client
+ * 			only loses its own messages and never stalls the rest of them.
+*/
+#define PROACTOR_QUEUE_LIMIT	262144
+
+/*
+ * @brief The maximum number of events a proactor worker handles in a single epoll_wait() call.
+ * @note The default number is 256 events.
+*/
+#define PROACTOR_MAX_EVENTS	256
+
+/*
+ * @brief The maximum number of queued messages a proactor worker sends to a client in a single sendmsg() call.
+ * @note The default number is 64 messages.
+ * @note Must not be greater than IOV_MAX (1024 on Linux).
+*/
+#define PROACTOR_MAX_BATCH	64
+
+/*
+ * @brief The number of client records in every slab of a proactor worker's record allocator.
+ * @note The default number is 64 records.
+ * @note Every worker carves its records out of contiguous slabs and recycles them through a free list,
+ * 			so connection churn doesn't go through malloc() and free() for every client.
+*/
+#define PROACTOR_SLAB_NODES	64
+
+/*
+ * @brief The maximum time a proactor worker holds queued messages back, to flush more of them together.
+ * @note The default time is 0 milliseconds - the messages are flushed once the worker is done with
+ * 			the jobs it took, which already merges all the broadcasts that were enqueued meanwhile.
+ * @note A client that got PROACTOR_MAX_BATCH messages is flushed right away, regardless of this value.
+*/
+#define PROACTOR_FLUSH_LATENCY	0
+
+/*
+ * @brief The minimum size of a message that the proactor sends with MSG_ZEROCOPY.
+ * @note The default value is 0, which disables zero-copy sends - they're opt-in.
+ * @note Zero-copy sends pin the message's pages instead of copying them, and release the message
+ * 			only once the kernel reports the send as done, which only pays off for large messages.
+ * 			Run bench_zerocopy to find the crossover on a given machine.
+ * @note Can be overridden at run time with --zerocopy-threshold or the PROACTOR_ZEROCOPY_THRESHOLD environment variable.
+*/
+#define PROACTOR_ZEROCOPY_THRESHOLD	0
+
+/*
+ * @brief The logger's initial level, the most verbose level that's logged.
+ * @note The default level is LOG_LEVEL_MESSAGE (everything).
+ * @note Can be overridden at run time with the LOG_LEVEL environment variable (error, warning, info or message),
+ * 			and changed while the server runs with SIGUSR1 (more verbose) and SIGUSR2 (less verbose).
+*/
+#define LOG_LEVEL			LOG_LEVEL_MESSAGE
+
+/*
+ * @brief The number of records in the logger's ring.
+ * @note The default number is 4096 records.
+ * @note Must be a power of 2. When the ring is full, new records are dropped and counted.
+*/
+#define LOG_RING_SIZE		4096
+
+/*
+ * @brief The maximum number of arguments a single log record keeps.
+ * @note The default number is 8 arguments, the rest of them are ignored.
+*/
+#define LOG_RECORD_ARGS		8
+
+/*
+ * @brief The number of bytes a single log record keeps for the strings it was given.
+ * @note The default size is 256 bytes, strings that don't fit are copied onto the heap instead.
+*/
+#define LOG_RECORD_TEXT		256
+
+/*
+ * @brief The size of the logger's output buffers, in bytes.
+ * @note The default size is 16 KB.
+ * @note The logger's thread formats records into these buffers, and writes them out when
+ * 			they're full or when the ring runs empty, so a burst of records costs a few writes.
+*/
+#define LOG_BATCH_SIZE		16384
+
 
 /************************/
 /* Messages definitions */
@@ -109,13 +437,13 @@
 /********************************/
 
 /*
- * @brief A signal handler for SIGINT.
- * @note This function is called when the user presses CTRL+C.
- * 			It stops the reactor, closes all sockets and frees all memory,
- * 			Then, it exits the program.
- * @note This function is registered to SIGINT in main().
+ * @brief Shut the server down gracefully.
+ * @return void
+ * @note This function is called by main() once SIGINT or SIGTERM stopped the first shard.
+ * 			It stops the rest of the reactors and the listening sockets, sends the clients their pending data
+ * 			for up to SERVER_DRAIN_TIMEOUT milliseconds, closes all sockets and frees all memory.
 */
-void signal_handler();
+void server_shutdown(void);
 
 /*
  * @brief A handler for a client socket.
@@ -137,12 +465,4 @@ void *client_handler(int fd, void *react);
 */
 void *server_handler(int fd, void *react);
 
-/*
- * @brief A handler for the fds of the proactor.
- * @param fd The file descriptor.
- * @return 0 on success, 1 otherwise.
- * @note This function is called when a new message is received from one of the clients.
-*/
-int fds_handler(int fd);
-
 #endif /* !_SETTINGS_H */
\ No newline at end of file
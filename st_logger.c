@@ -0,0 +1,790 @@
+/*
+ *  Operation Systems (OSs) Course Assignment 4 Bonus
+ *  Asynchronous Logger Source File
+ *  Copyright (C) 2023  Roy Simanovich and Linor Ronen
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "logger.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/eventfd.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/*
+ * @brief The initial size of the logger thread's line buffer, which grows for longer lines.
+*/
+#define LOG_LINE_MAX		4096
+
+/*
+ * @brief The kind of a conversion in a log format string.
+*/
+typedef enum _log_conversion {
+	LOG_CONV_PERCENT = 0,	// "%%", takes no argument.
+	LOG_CONV_SIGNED,		// d, i and c.
+	LOG_CONV_UNSIGNED,		// u, x, X and o.
+	LOG_CONV_POINTER,		// p.
+	LOG_CONV_STRING,		// s, copied into the record's text (or onto the heap).
+	LOG_CONV_INVALID		// Anything else - the rest of the format is printed as is.
+} log_conversion_t;
+
+/*
+ * @brief The length modifier of a conversion in a log format string.
+*/
+typedef enum _log_length {
+	LOG_LEN_NONE = 0,
+	LOG_LEN_CHAR,			// hh
+	LOG_LEN_SHORT,			// h
+	LOG_LEN_LONG,			// l
+	LOG_LEN_LONG_LONG,		// ll
+	LOG_LEN_SIZE			// z
+} log_length_t;
+
+/*
+ * @brief A log record - a format string and its arguments, before they're formatted.
+ * @note Producers claim a record by its sequence number, fill it, and publish it by advancing the sequence
+ * 			(a bounded MPMC ring, used here with a single consumer).
+*/
+typedef struct _log_record {
+	/*
+	 * @brief The record's sequence number - equals the ring position when the record is free,
+	 * 			and the position + 1 once a producer published it.
+	*/
+	_Atomic size_t sequence;
+
+	/*
+	 * @brief The format string, a string literal.
+	*/
+	const char *format;
+
+	/*
+	 * @brief The record's level.
+	*/
+	log_level_t level;
+
+	/*
+	 * @brief The number of arguments the record keeps.
+	*/
+	unsigned int argc;
+
+	/*
+	 * @brief The arguments, as raw 64-bit values - a string argument is its offset in text,
+	 * 			or a pointer to its copy on the heap if it's spilled.
+	*/
+	uint64_t args[LOG_RECORD_ARGS];
+
+	/*
+	 * @brief The string arguments that didn't fit in text, a bit per argument - the logger's thread frees
+	 * 			their copies once the record is formatted.
+	*/
+	uint32_t spilled;
+
+	/*
+	 * @brief The string arguments, one after the other, each terminated by a null byte.
+	*/
+	char text[LOG_RECORD_TEXT];
+} log_record_t, *log_record_t_ptr;
+
+/*
+ * @brief The logger's state - a single, process-wide logger.
+*/
+typedef struct _logger {
+	/*
+	 * @brief The next ring position producers claim, on its own cache line.
+	*/
+	_Alignas(64) _Atomic size_t tail;
+
+	/*
+	 * @brief The next ring position the logger's thread reads, only used by that thread.
+	*/
+	_Alignas(64) size_t head;
+
+	/*
+	 * @brief The ring of records, LOG_RING_SIZE of them.
+	*/
+	log_record_t_ptr ring;
+
+	/*
+	 * @brief The current level.
+	*/
+	_Atomic int level;
+
+	/*
+	 * @brief A boolean value indicating whether the logger's thread is running.
+	*/
+	_Atomic bool running;
+
+	/*
+	 * @brief A boolean value indicating whether the logger's thread waits on wake_fd,
+	 * 			so the next producer has to wake it up.
+	*/
+	_Atomic bool sleeping;
+
+	/*
+	 * @brief The number of records that were dropped because the ring was full.
+	*/
+	_Atomic uint64_t dropped;
+
+	/*
+	 * @brief The number of strings that were cut to fit in a record, because they couldn't be copied onto the heap.
+	*/
+	_Atomic uint64_t truncated;
+
+	/*
+	 * @brief An eventfd the logger's thread sleeps on while the ring is empty.
+	*/
+	int wake_fd;
+
+	/*
+	 * @brief The logger's thread identifier.
+	*/
+	pthread_t thread;
+
+	/*
+	 * @brief The logger thread's line buffer and its size, grown to fit the longest line so far.
+	*/
+	char *line;
+	size_t line_size;
+
+	/*
+	 * @brief The output buffers of stdout and stderr, and the number of bytes in each of them.
+	*/
+	char out[LOG_BATCH_SIZE], err[LOG_BATCH_SIZE];
+	size_t out_len, err_len;
+} logger_t;
+
+/*
+ * @brief The process-wide logger.
+*/
+static logger_t logger = { .tail = 0, .head = 0, .ring = NULL, .level = LOG_LEVEL, .running = false, .sleeping = false, .dropped = 0, .truncated = 0, .wake_fd = -1, .line = NULL, .line_size = 0 };
+
+/*
+ * @brief Get the prefix of a level.
+ * @param level The level.
+ * @return The level's colored prefix.
+*/
+static const char *loggerPrefix(log_level_t level) {
+	switch (level)
+	{
+		case LOG_LEVEL_ERROR:
+			return C_PREFIX_ERROR;
+
+		case LOG_LEVEL_WARNING:
+			return C_PREFIX_WARNING;
+
+		case LOG_LEVEL_INFO:
+			return C_PREFIX_INFO;
+
+		default:
+			return C_PREFIX_MESSAGE;
+	}
+}
+
+/*
+ * @brief Find the next conversion in a format string.
+ * @param format The format string, from where to look.
+ * @param spec Where to store the conversion's start (its '%').
+ * @param conversion Where to store the conversion's kind.
+ * @param length Where to store the conversion's length modifier.
+ * @return A pointer past the conversion, or NULL if there are no more conversions.
+*/
+static const char *loggerNextConversion(const char *format, const char **spec, log_conversion_t *conversion, log_length_t *length) {
+	const char *p = strchr(format, '%');
+
+	if (p == NULL)
+		return NULL;
+
+	*spec = p++;
+	*length = LOG_LEN_NONE;
+
+	if (*p == '%')
+	{
+		*conversion = LOG_CONV_PERCENT;
+		return p + 1;
+	}
+
+	// Flags, field width and precision are kept as they are, as long as they aren't given as arguments ('*').
+	while (*p != '\0' && strchr("-+ #0123456789.", *p) != NULL)
+		++p;
+
+	if (*p == 'h')
+		*length = (*(++p) == 'h') ? (++p, LOG_LEN_CHAR) : LOG_LEN_SHORT;
+
+	else if (*p == 'l')
+		*length = (*(++p) == 'l') ? (++p, LOG_LEN_LONG_LONG) : LOG_LEN_LONG;
+
+	else if (*p == 'z')
+	{
+		*length = LOG_LEN_SIZE;
+		++p;
+	}
+
+	switch (*p)
+	{
+		case 'd':
+		case 'i':
+		case 'c':
+			*conversion = LOG_CONV_SIGNED;
+			break;
+
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			*conversion = LOG_CONV_UNSIGNED;
+			break;
+
+		case 'p':
+			*conversion = LOG_CONV_POINTER;
+			break;
+
+		case 's':
+			*conversion = LOG_CONV_STRING;
+			break;
+
+		default:
+			*conversion = LOG_CONV_INVALID;
+			return p;
+	}
+
+	return p + 1;
+}
+
+/*
+ * @brief Copy a format's arguments into a record.
+ * @param record A pointer to the record.
+ * @param args The arguments.
+ * @return void
+ * @note Stops at the first unsupported conversion, or after LOG_RECORD_ARGS arguments.
+*/
+static void loggerCapture(log_record_t_ptr record, va_list args) {
+	const char *format = record->format, *spec = NULL;
+	log_conversion_t conversion;
+	log_length_t length;
+	size_t text_len = 0;
+
+	record->argc = 0;
+	record->spilled = 0;
+
+	while (record->argc < LOG_RECORD_ARGS && (format = loggerNextConversion(format, &spec, &conversion, &length)) != NULL)
+	{
+		uint64_t *arg = (record->args + record->argc);
+
+		switch (conversion)
+		{
+			case LOG_CONV_PERCENT:
+				continue;
+
+			case LOG_CONV_SIGNED:
+				if (length == LOG_LEN_LONG)
+					*arg = (uint64_t)va_arg(args, long);
+
+				else if (length == LOG_LEN_LONG_LONG)
+					*arg = (uint64_t)va_arg(args, long long);
+
+				else if (length == LOG_LEN_SIZE)
+					*arg = (uint64_t)va_arg(args, ssize_t);
+
+				else
+					*arg = (uint64_t)va_arg(args, int);
+
+				break;
+
+			case LOG_CONV_UNSIGNED:
+				if (length == LOG_LEN_LONG)
+					*arg = (uint64_t)va_arg(args, unsigned long);
+
+				else if (length == LOG_LEN_LONG_LONG)
+					*arg = (uint64_t)va_arg(args, unsigned long long);
+
+				else if (length == LOG_LEN_SIZE)
+					*arg = (uint64_t)va_arg(args, size_t);
+
+				else
+					*arg = (uint64_t)va_arg(args, unsigned int);
+
+				break;
+
+			case LOG_CONV_POINTER:
+				*arg = (uint64_t)(uintptr_t)va_arg(args, void *);
+				break;
+
+			case LOG_CONV_STRING:
+			{
+				const char *str = va_arg(args, const char *);
+				size_t len;
+
+				if (str == NULL)
+					str = "(null)";
+
+				len = strlen(str);
+
+				// A string that doesn't fit in the text is copied onto the heap instead of being cut.
+				if (len >= LOG_RECORD_TEXT - text_len)
+				{
+					char *copy = (char *)malloc(len + 1);
+
+					if (copy != NULL)
+					{
+						memcpy(copy, str, len + 1);
+						*arg = (uint64_t)(uintptr_t)copy;
+						record->spilled |= (1u << record->argc);
+						break;
+					}
+
+					atomic_fetch_add_explicit(&logger.truncated, 1, memory_order_relaxed);
+
+					// A string that doesn't fit at all points at the null byte that ends the text.
+					if (text_len == LOG_RECORD_TEXT)
+					{
+						*arg = LOG_RECORD_TEXT - 1;
+						break;
+					}
+
+					len = LOG_RECORD_TEXT - text_len - 1;
+				}
+
+				memcpy(record->text + text_len, str, len);
+				*(record->text + text_len + len) = '\0';
+
+				*arg = text_len;
+				text_len += len + 1;
+				break;
+			}
+
+			case LOG_CONV_INVALID:
+				return;
+		}
+
+		record->argc++;
+	}
+}
+
+/*
+ * @brief Make sure the logger thread's line buffer has room for a number of bytes.
+ * @param needed The number of bytes.
+ * @return void
+ * @note If the buffer can't grow, it's kept as it is, and the line is cut to its size.
+*/
+static void loggerReserve(size_t needed) {
+	if (needed <= logger.line_size)
+		return;
+
+	size_t size = logger.line_size;
+
+	while (size < needed)
+		size *= 2;
+
+	char *line = (char *)realloc(logger.line, size);
+
+	if (line == NULL)
+		return;
+
+	logger.line = line;
+	logger.line_size = size;
+}
+
+/*
+ * @brief Format a record into the logger thread's line buffer.
+ * @param record A pointer to the record.
+ * @return The length of the line.
+*/
+static size_t loggerFormat(log_record_t_ptr record) {
+	const char *format = record->format, *spec = NULL, *next = NULL;
+	log_conversion_t conversion;
+	log_length_t length;
+	unsigned int argi = 0;
+	size_t len = 0;
+	int ret = snprintf(logger.line, logger.line_size, "%s ", loggerPrefix(record->level));
+
+	len = (size_t)ret;
+
+	while (len < logger.line_size - 1 && (next = loggerNextConversion(format, &spec, &conversion, &length)) != NULL)
+	{
+		char conv[32];
+		size_t spec_len = (size_t)(next - spec);
+
+		// The text before the conversion.
+		loggerReserve(len + (size_t)(spec - format) + 1);
+		ret = snprintf(logger.line + len, logger.line_size - len, "%.*s", (int)(spec - format), format);
+		len += (size_t)ret;
+
+		if (len >= logger.line_size - 1)
+			break;
+
+		// Whatever wasn't captured is printed as is.
+		if (conversion == LOG_CONV_INVALID || (conversion != LOG_CONV_PERCENT && argi >= record->argc) || spec_len >= sizeof(conv))
+		{
+			format = spec;
+			break;
+		}
+
+		memcpy(conv, spec, spec_len);
+		*(conv + spec_len) = '\0';
+
+		bool spilled = (conversion == LOG_CONV_STRING && (record->spilled & (1u << argi)) != 0);
+		uint64_t arg = (conversion == LOG_CONV_PERCENT) ? 0 : *(record->args + argi++);
+
+		switch (conversion)
+		{
+			case LOG_CONV_PERCENT:
+				ret = snprintf(logger.line + len, logger.line_size - len, "%%");
+				break;
+
+			case LOG_CONV_SIGNED:
+				if (length == LOG_LEN_LONG)
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (long)arg);
+
+				else if (length == LOG_LEN_LONG_LONG)
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (long long)arg);
+
+				else if (length == LOG_LEN_SIZE)
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (ssize_t)arg);
+
+				else
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (int)arg);
+
+				break;
+
+			case LOG_CONV_UNSIGNED:
+				if (length == LOG_LEN_LONG)
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (unsigned long)arg);
+
+				else if (length == LOG_LEN_LONG_LONG)
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (unsigned long long)arg);
+
+				else if (length == LOG_LEN_SIZE)
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (size_t)arg);
+
+				else
+					ret = snprintf(logger.line + len, logger.line_size - len, conv, (unsigned int)arg);
+
+				break;
+
+			case LOG_CONV_POINTER:
+				ret = snprintf(logger.line + len, logger.line_size - len, conv, (void *)(uintptr_t)arg);
+				break;
+
+			case LOG_CONV_STRING:
+			{
+				const char *str = spilled ? (const char *)(uintptr_t)arg : record->text + arg;
+
+				ret = snprintf(NULL, 0, conv, str);
+
+				if (ret > 0)
+					loggerReserve(len + (size_t)ret + 1);
+
+				ret = snprintf(logger.line + len, logger.line_size - len, conv, str);
+				break;
+			}
+
+			case LOG_CONV_INVALID:
+				break;
+		}
+
+		// A cut conversion leaves the line full.
+		if (ret > 0)
+			len = (len + (size_t)ret < logger.line_size) ? len + (size_t)ret : logger.line_size - 1;
+
+		format = next;
+	}
+
+	loggerReserve(len + strlen(format) + 1);
+
+	if (len < logger.line_size - 1)
+		len += (size_t)snprintf(logger.line + len, logger.line_size - len, "%s", format);
+
+	return (len < logger.line_size) ? len : logger.line_size - 1;
+}
+
+/*
+ * @brief Write an output buffer to its stream.
+ * @param stream The stream.
+ * @param buf The buffer.
+ * @param len A pointer to the number of bytes in the buffer, reset to 0.
+ * @return void
+*/
+static void loggerFlush(FILE *stream, char *buf, size_t *len) {
+	if (*len == 0)
+		return;
+
+	fwrite(buf, 1, *len, stream);
+	fflush(stream);
+	*len = 0;
+}
+
+/*
+ * @brief The logger's thread function - formats the published records in order, and writes them in batches.
+ * @param arg Unused.
+ * @return NULL.
+*/
+static void *loggerRun(void *arg) {
+	(void)arg;
+
+	while (true)
+	{
+		log_record_t_ptr record = (logger.ring + (logger.head & (LOG_RING_SIZE - 1)));
+
+		if (atomic_load_explicit(&record->sequence, memory_order_acquire) == logger.head + 1)
+		{
+			size_t len = loggerFormat(record);
+			bool error = (record->level <= LOG_LEVEL_WARNING);
+			FILE *stream = error ? stderr : stdout;
+			char *buf = error ? logger.err : logger.out;
+			size_t *buf_len = error ? &logger.err_len : &logger.out_len;
+
+			for (unsigned int i = 0; record->spilled != 0 && i < record->argc; ++i)
+			{
+				if ((record->spilled & (1u << i)) != 0)
+					free((void *)(uintptr_t)*(record->args + i));
+			}
+
+			// Free the record for the producers as soon as it's formatted.
+			atomic_store_explicit(&record->sequence, logger.head + LOG_RING_SIZE, memory_order_release);
+			logger.head++;
+
+			if (*buf_len + len > LOG_BATCH_SIZE)
+				loggerFlush(stream, buf, buf_len);
+
+			// A line longer than a whole batch is written on its own.
+			if (len > LOG_BATCH_SIZE)
+			{
+				fwrite(logger.line, 1, len, stream);
+				fflush(stream);
+				continue;
+			}
+
+			memcpy(buf + *buf_len, logger.line, len);
+			*buf_len += len;
+			continue;
+		}
+
+		// The ring is empty, so this batch is done.
+		loggerFlush(stdout, logger.out, &logger.out_len);
+		loggerFlush(stderr, logger.err, &logger.err_len);
+
+		if (!atomic_load(&logger.running))
+			break;
+
+		atomic_store(&logger.sleeping, true);
+
+		// A producer might have published a record before it saw the flag.
+		if (atomic_load(&record->sequence) == logger.head + 1)
+		{
+			atomic_store(&logger.sleeping, false);
+			continue;
+		}
+
+		uint64_t value;
+
+		if (read(logger.wake_fd, &value, sizeof(value)) < 0 && errno != EINTR)
+			break;
+	}
+
+	return NULL;
+}
+
+int startLogger(void) {
+	char *env = getenv("LOG_LEVEL");
+
+	if (atomic_load(&logger.running))
+		return 0;
+
+	if (env != NULL)
+	{
+		if (strcasecmp(env, "error") == 0)
+			setLogLevel(LOG_LEVEL_ERROR);
+
+		else if (strcasecmp(env, "warning") == 0)
+			setLogLevel(LOG_LEVEL_WARNING);
+
+		else if (strcasecmp(env, "info") == 0)
+			setLogLevel(LOG_LEVEL_INFO);
+
+		else if (strcasecmp(env, "message") == 0)
+			setLogLevel(LOG_LEVEL_MESSAGE);
+
+		else
+			fprintf(stderr, "%s Unknown LOG_LEVEL \"%s\", ignoring it.\n", C_PREFIX_WARNING, env);
+	}
+
+	if ((logger.ring = (log_record_t_ptr)calloc(LOG_RING_SIZE, sizeof(log_record_t))) == NULL)
+	{
+		fprintf(stderr, "%s calloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return 1;
+	}
+
+	if ((logger.line = (char *)malloc(LOG_LINE_MAX)) == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		free(logger.ring);
+		logger.ring = NULL;
+		return 1;
+	}
+
+	logger.line_size = LOG_LINE_MAX;
+
+	for (size_t i = 0; i < LOG_RING_SIZE; ++i)
+		atomic_init(&(logger.ring + i)->sequence, i);
+
+	atomic_store(&logger.tail, 0);
+	logger.head = 0;
+	logger.out_len = logger.err_len = 0;
+	atomic_store(&logger.sleeping, false);
+
+	if ((logger.wake_fd = eventfd(0, EFD_CLOEXEC)) < 0)
+	{
+		fprintf(stderr, "%s eventfd() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		free(logger.line);
+		logger.line = NULL;
+		free(logger.ring);
+		logger.ring = NULL;
+		return 1;
+	}
+
+	atomic_store(&logger.running, true);
+
+	int ret = pthread_create(&logger.thread, NULL, loggerRun, NULL);
+
+	if (ret != 0)
+	{
+		fprintf(stderr, "%s pthread_create() failed: %s\n", C_PREFIX_ERROR, strerror(ret));
+		atomic_store(&logger.running, false);
+		close(logger.wake_fd);
+		logger.wake_fd = -1;
+		free(logger.line);
+		logger.line = NULL;
+		free(logger.ring);
+		logger.ring = NULL;
+		return 1;
+	}
+
+	return 0;
+}
+
+void stopLogger(void) {
+	uint64_t value = 1;
+
+	if (!atomic_load(&logger.running))
+		return;
+
+	atomic_store(&logger.running, false);
+
+	while (write(logger.wake_fd, &value, sizeof(value)) < 0 && errno == EINTR);
+
+	pthread_join(logger.thread, NULL);
+
+	close(logger.wake_fd);
+	logger.wake_fd = -1;
+	free(logger.line);
+	logger.line = NULL;
+	free(logger.ring);
+	logger.ring = NULL;
+}
+
+void setLogLevel(log_level_t level) {
+	if (level < LOG_LEVEL_ERROR)
+		level = LOG_LEVEL_ERROR;
+
+	else if (level > LOG_LEVEL_MESSAGE)
+		level = LOG_LEVEL_MESSAGE;
+
+	atomic_store_explicit(&logger.level, (int)level, memory_order_relaxed);
+}
+
+log_level_t getLogLevel(void) {
+	return (log_level_t)atomic_load_explicit(&logger.level, memory_order_relaxed);
+}
+
+uint64_t getLogDropped(void) {
+	return atomic_load_explicit(&logger.dropped, memory_order_relaxed);
+}
+
+uint64_t getLogTruncated(void) {
+	return atomic_load_explicit(&logger.truncated, memory_order_relaxed);
+}
+
+void logWrite(log_level_t level, const char *format, ...) {
+	va_list args;
+
+	if ((int)level > atomic_load_explicit(&logger.level, memory_order_relaxed) || format == NULL)
+		return;
+
+	va_start(args, format);
+
+	// Without the logger's thread, the message is printed right away.
+	if (!atomic_load_explicit(&logger.running, memory_order_acquire))
+	{
+		FILE *stream = (level <= LOG_LEVEL_WARNING) ? stderr : stdout;
+
+		flockfile(stream);
+		fprintf(stream, "%s ", loggerPrefix(level));
+		vfprintf(stream, format, args);
+		funlockfile(stream);
+
+		va_end(args);
+		return;
+	}
+
+	size_t pos = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+	log_record_t_ptr record = NULL;
+
+	while (true)
+	{
+		record = (logger.ring + (pos & (LOG_RING_SIZE - 1)));
+
+		size_t sequence = atomic_load_explicit(&record->sequence, memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+		if (diff == 0)
+		{
+			if (atomic_compare_exchange_weak_explicit(&logger.tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+
+		// The record is still waiting for the logger's thread, so the ring is full.
+		else if (diff < 0)
+		{
+			atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+			va_end(args);
+			return;
+		}
+
+		else
+			pos = atomic_load_explicit(&logger.tail, memory_order_relaxed);
+	}
+
+	record->format = format;
+	record->level = level;
+	loggerCapture(record, args);
+	va_end(args);
+
+	atomic_store(&record->sequence, pos + 1);
+
+	// Only a sleeping logger thread costs the producer a syscall.
+	if (atomic_load(&logger.sleeping) && atomic_exchange(&logger.sleeping, false))
+	{
+		uint64_t value = 1;
+
+		while (write(logger.wake_fd, &value, sizeof(value)) < 0 && errno == EINTR);
+	}
+}
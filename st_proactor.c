@@ -17,11 +17,802 @@
 */
 
 #include "proactor.h"
+#include "logger.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
 
+/*
+ * @brief Append a chain of jobs to a proactor worker's queue.
+ * @param worker A pointer to the worker.
+ * @param head The first job in the chain.
+ * @param tail The last job in the chain.
+ * @param count The number of jobs in the chain.
+ * @return void
+ * @note The worker is only woken up once per queue, as it always takes the whole queue at once.
+ * @note Completions only release memory, so they don't wake the worker up - it takes them along with the next job that does.
+*/
+static void proactorEnqueueChain(PProactorWorker worker, PProactorJob head, PProactorJob tail, size_t count) {
+	pthread_mutex_lock(&worker->lock);
+
+	bool wake = (!worker->queue_woken && head->type != PROACTOR_JOB_COMPLETE);
+
+	if (wake)
+		worker->queue_woken = true;
+
+	metricAdd(&worker->stats.queued_jobs, count);
+
+	if (worker->queue_tail == NULL)
+		worker->queue_head = head;
+
+	else
+		worker->queue_tail->next = head;
+
+	worker->queue_tail = tail;
+
+	pthread_mutex_unlock(&worker->lock);
+
+	if (wake)
+	{
+		uint64_t one = 1;
+
+		while (write(worker->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+	}
+}
+
+/*
+ * @brief Add a worker's counters to a snapshot.
+ * @param stats A pointer to the snapshot.
+ * @param worker A pointer to the worker.
+ * @return void
+*/
+static void proactorStatsAdd(PProactorStats stats, PProactorWorker worker) {
+	stats->writes += metricRead(&worker->stats.writes);
+	stats->bytes_sent += metricRead(&worker->stats.bytes_sent);
+	stats->dropped += metricRead(&worker->stats.dropped);
+	stats->zc_sends += metricRead(&worker->stats.zc_sends);
+	stats->zc_completed += metricRead(&worker->stats.zc_completed);
+	stats->zc_copied += metricRead(&worker->stats.zc_copied);
+	stats->queued_bytes += metricRead(&worker->stats.queued_bytes);
+	stats->queued_jobs += metricRead(&worker->stats.queued_jobs);
+	stats->nodes_live += metricRead(&worker->stats.nodes_live);
+	stats->nodes_free += metricRead(&worker->stats.nodes_free);
+}
+
+/*
+ * @brief Enqueue a job to a proactor worker.
+ * @param worker A pointer to the worker.
+ * @param type The job's type.
+ * @param fd The file descriptor to add or remove.
+ * @param handler The file descriptor's handler, for PROACTOR_JOB_ADD.
+ * @param message The message to send, for PROACTOR_JOB_SEND and PROACTOR_JOB_BROADCAST,
+ * 			the job takes ownership of the caller's reference to it.
+ * @return 0 on success, 1 on failure.
+*/
+static int proactorEnqueue(PProactorWorker worker, ProactorJobType type, int fd, handler_t handler, PProactorMessage message) {
+	PProactorJob job = (PProactorJob) malloc(sizeof(ProactorJob));
+
+	if (job == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return 1;
+	}
+
+	job->type = type;
+	job->fd = fd;
+	job->handler = handler;
+	job->message = message;
+	job->seq = job->copied = 0;
+	job->next = NULL;
+
+	proactorEnqueueChain(worker, job, job, 1);
+
+	return 0;
+}
+
+/*
+ * @brief Find the worker that owns a file descriptor.
+ * @param proactor A pointer to the proactor.
+ * @param fd The file descriptor.
+ * @return A pointer to the worker.
+*/
+static inline PProactorWorker proactorWorkerOf(PProactor proactor, int fd) {
+	return (proactor->workers + ((size_t)fd % proactor->worker_count));
+}
+
+/*
+ * @brief Find a file descriptor in a worker's file descriptor table.
+ * @param worker A pointer to the worker.
+ * @param fd The file descriptor.
+ * @return A pointer to the file descriptor's node, or NULL if it isn't in the table.
+ * @note Must only be called from the worker's thread.
+*/
+static PProactorNode proactorWorkerFind(PProactorWorker worker, int fd) {
+	size_t slot = (size_t)fd / worker->proactor->worker_count;
+
+	return (slot < worker->table_size) ? *(worker->table + slot) : NULL;
+}
+
+/*
+ * @brief Start or stop waiting for a file descriptor to become writable.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the file descriptor's node.
+ * @param watch True to start waiting, false to stop.
+ * @return 0 on success, 1 on failure.
+*/
+static int proactorNodeWatch(PProactorWorker worker, PProactorNode node, bool watch) {
+	if (node->watching == watch)
+		return 0;
+
+	// A zero-copy socket is always in the epoll set, only its events change.
+	if (node->zerocopy)
+	{
+		struct epoll_event event = { .events = (watch ? EPOLLOUT : 0), .data.ptr = node };
+
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, node->fd, &event) < 0 && watch)
+		{
+			fprintf(stderr, "%s epoll_ctl() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			return 1;
+		}
+	}
+
+	else if (watch)
+	{
+		struct epoll_event event = { .events = EPOLLOUT, .data.ptr = node };
+
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, node->fd, &event) < 0)
+		{
+			fprintf(stderr, "%s epoll_ctl() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			return 1;
+		}
+	}
+
+	// The file descriptor might be closed already, in which case the kernel dropped it from the epoll set.
+	else
+	{
+		int saved_errno = errno;
+		epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, node->fd, NULL);
+		errno = saved_errno;
+	}
+
+	node->watching = watch;
+
+	return 0;
+}
+
+/*
+ * @brief Enable zero-copy sends on a file descriptor, if the proactor uses them and the socket supports them.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the file descriptor's node.
+ * @return void
+ * @note A socket that doesn't support SO_ZEROCOPY (e.g. a Unix domain socket) just keeps copying.
+*/
+static void proactorNodeZeroCopy(PProactorWorker worker, PProactorNode node) {
+	int enable = 1;
+	struct epoll_event event = { .events = 0, .data.ptr = node };
+
+	if (worker->proactor->zerocopy_threshold == 0)
+		return;
+
+	if (setsockopt(node->fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) < 0)
+		return;
+
+	// The completions are reported as EPOLLERR, which epoll always reports, even with no events requested.
+	if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, node->fd, &event) < 0)
+	{
+		fprintf(stderr, "%s epoll_ctl() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return;
+	}
+
+	node->zerocopy = true;
+}
+
+/*
+ * @brief Read the zero-copy completions from a socket's error queue.
+ * @param fd The socket.
+ * @param seq Where to store the sequence number of the last completed send, if there were any completions.
+ * @param copied Where to add the number of completed sends the kernel copied anyway.
+ * @return true if there were any completions, false otherwise.
+ * @note The kernel reports a range of sequence numbers per completion, and completes the sends in order,
+ * 			so every send up to the end of the last range is done.
+*/
+static bool proactorReadCompletions(int fd, uint32_t *seq, uint32_t *copied) {
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+	bool completed = false;
+
+	while (true)
+	{
+		struct msghdr msg = { .msg_control = control, .msg_controllen = sizeof(control) };
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+
+		for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+				(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+				continue;
+
+			struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+
+			if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				*copied += (serr->ee_data - serr->ee_info) + 1;
+
+			if (!completed || (int32_t)(serr->ee_data - *seq) > 0)
+				*seq = serr->ee_data;
+
+			completed = true;
+		}
+	}
+
+	return completed;
+}
+
+/*
+ * @brief Release a file descriptor's zero-copy sends, up to a sequence number.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the file descriptor's node.
+ * @param seq The sequence number of the last completed send.
+ * @return void
+ * @note Sends that were released already are skipped, so the same completion may be applied twice.
+*/
+static void proactorNodeRelease(PProactorWorker worker, PProactorNode node, uint32_t seq) {
+	while (node->zc_head != NULL && (int32_t)(node->zc_head->seq - seq) <= 0)
+	{
+		PProactorZeroCopy zc = node->zc_head;
+
+		node->zc_head = zc->next;
+
+		if (node->zc_head == NULL)
+			node->zc_tail = NULL;
+
+		unrefProactorMessage(zc->message);
+		free(zc);
+
+		metricAdd(&worker->stats.zc_completed, 1);
+	}
+}
+
+/*
+ * @brief Read the zero-copy completions from a socket's error queue, and release the messages they cover.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the file descriptor's node.
+ * @return 0 on success, 1 if the socket has a pending error.
+*/
+static int proactorNodeComplete(PProactorWorker worker, PProactorNode node) {
+	uint32_t seq = 0, copied = 0;
+
+	if (proactorReadCompletions(node->fd, &seq, &copied))
+	{
+		metricAdd(&worker->stats.zc_copied, copied);
+		proactorNodeRelease(worker, node, seq);
+	}
+
+	int error = 0;
+	socklen_t error_len = sizeof(error);
+
+	if (getsockopt(node->fd, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error != 0)
+	{
+		errno = error;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Get the current time of the monotonic clock, in milliseconds.
+ * @return The current time, in milliseconds.
+*/
+static inline uint64_t proactorNow(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return ((uint64_t)now.tv_sec * 1000) + ((uint64_t)now.tv_nsec / 1000000);
+}
+
+/*
+ * @brief Mark a file descriptor as having fresh data to flush at the end of the worker's tick.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the file descriptor's node.
+ * @return void
+ * @note A file descriptor that waits to become writable isn't marked, as EPOLLOUT flushes it anyway.
+*/
+static void proactorNodeMarkDirty(PProactorWorker worker, PProactorNode node) {
+	if (node->out_count >= PROACTOR_MAX_BATCH)
+		worker->batch_full = true;
+
+	if (node->dirty || node->watching)
+		return;
+
+	if (worker->dirty_head == NULL)
+		worker->flush_deadline = proactorNow() + PROACTOR_FLUSH_LATENCY;
+
+	node->dirty = true;
+	node->dirty_next = worker->dirty_head;
+	worker->dirty_head = node;
+}
+
+/*
+ * @brief Send as much of a file descriptor's outbound queue as the socket accepts, without blocking.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the file descriptor's node.
+ * @return 0 on success (even if some data is still queued), 1 on a fatal socket error.
+ * @note Up to PROACTOR_MAX_BATCH queued messages go out in a single sendmsg() call.
+ * @note A message of at least zerocopy_threshold bytes goes out on its own with MSG_ZEROCOPY, and stays
+ * 			referenced until the kernel reports the send as done.
+*/
+static int proactorNodeFlush(PProactorWorker worker, PProactorNode node) {
+	struct iovec iov[PROACTOR_MAX_BATCH];
+	bool copy_only = false;
+
+	while (node->out_head != NULL)
+	{
+		PProactorChunk chunk = node->out_head;
+		PProactorZeroCopy zc = NULL;
+		struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 0 };
+		int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+		size_t total = 0;
+
+		if (node->zerocopy && !copy_only && chunk->message->length - chunk->offset >= worker->proactor->zerocopy_threshold)
+			zc = (PProactorZeroCopy) malloc(sizeof(ProactorZeroCopy));
+
+		if (zc != NULL)
+		{
+			iov->iov_base = chunk->message->data + chunk->offset;
+			iov->iov_len = chunk->message->length - chunk->offset;
+			total = iov->iov_len;
+			msg.msg_iovlen = 1;
+			flags |= MSG_ZEROCOPY;
+		}
+
+		else
+		{
+			while (chunk != NULL && msg.msg_iovlen < PROACTOR_MAX_BATCH)
+			{
+				(iov + msg.msg_iovlen)->iov_base = chunk->message->data + chunk->offset;
+				(iov + msg.msg_iovlen)->iov_len = chunk->message->length - chunk->offset;
+				total += (iov + msg.msg_iovlen)->iov_len;
+				msg.msg_iovlen++;
+				chunk = chunk->next;
+			}
+		}
+
+		ssize_t bytes_sent = sendmsg(node->fd, &msg, flags);
+
+		metricAdd(&worker->stats.writes, 1);
+
+		if (bytes_sent < 0)
+		{
+			free(zc);
+
+			if (errno == EINTR)
+				continue;
+
+			// The socket can't pin any more pages right now, so this flush copies instead.
+			if (errno == ENOBUFS && (flags & MSG_ZEROCOPY))
+			{
+				copy_only = true;
+				continue;
+			}
+
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return proactorNodeWatch(worker, node, true);
+
+			return 1;
+		}
+
+		metricAdd(&worker->stats.bytes_sent, (uint64_t)bytes_sent);
+
+#if LATENCY_HISTOGRAMS
+		uint64_t sent = histogramClock();
+#endif
+
+		metricSub(&worker->stats.queued_bytes, (uint64_t)bytes_sent);
+		node->out_bytes -= (size_t)bytes_sent;
+
+		// The kernel numbers every successful zero-copy send of the socket, starting from 0.
+		if (zc != NULL)
+		{
+			zc->seq = node->zc_seq++;
+			zc->message = refProactorMessage(chunk->message);
+			zc->next = NULL;
+
+			if (node->zc_tail == NULL)
+				node->zc_head = zc;
+
+			else
+				node->zc_tail->next = zc;
+
+			node->zc_tail = zc;
+			metricAdd(&worker->stats.zc_sends, 1);
+		}
+
+		// Release every chunk that was sent completely, and advance the one that was sent partially.
+		size_t left = (size_t)bytes_sent;
+
+		while (node->out_head != NULL && left > 0)
+		{
+			chunk = node->out_head;
+
+			size_t remaining = chunk->message->length - chunk->offset;
+
+			if (left < remaining)
+			{
+				chunk->offset += left;
+				break;
+			}
+
+			left -= remaining;
+			node->out_head = chunk->next;
+			node->out_count--;
+
+#if LATENCY_HISTOGRAMS
+			histogramRecord(&worker->stats.send_latency, sent - chunk->message->created);
+#endif
+
+			if (node->out_head == NULL)
+				node->out_tail = NULL;
+
+			unrefProactorMessage(chunk->message);
+			free(chunk);
+		}
+
+		// The socket's buffer is full, so the rest waits until it becomes writable.
+		if ((size_t)bytes_sent < total)
+			return proactorNodeWatch(worker, node, true);
+	}
+
+	return proactorNodeWatch(worker, node, false);
+}
+
+/*
+ * @brief Queue data for a file descriptor, to be flushed at the end of the worker's tick.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the file descriptor's node.
+ * @param buf The data to send.
+ * @param len The length of the data, in bytes.
+ * @param message The message that holds the data, or NULL if the data isn't in a message.
+ * @return len on success, -1 on failure with errno set - ENOBUFS if the data was dropped.
+ * @note Data that's in a message is queued as a reference to the message, and only data that
+ * 			isn't in a message is copied - into a new message.
+*/
+static ssize_t proactorNodeQueue(PProactorWorker worker, PProactorNode node, const void *buf, size_t len, PProactorMessage message) {
+	if (node->out_head != NULL && node->out_bytes + len > PROACTOR_QUEUE_LIMIT)
+	{
+		metricAdd(&worker->stats.dropped, 1);
+		errno = ENOBUFS;
+		return -1;
+	}
+
+	PProactorChunk chunk = (PProactorChunk) malloc(sizeof(ProactorChunk));
+
+	if (chunk == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return -1;
+	}
+
+	if (message != NULL)
+	{
+		chunk->message = refProactorMessage(message);
+		chunk->offset = (size_t)((const char *)buf - message->data);
+	}
+
+	else if ((chunk->message = createProactorMessage(buf, len)) == NULL)
+	{
+		free(chunk);
+		return -1;
+	}
+
+	else
+		chunk->offset = 0;
+
+	chunk->next = NULL;
+
+	if (node->out_tail == NULL)
+		node->out_head = chunk;
+
+	else
+		node->out_tail->next = chunk;
+
+	node->out_tail = chunk;
+	node->out_bytes += len;
+	node->out_count++;
+	metricAdd(&worker->stats.queued_bytes, len);
+
+	proactorNodeMarkDirty(worker, node);
+
+	return (ssize_t)len;
+}
+
+/*
+ * @brief Take a zeroed node from a worker's free list, adding a slab when the list is empty.
+ * @param worker A pointer to the worker.
+ * @return A pointer to the node, or NULL on failure.
+*/
+static PProactorNode proactorNodeAlloc(PProactorWorker worker) {
+	if (worker->free_nodes == NULL)
+	{
+		PProactorSlab slab = (PProactorSlab) malloc(sizeof(ProactorSlab));
+
+		if (slab == NULL)
+			return NULL;
+
+		slab->next = worker->slabs;
+		worker->slabs = slab;
+
+		// Pushed from the last node down, so the nodes are handed out in address order.
+		for (size_t i = PROACTOR_SLAB_NODES; i > 0; --i)
+		{
+			PProactorNode node = (slab->nodes + i - 1);
+
+			node->next = worker->free_nodes;
+			worker->free_nodes = node;
+		}
+
+		metricAdd(&worker->stats.nodes_free, PROACTOR_SLAB_NODES);
+	}
+
+	PProactorNode node = worker->free_nodes;
+
+	worker->free_nodes = node->next;
+	metricSub(&worker->stats.nodes_free, 1);
+	metricAdd(&worker->stats.nodes_live, 1);
+
+	memset(node, 0, sizeof(ProactorNode));
+
+	return node;
+}
+
+/*
+ * @brief Free a node, along with whatever is left in its outbound queue.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the node.
+ * @return void
+*/
+static void proactorNodeFree(PProactorWorker worker, PProactorNode node) {
+	proactorNodeWatch(worker, node, false);
+
+	// The socket is going away, so the pages it still has pinned don't matter anymore.
+	if (node->zerocopy)
+	{
+		int saved_errno = errno;
+		epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, node->fd, NULL);
+		errno = saved_errno;
+	}
+
+	while (node->zc_head != NULL)
+	{
+		PProactorZeroCopy zc = node->zc_head;
+		node->zc_head = zc->next;
+		unrefProactorMessage(zc->message);
+		free(zc);
+	}
+
+	if (node->dirty)
+	{
+		PProactorNode *link = &worker->dirty_head;
+
+		while (*link != node)
+			link = &(*link)->dirty_next;
+
+		*link = node->dirty_next;
+	}
+
+	while (node->out_head != NULL)
+	{
+		PProactorChunk chunk = node->out_head;
+		node->out_head = chunk->next;
+		unrefProactorMessage(chunk->message);
+		free(chunk);
+	}
+
+	metricSub(&worker->stats.queued_bytes, node->out_bytes);
+
+	if (worker->current == node)
+		worker->current = NULL;
+
+	node->next = worker->free_nodes;
+	worker->free_nodes = node;
+	metricSub(&worker->stats.nodes_live, 1);
+	metricAdd(&worker->stats.nodes_free, 1);
+}
+
+/*
+ * @brief Add a node to a worker's linked list and file descriptor table.
+ * @param worker A pointer to the worker.
+ * @param node A pointer to the node, its file descriptor must not be in the table.
+ * @return 0 on success, 1 on failure.
+ * @note Must only be called from the worker's thread.
+*/
+static int proactorWorkerInsert(PProactorWorker worker, PProactorNode node) {
+	size_t slot = (size_t)node->fd / worker->proactor->worker_count;
+
+	if (slot >= worker->table_size)
+	{
+		size_t table_size = (worker->table_size == 0) ? PROACTOR_SLAB_NODES : worker->table_size;
+
+		while (table_size <= slot)
+			table_size *= 2;
+
+		PProactorNode *table = (PProactorNode *)realloc(worker->table, table_size * sizeof(PProactorNode));
+
+		if (table == NULL)
+			return 1;
+
+		for (size_t i = worker->table_size; i < table_size; ++i)
+			*(table + i) = NULL;
+
+		worker->table = table;
+		worker->table_size = table_size;
+	}
+
+	*(worker->table + slot) = node;
+
+	node->prev = NULL;
+	node->next = worker->head;
+
+	if (worker->head != NULL)
+		worker->head->prev = node;
+
+	worker->head = node;
+
+	return 0;
+}
+
+/*
+ * @brief Remove a file descriptor from a worker's linked list and file descriptor table.
+ * @param worker A pointer to the worker.
+ * @param fd The file descriptor.
+ * @return 0 on success, 1 if the file descriptor isn't in the table.
+ * @note Must only be called from the worker's thread.
+*/
+static int proactorWorkerRemove(PProactorWorker worker, int fd) {
+	PProactorNode node = proactorWorkerFind(worker, fd);
+
+	if (node == NULL)
+		return 1;
+
+	if (node->prev == NULL)
+		worker->head = node->next;
+
+	else
+		node->prev->next = node->next;
+
+	if (node->next != NULL)
+		node->next->prev = node->prev;
+
+	*(worker->table + (size_t)fd / worker->proactor->worker_count) = NULL;
+
+	proactorNodeFree(worker, node);
+
+	return 0;
+}
+
+/*
+ * @brief Run the handler of every file descriptor in a worker's linked list.
+ * @param proactor A pointer to the proactor.
+ * @param worker A pointer to the worker.
+ * @return void
+ * @note A file descriptor whose handler fails is removed, and the run goes on with the rest of them.
+*/
+static void proactorWorkerRun(PProactor proactor, PProactorWorker worker) {
+	PProactorNode curr = worker->head;
+
+	while (curr != NULL)
+	{
+		PProactorNode next = curr->next;
+
+		if (curr->hdlr.handler != NULL)
+		{
+			worker->current = curr;
+
+			int ret = curr->hdlr.handler(curr->fd);
+
+			worker->current = NULL;
+
+			// Error handling
+			if (ret != 0)
+			{
+				logWrite(LOG_LEVEL_ERROR, "proactorRun() failed: handler returned %d, removing file descriptor %d\n", ret, curr->fd);
+
+				if (proactorWorkerRemove(worker, curr->fd) == 0)
+					proactor->size--;
+			}
+		}
+
+		curr = next;
+	}
+}
+
+/*
+ * @brief Queue a message for every file descriptor in a worker's linked list.
+ * @param worker A pointer to the worker.
+ * @param message The message to send.
+ * @param except A file descriptor that doesn't get the message, or -1.
+ * @return void
+ * @note The message is only queued, it goes out when the worker flushes at the end of its tick.
+*/
+static void proactorWorkerBroadcast(PProactorWorker worker, PProactorMessage message, int except) {
+	for (PProactorNode curr = worker->head; curr != NULL; curr = curr->next)
+	{
+		if (curr->fd != except)
+			proactorNodeQueue(worker, curr, message->data, message->length, message);
+	}
+}
+
+/*
+ * @brief Flush every file descriptor that got fresh data since the last flush.
+ * @param proactor A pointer to the proactor.
+ * @param worker A pointer to the worker.
+ * @return void
+ * @note Every file descriptor gets a single sendmsg() call for all the messages it got in the meantime
+ * 			(up to PROACTOR_MAX_BATCH of them), instead of a send() call per message.
+ * @note A file descriptor whose socket fails is removed, and the flush goes on with the rest of them.
+*/
+static void proactorWorkerFlush(PProactor proactor, PProactorWorker worker) {
+	while (worker->dirty_head != NULL)
+	{
+		PProactorNode node = worker->dirty_head;
+
+		worker->dirty_head = node->dirty_next;
+		node->dirty = false;
+		node->dirty_next = NULL;
+
+		if (proactorNodeFlush(worker, node) != 0)
+		{
+			logWrite(LOG_LEVEL_ERROR, "send() failed: %s, removing file descriptor %d\n", strerror(errno), node->fd);
+
+			if (proactorWorkerRemove(worker, node->fd) == 0)
+				proactor->size--;
+		}
+	}
+
+	worker->batch_full = false;
+}
+
+/*
+ * @brief Check whether any file descriptor of a worker still has data in its outbound queue.
+ * @param worker A pointer to the worker.
+ * @return true if some data wasn't sent yet, false otherwise.
+*/
+static bool proactorWorkerBacklogged(PProactorWorker worker) {
+	for (PProactorNode curr = worker->head; curr != NULL; curr = curr->next)
+	{
+		if (curr->out_head != NULL)
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * @brief The thread function of a proactor worker.
+ * @param args A pointer to the worker.
+ * @return A pointer to the proactor, or NULL on failure.
+ * @note The worker sleeps until jobs are enqueued or a backlogged socket becomes writable.
+ * 			Writable sockets are flushed first, and then the worker takes the whole queue at once.
+ * @note The messages the jobs queued are flushed once the whole queue was done - right away by default,
+ * 			or after up to PROACTOR_FLUSH_LATENCY milliseconds, to let more messages join the same flush.
+ * @note After a stop job, the worker keeps flushing its backlogged sockets as they become writable,
+ * 			until they're all empty or the proactor's drain timeout passes.
+*/
 void *proactorRunFunction(void *args) {
 	if (args == NULL)
 	{
@@ -30,48 +821,241 @@ void *proactorRunFunction(void *args) {
 		return NULL;
 	}
 
-	PProactor proactor = (PProactor)args;
+	PProactorWorker worker = (PProactorWorker)args;
+	PProactor proactor = worker->proactor;
+	struct epoll_event events[PROACTOR_MAX_EVENTS];
+
+	bool running = true;
+	uint64_t drain_deadline = 0;
+
+	while (running || (proactorNow() < drain_deadline && proactorWorkerBacklogged(worker)))
+	{
+		int timeout = -1;
+
+		// Sleep no longer than the flush latency bound allows.
+		if (worker->dirty_head != NULL)
+		{
+			uint64_t now = proactorNow();
+			timeout = (now >= worker->flush_deadline) ? 0 : (int)(worker->flush_deadline - now);
+		}
+
+		// While draining, sleep no longer than the drain deadline either.
+		if (!running)
+		{
+			uint64_t now = proactorNow();
+			int left = (now >= drain_deadline) ? 0 : (int)(drain_deadline - now);
+
+			if (timeout < 0 || left < timeout)
+				timeout = left;
+		}
+
+		int ready = epoll_wait(worker->epoll_fd, events, PROACTOR_MAX_EVENTS, timeout);
+		bool wake = false;
+
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "%s epoll_wait() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			break;
+		}
+
+		// The nodes are flushed before the jobs run, as a job might free a node that has a pending event.
+		for (int i = 0; i < ready; ++i)
+		{
+			PProactorNode node = (PProactorNode)(events + i)->data.ptr;
+
+			if (node == NULL)
+			{
+				wake = true;
+				continue;
+			}
 
-	if (!proactor->isRunning)
-	{
-		fprintf(stderr, "%s proactorRun() failed: the proactor is not running\n", C_PREFIX_ERROR);
-		return NULL;
-	}
+			uint32_t revents = (events + i)->events;
+			int failed = 0;
 
-	fprintf(stderr, "%s Proactor thread started.\n", C_PREFIX_INFO);
+			if (node->zerocopy && (revents & EPOLLERR))
+				failed = proactorNodeComplete(worker, node);
 
-	PProactorNode curr = proactor->head;
+			// The peer is gone, a zero-copy socket would otherwise keep reporting it.
+			if (failed == 0 && (revents & EPOLLHUP))
+			{
+				errno = EPIPE;
+				failed = 1;
+			}
 
-	while (curr != NULL && proactor->isRunning)
-	{
-		if (curr->hdlr.handler != NULL)
+			if (failed == 0 && node->out_head != NULL)
+				failed = proactorNodeFlush(worker, node);
+
+			if (failed != 0)
+			{
+				logWrite(LOG_LEVEL_ERROR, "send() failed: %s, removing file descriptor %d\n", strerror(errno), node->fd);
+
+				if (proactorWorkerRemove(worker, node->fd) == 0)
+					proactor->size--;
+			}
+		}
+
+		if (!wake)
 		{
-			int ret = curr->hdlr.handler(curr->fd);
+			if (worker->dirty_head != NULL && (worker->batch_full || proactorNow() >= worker->flush_deadline))
+				proactorWorkerFlush(proactor, worker);
 
-			// Error handling
-			if (ret != 0)
+			continue;
+		}
+
+		uint64_t value;
+
+		while (read(worker->wake_fd, &value, sizeof(value)) < 0 && errno == EINTR);
+
+		pthread_mutex_lock(&worker->lock);
+
+		// Take the whole queue at once, so the lock isn't held while the handlers run.
+		PProactorJob job = worker->queue_head;
+		worker->queue_head = worker->queue_tail = NULL;
+		worker->queue_woken = false;
+		metricSet(&worker->stats.queued_jobs, 0);
+
+		pthread_mutex_unlock(&worker->lock);
+
+		while (job != NULL)
+		{
+			PProactorJob next = job->next;
+
+			switch (job->type)
 			{
-				fprintf(stderr, "%s proactorRun() failed: handler returned %d\n", C_PREFIX_ERROR, ret);
-				proactor->isRunning = false;
-				pthread_exit(NULL);
+				case PROACTOR_JOB_ADD:
+				{
+					PProactorNode node = proactorWorkerFind(worker, job->fd);
+
+					// A file descriptor that's added again only gets its new handler.
+					if (node != NULL)
+					{
+						node->hdlr.handler = job->handler;
+						break;
+					}
+
+					node = proactorNodeAlloc(worker);
+
+					if (node == NULL)
+					{
+						logWrite(LOG_LEVEL_ERROR, "addFD2Proactor() failed: %s\n", strerror(errno));
+						break;
+					}
+
+					node->fd = job->fd;
+					node->hdlr.handler = job->handler;
+
+					if (proactorWorkerInsert(worker, node) != 0)
+					{
+						logWrite(LOG_LEVEL_ERROR, "addFD2Proactor() failed: %s\n", strerror(errno));
+						proactorNodeFree(worker, node);
+						break;
+					}
+
+					proactorNodeZeroCopy(worker, node);
+
+					proactor->size++;
+					break;
+				}
+
+				case PROACTOR_JOB_REMOVE:
+				case PROACTOR_JOB_CLOSE:
+					// The file descriptor might have been removed already, after its handler failed.
+					if (proactorWorkerRemove(worker, job->fd) == 0)
+						proactor->size--;
+
+					if (job->type == PROACTOR_JOB_CLOSE)
+						close(job->fd);
+
+					break;
+
+				case PROACTOR_JOB_RUN:
+					proactorWorkerRun(proactor, worker);
+					break;
+
+				case PROACTOR_JOB_SEND:
+				{
+					PProactorNode node = proactorWorkerFind(worker, job->fd);
+
+					// The file descriptor might have been removed since the data was enqueued.
+					if (node != NULL)
+						proactorNodeQueue(worker, node, job->message->data, job->message->length, job->message);
+
+					break;
+				}
+
+				case PROACTOR_JOB_BROADCAST:
+				{
+					LATENCY_START(start);
+					proactorWorkerBroadcast(worker, job->message, job->fd);
+					LATENCY_RECORD(&worker->stats.fanout_latency, start);
+					break;
+				}
+
+				case PROACTOR_JOB_COMPLETE:
+				{
+					PProactorNode node = proactorWorkerFind(worker, job->fd);
+
+					metricAdd(&worker->stats.zc_copied, job->copied);
+
+					// The file descriptor might have been removed since, along with its sends.
+					if (node != NULL)
+						proactorNodeRelease(worker, node, job->seq);
+
+					break;
+				}
+
+				case PROACTOR_JOB_STOP:
+					running = false;
+					drain_deadline = proactorNow() + proactor->drain_timeout;
+					break;
 			}
+
+			unrefProactorMessage(job->message);
+			free(job);
+			job = next;
 		}
 
-		curr = curr->next;
+		// Whatever was queued before a stop job is flushed before the worker stops.
+		if (worker->dirty_head != NULL && (!running || worker->batch_full || proactorNow() >= worker->flush_deadline))
+			proactorWorkerFlush(proactor, worker);
 	}
 
-	proactor->isRunning = false;
+	if (proactorWorkerBacklogged(worker))
+		logWrite(LOG_LEVEL_WARNING, "Proactor worker stopped with undelivered data, some clients didn't drain in time.\n");
+
+	return proactor;
+}
+
+void *createProactor() {
+	size_t workers = PROACTOR_WORKERS, threshold = PROACTOR_ZEROCOPY_THRESHOLD;
+	char *env = getenv("PROACTOR_WORKERS");
+
+	if (env != NULL)
+		workers = (size_t)strtoul(env, NULL, 10);
 
-	fprintf(stderr, "%s Proactor finished running, total file descriptors: %d\n", C_PREFIX_INFO, proactor->size);
+	if ((env = getenv("PROACTOR_ZEROCOPY_THRESHOLD")) != NULL)
+		threshold = (size_t)strtoul(env, NULL, 10);
 
-	pthread_exit(proactor);
+	void *proactor = createProactorPool(workers);
 
-	return NULL;
+	if (proactor != NULL)
+		setProactorZeroCopy(proactor, threshold);
+
+	return proactor;
 }
 
-void *createProactor() {
+void *createProactorPool(size_t workers) {
 	fprintf(stderr, "%s Creating proactor...\n", C_PREFIX_INFO);
 
+	if (workers == 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		workers = (cpus > 0) ? (size_t)cpus : 1;
+	}
+
 	PProactor proactor = (PProactor) malloc(sizeof(Proactor));
 
 	if (proactor == NULL)
@@ -80,12 +1064,88 @@ void *createProactor() {
 		return NULL;
 	}
 
-	proactor->thread = 0;
-	proactor->head = NULL;
-	proactor->isRunning = false;
+	// The workers' counters are aligned to a cache line, so the array must be too.
+	proactor->workers = (PProactorWorker) aligned_alloc(CACHE_LINE_SIZE, workers * sizeof(ProactorWorker));
+
+	if (proactor->workers == NULL)
+	{
+		fprintf(stderr, "%s createProactor() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		free(proactor);
+		return NULL;
+	}
+
+	memset(proactor->workers, 0, workers * sizeof(ProactorWorker));
+
+	proactor->worker_count = 0;
+	atomic_init(&proactor->isRunning, false);
 	proactor->size = 0;
+	proactor->zerocopy_threshold = 0;
+	proactor->drain_timeout = 0;
+
+	for (size_t i = 0; i < workers; ++i)
+	{
+		PProactorWorker worker = (proactor->workers + i);
+
+		worker->proactor = proactor;
+		worker->head = NULL;
+		worker->table = NULL;
+		worker->table_size = 0;
+		worker->queue_head = NULL;
+		worker->queue_tail = NULL;
+		worker->queue_woken = false;
+		worker->current = NULL;
+		worker->dirty_head = NULL;
+		worker->slabs = NULL;
+		worker->free_nodes = NULL;
+		worker->flush_deadline = 0;
+		worker->batch_full = false;
+		metricSet(&worker->stats.writes, 0);
+		metricSet(&worker->stats.bytes_sent, 0);
+		metricSet(&worker->stats.dropped, 0);
+		metricSet(&worker->stats.zc_sends, 0);
+		metricSet(&worker->stats.zc_completed, 0);
+		metricSet(&worker->stats.zc_copied, 0);
+		metricSet(&worker->stats.queued_bytes, 0);
+		metricSet(&worker->stats.queued_jobs, 0);
+		metricSet(&worker->stats.nodes_live, 0);
+		metricSet(&worker->stats.nodes_free, 0);
+		worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+		struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+		int ret = 0;
+
+		if (worker->wake_fd < 0 || worker->epoll_fd < 0 || epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &event) < 0)
+			ret = errno;
+
+		pthread_mutex_init(&worker->lock, NULL);
+
+		proactor->worker_count++;
+
+		if (ret == 0)
+			ret = pthread_create(&worker->thread, NULL, proactorRunFunction, worker);
+
+		if (ret != 0)
+		{
+			fprintf(stderr, "%s Creating proactor worker failed: %s\n", C_PREFIX_ERROR, strerror(ret));
+			pthread_mutex_destroy(&worker->lock);
+
+			if (worker->wake_fd >= 0)
+				close(worker->wake_fd);
+
+			if (worker->epoll_fd >= 0)
+				close(worker->epoll_fd);
+
+			proactor->worker_count--;
+			atomic_store_explicit(&proactor->isRunning, (proactor->worker_count > 0), memory_order_release);
+			destroyProactor(proactor);
+			return NULL;
+		}
+	}
+
+	atomic_store_explicit(&proactor->isRunning, true, memory_order_release);
 
-	fprintf(stderr, "%s Proactor created successfully\n", C_PREFIX_INFO);
+	fprintf(stderr, "%s Proactor created successfully, running %zu worker(s)\n", C_PREFIX_INFO, proactor->worker_count);
 
 	return proactor;
 }
@@ -100,60 +1160,66 @@ int runProactor(void *this) {
 
 	PProactor proactor = (PProactor)this;
 
-	if (proactor->head == NULL)
+	if (!atomic_load_explicit(&proactor->isRunning, memory_order_acquire))
 	{
-		errno = EINVAL;
-		fprintf(stderr, "%s Tried to start a proactor without registered file descriptors.\n", C_PREFIX_WARNING);
-		return 1;
-	}
-
-	else if (proactor->isRunning)
-	{
-		errno = EAGAIN;
-		fprintf(stderr, "%s Tried to start a proactor that's already running.\n", C_PREFIX_WARNING);
+		errno = ESRCH;
+		fprintf(stderr, "%s Tried to run a proactor that was cancelled.\n", C_PREFIX_WARNING);
 		return 1;
 	}
 
-	proactor->isRunning = true;
-
-	if (pthread_create(&proactor->thread, NULL, proactorRunFunction, proactor) != 0)
+	for (size_t i = 0; i < proactor->worker_count; ++i)
 	{
-		proactor->isRunning = false;
-		fprintf(stderr, "%s runProactor() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		return 1;
+		if (proactorEnqueue((proactor->workers + i), PROACTOR_JOB_RUN, -1, NULL, NULL) != 0)
+			return 1;
 	}
 
 	return 0;
 }
 
 int cancelProactor(void *this) {
+	return drainProactor(this, 0);
+}
+
+int drainProactor(void *this, unsigned int timeout) {
 	if (this == NULL)
 	{
 		errno = EINVAL;
-		fprintf(stderr, "%s cancelProactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		fprintf(stderr, "%s drainProactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
 		return 1;
 	}
 
 	PProactor proactor = (PProactor)this;
 
-	if (!proactor->isRunning)
+	if (!atomic_load_explicit(&proactor->isRunning, memory_order_acquire))
 	{
 		fprintf(stderr, "%s Tried to stop a proactor that's not currently running.\n", C_PREFIX_WARNING);
 		return 1;
 	}
 
-	fprintf(stdout, "%s Stopping proactor thread gracefully...\n", C_PREFIX_INFO);
+	fprintf(stdout, "%s Stopping proactor workers gracefully...\n", C_PREFIX_INFO);
+
+	atomic_store_explicit(&proactor->isRunning, false, memory_order_release);
+
+	// The workers read it when they take the stop job, which the queue's lock publishes.
+	proactor->drain_timeout = timeout;
+
+	// Every worker finishes the jobs that were enqueued before the stop job.
+	for (size_t i = 0; i < proactor->worker_count; ++i)
+	{
+		PProactorWorker worker = (proactor->workers + i);
 
-	proactor->isRunning = false;
+		while (proactorEnqueue(worker, PROACTOR_JOB_STOP, -1, NULL, NULL) != 0)
+			sched_yield();
+	}
 
-	pthread_cancel(proactor->thread);
-	pthread_join(proactor->thread, NULL);
+	for (size_t i = 0; i < proactor->worker_count; ++i)
+		pthread_join((proactor->workers + i)->thread, NULL);
 
 	return 0;
 }
 
 int addFD2Proactor(void *this, int fd, handler_t handler) {
-	if (this == NULL)
+	if (this == NULL || fd < 0)
 	{
 		errno = EINVAL;
 		fprintf(stderr, "%s addFD2Proactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
@@ -162,40 +1228,82 @@ int addFD2Proactor(void *this, int fd, handler_t handler) {
 
 	PProactor proactor = (PProactor)this;
 
-	PProactorNode node = (PProactorNode) malloc(sizeof(ProactorNode));
-
-	if (node == NULL)
+	if (proactorEnqueue(proactorWorkerOf(proactor, fd), PROACTOR_JOB_ADD, fd, handler, NULL) != 0)
 	{
 		fprintf(stderr, "%s addFD2Proactor() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
 		return 1;
 	}
 
-	node->fd = fd;
-	node->hdlr.handler = handler;
-	node->next = NULL;
-	
-	if (proactor->head == NULL)
-		proactor->head = node;
+	union _hdlr_func_union_proactor hdlr = { .handler = handler };
 
-	else
-	{
-		PProactorNode curr = proactor->head;
+	logWrite(LOG_LEVEL_INFO, "Successfuly added file descriptor %d to the list of proactor, function handler address: %p.\n", fd, hdlr.handler_ptr);
 
-		while (curr->next != NULL)
-			curr = curr->next;
+	return 0;
+}
 
-		curr->next = node;
+int addFDs2Proactor(void *this, const int *fds, size_t count, handler_t handler) {
+	if (this == NULL || (fds == NULL && count > 0))
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s addFDs2Proactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return 1;
 	}
 
-	proactor->size++;
+	PProactor proactor = (PProactor)this;
+	union _hdlr_func_union_proactor hdlr = { .handler = handler };
+	int ret = 0;
 
-	fprintf(stdout, "%s Successfuly added file descriptor %d to the list of proactor, function handler address: %p.\n", C_PREFIX_INFO, fd, node->hdlr.handler_ptr);
+	// Every worker gets its share of the batch as a single chain - one lock and at most one wakeup per worker.
+	for (size_t w = 0; w < proactor->worker_count; ++w)
+	{
+		PProactorWorker worker = (proactor->workers + w);
+		PProactorJob head = NULL, tail = NULL;
+		size_t jobs = 0;
 
-	return 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			int fd = *(fds + i);
+
+			if (fd < 0 || proactorWorkerOf(proactor, fd) != worker)
+				continue;
+
+			PProactorJob job = (PProactorJob) malloc(sizeof(ProactorJob));
+
+			if (job == NULL)
+			{
+				fprintf(stderr, "%s addFDs2Proactor() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+				ret = 1;
+				break;
+			}
+
+			job->type = PROACTOR_JOB_ADD;
+			job->fd = fd;
+			job->handler = handler;
+			job->message = NULL;
+			job->seq = job->copied = 0;
+			job->next = NULL;
+
+			if (tail == NULL)
+				head = job;
+
+			else
+				tail->next = job;
+
+			tail = job;
+			jobs++;
+
+			logWrite(LOG_LEVEL_INFO, "Successfuly added file descriptor %d to the list of proactor, function handler address: %p.\n", fd, hdlr.handler_ptr);
+		}
+
+		if (head != NULL)
+			proactorEnqueueChain(worker, head, tail, jobs);
+	}
+
+	return ret;
 }
 
 int removeHandler(void *this, int fd) {
-	if (this == NULL)
+	if (this == NULL || fd < 0)
 	{
 		errno = EINVAL;
 		fprintf(stderr, "%s removeHandler() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
@@ -204,42 +1312,281 @@ int removeHandler(void *this, int fd) {
 
 	PProactor proactor = (PProactor)this;
 
-	if (proactor->head == NULL)
+	if (proactorEnqueue(proactorWorkerOf(proactor, fd), PROACTOR_JOB_REMOVE, fd, NULL, NULL) != 0)
 	{
-		fprintf(stderr, "%s removeHandler() failed: %s\n", C_PREFIX_ERROR, strerror(ENOENT));
+		fprintf(stderr, "%s removeHandler() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
 		return 1;
 	}
 
-	PProactorNode curr = proactor->head;
+	return 0;
+}
 
-	if (curr->fd == fd)
+int closeHandler(void *this, int fd) {
+	if (this == NULL || fd < 0)
 	{
-		proactor->head = curr->next;
-		free(curr);
+		errno = EINVAL;
+		fprintf(stderr, "%s closeHandler() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return 1;
+	}
 
-		proactor->size--;
+	PProactor proactor = (PProactor)this;
 
-		return 0;
+	if (proactorEnqueue(proactorWorkerOf(proactor, fd), PROACTOR_JOB_CLOSE, fd, NULL, NULL) != 0)
+	{
+		fprintf(stderr, "%s closeHandler() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return 1;
+	}
+
+	return 0;
+}
+
+ssize_t sendProactor(void *this, int fd, const void *buf, size_t len) {
+	if (this == NULL || fd < 0 || (buf == NULL && len > 0))
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s sendProactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return -1;
 	}
 
-	while (curr->next != NULL)
+	PProactor proactor = (PProactor)this;
+	PProactorWorker worker = proactorWorkerOf(proactor, fd);
+
+	// Called from a handler on the file descriptor's own worker, so the node can be used directly.
+	if (pthread_equal(pthread_self(), worker->thread))
 	{
-		if (curr->next->fd == fd)
+		PProactorNode node = proactorWorkerFind(worker, fd);
+
+		if (node == NULL)
 		{
-			PProactorNode tmp = curr->next;
-			curr->next = curr->next->next;
-			free(tmp);
+			errno = ENOENT;
+			return -1;
+		}
+
+		return proactorNodeQueue(worker, node, buf, len, NULL);
+	}
+
+	PProactorMessage message = createProactorMessage(buf, len);
+
+	if (message == NULL)
+		return -1;
+
+	if (proactorEnqueue(worker, PROACTOR_JOB_SEND, fd, NULL, message) != 0)
+	{
+		unrefProactorMessage(message);
+		return -1;
+	}
 
-			proactor->size--;
+	return (ssize_t)len;
+}
+
+/*
+ * @brief Enqueue a broadcast job to every worker of a proactor.
+ * @param proactor A pointer to the proactor.
+ * @param message The message to send, every job takes its own reference to it.
+ * @param except A file descriptor that doesn't get the message, or -1.
+ * @return 0 on success, 1 on failure.
+*/
+static int proactorBroadcast(PProactor proactor, PProactorMessage message, int except) {
+	if (!atomic_load_explicit(&proactor->isRunning, memory_order_acquire))
+	{
+		errno = ESRCH;
+		fprintf(stderr, "%s Tried to broadcast on a proactor that was cancelled.\n", C_PREFIX_WARNING);
+		return 1;
+	}
 
-			return 0;
+	for (size_t i = 0; i < proactor->worker_count; ++i)
+	{
+		if (proactorEnqueue((proactor->workers + i), PROACTOR_JOB_BROADCAST, except, NULL, refProactorMessage(message)) != 0)
+		{
+			unrefProactorMessage(message);
+			return 1;
 		}
+	}
+
+	return 0;
+}
+
+int broadcastProactor(void *this, PProactorMessage message) {
+	if (this == NULL || message == NULL)
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s broadcastProactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return 1;
+	}
+
+	return proactorBroadcast((PProactor)this, message, -1);
+}
+
+int relayProactor(void *this, PProactorMessage message, int sender) {
+	if (this == NULL || message == NULL || sender < 0)
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s relayProactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return 1;
+	}
+
+	return proactorBroadcast((PProactor)this, message, sender);
+}
+
+int setProactorZeroCopy(void *this, size_t threshold) {
+	if (this == NULL)
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s setProactorZeroCopy() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return 1;
+	}
+
+	PProactor proactor = (PProactor)this;
+
+	proactor->zerocopy_threshold = threshold;
+
+	if (threshold > 0)
+		fprintf(stderr, "%s Proactor sends messages of %zu bytes or more with MSG_ZEROCOPY\n", C_PREFIX_INFO, threshold);
+
+	return 0;
+}
+
+int completeProactorZeroCopy(void *this, int fd) {
+	if (this == NULL || fd < 0)
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s completeProactorZeroCopy() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return 1;
+	}
+
+	PProactor proactor = (PProactor)this;
+	uint32_t seq = 0, copied = 0;
+
+	if (!proactorReadCompletions(fd, &seq, &copied))
+		return 0;
+
+	PProactorJob job = (PProactorJob) malloc(sizeof(ProactorJob));
+
+	if (job == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return 1;
+	}
+
+	job->type = PROACTOR_JOB_COMPLETE;
+	job->fd = fd;
+	job->handler = NULL;
+	job->message = NULL;
+	job->seq = seq;
+	job->copied = copied;
+	job->next = NULL;
+
+	proactorEnqueueChain(proactorWorkerOf(proactor, fd), job, job, 1);
+
+	return 0;
+}
+
+int getProactorStats(void *this, PProactorStats stats) {
+	if (this == NULL || stats == NULL)
+	{
+		errno = EINVAL;
+		return 1;
+	}
 
-		curr = curr->next;
+	PProactor proactor = (PProactor)this;
+
+	memset(stats, 0, sizeof(ProactorStats));
+
+	for (size_t i = 0; i < proactor->worker_count; ++i)
+		proactorStatsAdd(stats, (proactor->workers + i));
+
+	return 0;
+}
+
+int getProactorWorkerStats(void *this, size_t worker, PProactorStats stats) {
+	if (this == NULL || stats == NULL || worker >= ((PProactor)this)->worker_count)
+	{
+		errno = EINVAL;
+		return 1;
+	}
+
+	memset(stats, 0, sizeof(ProactorStats));
+	proactorStatsAdd(stats, (((PProactor)this)->workers + worker));
+
+	return 0;
+}
+
+size_t getProactorWorkerCount(void *this) {
+	return (this == NULL) ? 0 : ((PProactor)this)->worker_count;
+}
+
+bool isProactorRunning(void *this) {
+	return (this != NULL && atomic_load_explicit(&((PProactor)this)->isRunning, memory_order_acquire));
+}
+
+#if LATENCY_HISTOGRAMS
+int getProactorLatency(void *this, histogram_snapshot_t_ptr fanout, histogram_snapshot_t_ptr send) {
+	if (this == NULL || fanout == NULL || send == NULL)
+	{
+		errno = EINVAL;
+		return 1;
+	}
+
+	PProactor proactor = (PProactor)this;
+
+	for (size_t i = 0; i < proactor->worker_count; ++i)
+	{
+		histogramMerge(fanout, &(proactor->workers + i)->stats.fanout_latency);
+		histogramMerge(send, &(proactor->workers + i)->stats.send_latency);
+	}
+
+	return 0;
+}
+#endif
+
+PProactorMessage allocProactorMessage(size_t length) {
+	PProactorMessage message = (PProactorMessage) malloc(sizeof(ProactorMessage) + length);
+
+	if (message == NULL)
+	{
+		fprintf(stderr, "%s allocProactorMessage() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return NULL;
+	}
+
+	atomic_init(&message->refs, 1);
+	message->length = length;
+
+#if LATENCY_HISTOGRAMS
+	message->created = histogramClock();
+#endif
+
+	return message;
+}
+
+PProactorMessage createProactorMessage(const void *data, size_t length) {
+	if (data == NULL && length > 0)
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s createProactorMessage() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return NULL;
 	}
 
-	fprintf(stderr, "%s removeHandler() failed: %s\n", C_PREFIX_ERROR, strerror(ENOENT));
-	return 1;
+	PProactorMessage message = allocProactorMessage(length);
+
+	if (message != NULL && length > 0)
+		memcpy(message->data, data, length);
+
+	return message;
+}
+
+PProactorMessage refProactorMessage(PProactorMessage message) {
+	atomic_fetch_add_explicit(&message->refs, 1, memory_order_relaxed);
+
+	return message;
+}
+
+void unrefProactorMessage(PProactorMessage message) {
+	if (message == NULL)
+		return;
+
+	// The last reference frees the message, after every other holder is done reading it.
+	if (atomic_fetch_sub_explicit(&message->refs, 1, memory_order_acq_rel) == 1)
+		free(message);
 }
 
 int destroyProactor(void *this) {
@@ -253,21 +1600,51 @@ int destroyProactor(void *this) {
 	PProactor proactor = (PProactor)this;
 
 	// Stop the proactor if it's running
-	if (proactor->isRunning)
+	if (atomic_load_explicit(&proactor->isRunning, memory_order_acquire))
 		cancelProactor(proactor);
 
-	if (proactor->head != NULL)
+	for (size_t i = 0; i < proactor->worker_count; ++i)
 	{
-		PProactorNode curr = proactor->head;
+		PProactorWorker worker = (proactor->workers + i);
+		PProactorNode curr = worker->head;
 
 		while (curr != NULL)
 		{
 			PProactorNode tmp = curr;
 			curr = curr->next;
+			proactorNodeFree(worker, tmp);
+		}
+
+		while (worker->slabs != NULL)
+		{
+			PProactorSlab slab = worker->slabs;
+			worker->slabs = slab->next;
+			free(slab);
+		}
+
+		free(worker->table);
+
+		PProactorJob job = worker->queue_head;
+
+		while (job != NULL)
+		{
+			PProactorJob tmp = job;
+			job = job->next;
+
+			// The worker is gone, so nothing uses the file descriptor anymore.
+			if (tmp->type == PROACTOR_JOB_CLOSE)
+				close(tmp->fd);
+
+			unrefProactorMessage(tmp->message);
 			free(tmp);
 		}
+
+		pthread_mutex_destroy(&worker->lock);
+		close(worker->wake_fd);
+		close(worker->epoll_fd);
 	}
 
+	free(proactor->workers);
 	free(proactor);
 
 	fprintf(stdout, "%s Successfuly destroyed proactor.\n", C_PREFIX_INFO);
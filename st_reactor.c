@@ -17,14 +17,1761 @@
 */
 
 #include "reactor.h"
+#include "logger.h"
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
+#include <linux/io_uring.h>
+
+/*
+ * @brief Make sure the handler table can hold count more entries, and the slots array
+ * 			can map the given file descriptor.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The largest file descriptor that's about to be added.
+ * @param count The number of file descriptors that are about to be added.
+ * @return 0 on success, -1 on failure.
+ * @note Both arrays grow geometrically, so the amortized cost of an addition is O(1).
+*/
+static int reactorReserve(reactor_t_ptr reactor, int fd, size_t count) {
+	if (reactor->size + count > reactor->capacity)
+	{
+		size_t capacity = (reactor->capacity == 0) ? REACTOR_INITIAL_CAPACITY : reactor->capacity * 2;
+
+		while (capacity < reactor->size + count)
+			capacity *= 2;
+		reactor_node_ptr nodes = (reactor_node_ptr)realloc(reactor->nodes, capacity * sizeof(reactor_node));
+
+		if (nodes == NULL)
+			return -1;
+
+		reactor->nodes = nodes;
+
+		pollfd_t_ptr fds = (pollfd_t_ptr)realloc(reactor->fds, capacity * sizeof(pollfd_t));
+
+		if (fds == NULL)
+			return -1;
+
+		reactor->fds = fds;
+		reactor->capacity = capacity;
+	}
+
+	if ((size_t)fd >= reactor->slots_size)
+	{
+		size_t slots_size = (reactor->slots_size == 0) ? REACTOR_INITIAL_CAPACITY : reactor->slots_size;
+
+		while (slots_size <= (size_t)fd)
+			slots_size *= 2;
+
+		int *slots = (int *)realloc(reactor->slots, slots_size * sizeof(int));
+
+		if (slots == NULL)
+			return -1;
+
+		for (size_t i = reactor->slots_size; i < slots_size; ++i)
+			*(slots + i) = -1;
+
+		reactor->slots = slots;
+		reactor->slots_size = slots_size;
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Find the index of a file descriptor in the handler table.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @return The index of the file descriptor, or -1 if it's not registered.
+*/
+static inline int reactorSlotOf(reactor_t_ptr reactor, int fd) {
+	if (fd < 0 || (size_t)fd >= reactor->slots_size)
+		return -1;
+
+	return *(reactor->slots + fd);
+}
+
+/*
+ * @brief The multishot requests the io_uring backend arms, encoded in the top byte of the user data.
+*/
+enum
+{
+	REACTOR_URING_ACCEPT = 1,
+	REACTOR_URING_RECV,
+	REACTOR_URING_POLL,
+	REACTOR_URING_CANCEL
+};
+
+/*
+ * @brief The io_uring state of a reactor - the mapped rings and the provided buffers.
+*/
+struct _reactor_uring
+{
+	// The io_uring instance file descriptor.
+	int ring_fd;
+
+	// The features the kernel reported in io_uring_setup().
+	unsigned int features;
+
+	// The mapped submission queue ring, and its size.
+	void *sq_ptr;
+	size_t sq_size;
+
+	// The mapped completion queue ring, and its size (it might share the submission queue mapping).
+	void *cq_ptr;
+	size_t cq_size;
+
+	// The mapped submission queue entries array, and its size.
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	// Pointers into the submission queue ring.
+	unsigned int *sq_head, *sq_tail, *sq_mask, *sq_entries, *sq_array;
+
+	// Pointers into the completion queue ring.
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	// The local submission queue tail, published to the kernel in the next io_uring_enter().
+	unsigned int sq_local_tail;
+
+	// The number of prepared entries that weren't submitted yet.
+	unsigned int to_submit;
+
+	// The provided buffers ring (buffer group 0), and its size.
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+
+	// The provided buffers, REACTOR_URING_BUFFERS buffers of MAX_BUFFER bytes each.
+	char *buffers;
+
+	// The local provided buffers ring tail, published to the kernel once per iteration.
+	unsigned short buf_tail;
+
+	// The generation counter, incremented on every addFd().
+	unsigned int generation;
+
+	// The file descriptor whose completion is being dispatched, or -1.
+	int pending_fd;
+
+	// The result of the completion being dispatched (bytes received, accepted fd, or -errno).
+	int pending_res;
+
+	// The received data of the completion being dispatched, and how much of it was consumed.
+	char *pending_data;
+	size_t pending_off;
+};
+
+/*
+ * @brief Encode the user data of a multishot request.
+ * @param request The request type.
+ * @param generation The registration's generation.
+ * @param fd The file descriptor.
+ * @return The user data.
+*/
+static inline uint64_t reactorUringData(unsigned int request, unsigned int generation, int fd) {
+	return ((uint64_t)request << 56) | ((uint64_t)(generation & 0xFFFFFF) << 32) | (uint32_t)fd;
+}
+
+/*
+ * @brief Submit the prepared entries, and optionally wait for completions.
+ * @param uring A pointer to the io_uring state.
+ * @param wait Whether to wait for at least one completion.
+ * @param timeout The wait timeout in milliseconds, -1 to wait forever.
+ * @return The number of submitted entries, or -errno on failure.
+*/
+static int reactorUringEnter(reactor_uring_t_ptr uring, bool wait, int timeout) {
+	struct __kernel_timespec ts = { .tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000L };
+	struct io_uring_getevents_arg arg = { .ts = (uint64_t)(uintptr_t)&ts };
+	unsigned int flags = wait ? IORING_ENTER_GETEVENTS : 0;
+	void *argp = NULL;
+	size_t argsz = 0;
+
+	if (wait && timeout >= 0)
+	{
+		flags |= IORING_ENTER_EXT_ARG;
+		argp = &arg;
+		argsz = sizeof(arg);
+	}
+
+	__atomic_store_n(uring->sq_tail, uring->sq_local_tail, __ATOMIC_RELEASE);
+
+	int ret = (int)syscall(__NR_io_uring_enter, uring->ring_fd, uring->to_submit, wait ? 1 : 0, flags, argp, argsz);
+
+	if (ret < 0)
+		return -errno;
+
+	uring->to_submit -= ((unsigned int)ret > uring->to_submit) ? uring->to_submit : (unsigned int)ret;
+
+	return ret;
+}
+
+/*
+ * @brief Get a free submission queue entry.
+ * @param uring A pointer to the io_uring state.
+ * @return A pointer to a zeroed entry, or NULL if the submission queue is full.
+ * @note A full submission queue is flushed to the kernel first, without waiting.
+*/
+static struct io_uring_sqe *reactorUringGetSqe(reactor_uring_t_ptr uring) {
+	unsigned int head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+
+	if (uring->sq_local_tail - head >= *uring->sq_entries)
+	{
+		if (reactorUringEnter(uring, false, -1) < 0)
+			return NULL;
+
+		head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+
+		if (uring->sq_local_tail - head >= *uring->sq_entries)
+			return NULL;
+	}
+
+	unsigned int index = uring->sq_local_tail & *uring->sq_mask;
+	struct io_uring_sqe *sqe = (uring->sqes + index);
+
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	*(uring->sq_array + index) = index;
+
+	uring->sq_local_tail++;
+	uring->to_submit++;
+
+	return sqe;
+}
+
+/*
+ * @brief Give a provided buffer back to the kernel.
+ * @param uring A pointer to the io_uring state.
+ * @param bid The buffer ID.
+ * @return void
+ * @note The new ring tail is published once per iteration, in reactorRunUring().
+*/
+static void reactorUringRecycle(reactor_uring_t_ptr uring, unsigned short bid) {
+	struct io_uring_buf *buf = (uring->buf_ring->bufs + (uring->buf_tail & (REACTOR_URING_BUFFERS - 1)));
+
+	buf->addr = (uint64_t)(uintptr_t)(uring->buffers + (size_t)bid * MAX_BUFFER);
+	buf->len = MAX_BUFFER;
+	buf->bid = bid;
+
+	uring->buf_tail++;
+}
+
+/*
+ * @brief Arm the multishot request of a registered file descriptor.
+ * @param reactor A pointer to the reactor object.
+ * @param node A pointer to the file descriptor's handler table entry.
+ * @return 0 on success, -1 if the submission queue is full.
+*/
+static int reactorUringArm(reactor_t_ptr reactor, reactor_node_ptr node) {
+	struct io_uring_sqe *sqe = reactorUringGetSqe(reactor->uring);
+
+	if (sqe == NULL)
+		return -1;
+
+	sqe->fd = node->fd;
+	sqe->user_data = reactorUringData(node->request, node->generation, node->fd);
+
+	switch (node->request)
+	{
+		case REACTOR_URING_ACCEPT:
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->accept_flags = SOCK_CLOEXEC;
+			break;
+
+		case REACTOR_URING_RECV:
+			sqe->opcode = IORING_OP_RECV;
+			sqe->ioprio = IORING_RECV_MULTISHOT;
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = 0;
+			break;
+
+		default:
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->poll32_events = POLLIN;
+			sqe->len = IORING_POLL_ADD_MULTI;
+			break;
+	}
+
+	node->armed = true;
+
+	return 0;
+}
+
+/*
+ * @brief Cancel the multishot request of a file descriptor that's being removed.
+ * @param reactor A pointer to the reactor object.
+ * @param node A pointer to the file descriptor's handler table entry.
+ * @return void
+ * @note The request is matched by its user data, as the file descriptor might be closed already.
+*/
+static void reactorUringCancel(reactor_t_ptr reactor, reactor_node_ptr node) {
+	if (!node->armed)
+		return;
+
+	struct io_uring_sqe *sqe = reactorUringGetSqe(reactor->uring);
+
+	if (sqe == NULL)
+		return;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = reactorUringData(node->request, node->generation, node->fd);
+	sqe->user_data = reactorUringData(REACTOR_URING_CANCEL, 0, 0);
+
+	node->armed = false;
+}
+
+/*
+ * @brief Choose the multishot request for a file descriptor that's being added.
+ * @param fd The file descriptor.
+ * @return Accept for listening sockets, receive for other stream sockets, and poll for anything else.
+*/
+static unsigned char reactorUringRequestOf(int fd) {
+	int value = 0;
+	socklen_t len = sizeof(value);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &value, &len) == 0 && value)
+		return REACTOR_URING_ACCEPT;
+
+	len = sizeof(value);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &value, &len) == 0 && value == SOCK_STREAM)
+		return REACTOR_URING_RECV;
+
+	return REACTOR_URING_POLL;
+}
+
+/*
+ * @brief Release the io_uring state of a reactor.
+ * @param uring A pointer to the io_uring state, may be partially initialized.
+ * @return void
+*/
+static void reactorUringDestroy(reactor_uring_t_ptr uring) {
+	if (uring == NULL)
+		return;
+
+	if (uring->sqes != NULL && uring->sqes != MAP_FAILED)
+		munmap(uring->sqes, uring->sqes_size);
+
+	if (uring->cq_ptr != NULL && uring->cq_ptr != MAP_FAILED && uring->cq_ptr != uring->sq_ptr)
+		munmap(uring->cq_ptr, uring->cq_size);
+
+	if (uring->sq_ptr != NULL && uring->sq_ptr != MAP_FAILED)
+		munmap(uring->sq_ptr, uring->sq_size);
+
+	if (uring->buf_ring != NULL && uring->buf_ring != MAP_FAILED)
+		munmap(uring->buf_ring, uring->buf_ring_size);
+
+	if (uring->ring_fd >= 0)
+		close(uring->ring_fd);
+
+	free(uring->buffers);
+	free(uring);
+}
+
+/*
+ * @brief Check that the kernel supports multishot receives with provided buffers.
+ * @param uring A pointer to the io_uring state.
+ * @return 0 if it's supported, -errno otherwise.
+ * @note Multishot accept and provided buffer rings are older than multishot receive,
+ * 			so a single probe over a socket pair covers all of them.
+*/
+static int reactorUringProbe(reactor_uring_t_ptr uring) {
+	int pair[2], ret = 0;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0)
+		return -errno;
+
+	struct io_uring_sqe *sqe = reactorUringGetSqe(uring);
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = pair[0];
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = reactorUringData(REACTOR_URING_CANCEL, 0, 0);
+
+	if (write(pair[1], "", 1) != 1 || (ret = reactorUringEnter(uring, true, 1000)) < 0)
+		ret = (ret < 0) ? ret : -EIO;
+
+	else
+	{
+		unsigned int head = *uring->cq_head;
+		struct io_uring_cqe *cqe = (uring->cqes + (head & *uring->cq_mask));
+
+		if (head == __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+			ret = -ETIME;
+
+		else
+		{
+			ret = (cqe->res < 0) ? cqe->res : 0;
+
+			if (cqe->flags & IORING_CQE_F_BUFFER)
+				reactorUringRecycle(uring, (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+
+			__atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	// Closing the socket pair ends the probe's multishot request, its completion is ignored later on.
+	close(pair[0]);
+	close(pair[1]);
+
+	__atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+
+	return ret;
+}
+
+/*
+ * @brief Set up the io_uring state of a reactor - the rings and the provided buffers.
+ * @return A pointer to the io_uring state, or NULL if io_uring isn't available (errno is set).
+*/
+static reactor_uring_t_ptr reactorUringCreate(void) {
+	struct io_uring_params params;
+	reactor_uring_t_ptr uring = (reactor_uring_t_ptr)calloc(1, sizeof(reactor_uring_t));
+
+	if (uring == NULL)
+		return NULL;
+
+	uring->ring_fd = -1;
+	uring->pending_fd = -1;
+
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = REACTOR_URING_ENTRIES * 4;
+
+	if ((uring->ring_fd = (int)syscall(__NR_io_uring_setup, REACTOR_URING_ENTRIES, &params)) < 0)
+		goto fail;
+
+	uring->features = params.features;
+	uring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	uring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (uring->features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if (uring->cq_size > uring->sq_size)
+			uring->sq_size = uring->cq_size;
+
+		uring->cq_size = uring->sq_size;
+	}
+
+	uring->sq_ptr = mmap(NULL, uring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+
+	if (uring->sq_ptr == MAP_FAILED)
+		goto fail;
+
+	if (uring->features & IORING_FEAT_SINGLE_MMAP)
+		uring->cq_ptr = uring->sq_ptr;
+
+	else if ((uring->cq_ptr = mmap(NULL, uring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+		goto fail;
+
+	uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = (struct io_uring_sqe *)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+
+	if (uring->sqes == MAP_FAILED)
+		goto fail;
+
+	uring->sq_head = (unsigned int *)((char *)uring->sq_ptr + params.sq_off.head);
+	uring->sq_tail = (unsigned int *)((char *)uring->sq_ptr + params.sq_off.tail);
+	uring->sq_mask = (unsigned int *)((char *)uring->sq_ptr + params.sq_off.ring_mask);
+	uring->sq_entries = (unsigned int *)((char *)uring->sq_ptr + params.sq_off.ring_entries);
+	uring->sq_array = (unsigned int *)((char *)uring->sq_ptr + params.sq_off.array);
+	uring->sq_local_tail = *uring->sq_tail;
+
+	uring->cq_head = (unsigned int *)((char *)uring->cq_ptr + params.cq_off.head);
+	uring->cq_tail = (unsigned int *)((char *)uring->cq_ptr + params.cq_off.tail);
+	uring->cq_mask = (unsigned int *)((char *)uring->cq_ptr + params.cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *)((char *)uring->cq_ptr + params.cq_off.cqes);
+
+	// The provided buffers ring must be page aligned, so it's mapped rather than allocated.
+	uring->buf_ring_size = REACTOR_URING_BUFFERS * sizeof(struct io_uring_buf);
+	uring->buf_ring = (struct io_uring_buf_ring *)mmap(NULL, uring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (uring->buf_ring == MAP_FAILED)
+		goto fail;
+
+	if ((uring->buffers = (char *)malloc((size_t)REACTOR_URING_BUFFERS * MAX_BUFFER)) == NULL)
+		goto fail;
+
+	struct io_uring_buf_reg reg = {
+		.ring_addr = (uint64_t)(uintptr_t)uring->buf_ring,
+		.ring_entries = REACTOR_URING_BUFFERS,
+		.bgid = 0
+	};
+
+	if (syscall(__NR_io_uring_register, uring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		goto fail;
+
+	for (unsigned int i = 0; i < REACTOR_URING_BUFFERS; ++i)
+		reactorUringRecycle(uring, (unsigned short)i);
+
+	__atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+
+	int ret = reactorUringProbe(uring);
+
+	if (ret < 0)
+	{
+		errno = -ret;
+		goto fail;
+	}
+
+	return uring;
+
+fail:
+	{
+		int saved_errno = errno;
+		reactorUringDestroy(uring);
+		errno = saved_errno;
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief Initialize a reactor's receive buffer pool - the size classes only, the arena is mapped on first use.
+ * @param pool A pointer to the buffer pool.
+ * @return void
+*/
+static void reactorBufferPoolInit(reactor_buffer_pool_t_ptr pool) {
+	size_t offset = 0;
+
+	memset(pool, 0, sizeof(reactor_buffer_pool_t));
+
+	for (size_t i = 0; i < REACTOR_BUFFER_CLASSES; ++i)
+	{
+		reactor_buffer_class_t_ptr class = (pool->classes + i);
+
+		class->size = (size_t)REACTOR_BUFFER_MIN_SIZE << i;
+		class->offset = offset;
+		offset += class->size * REACTOR_BUFFER_COUNT;
+	}
+
+	pool->arena_size = offset;
+}
+
+/*
+ * @brief Map a buffer pool's arena and thread every size class's buffers onto its free list.
+ * @param pool A pointer to the buffer pool.
+ * @return 0 on success, -1 on failure (errno is set).
+ * @note With REACTOR_BUFFER_HUGEPAGES, the arena is rounded up to whole huge pages and mapped with MAP_HUGETLB,
+ * 			and if no huge pages are reserved, it's mapped with regular pages and MADV_HUGEPAGE instead.
+*/
+static int reactorBufferPoolMap(reactor_buffer_pool_t_ptr pool) {
+	void *arena = MAP_FAILED;
+
+	if (REACTOR_BUFFER_HUGEPAGES)
+	{
+		size_t huge_size = (pool->arena_size + (2 * 1024 * 1024) - 1) & ~(size_t)((2 * 1024 * 1024) - 1);
+
+		if ((arena = mmap(NULL, huge_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) != MAP_FAILED)
+		{
+			pool->arena_size = huge_size;
+			pool->hugepages = true;
+		}
+	}
+
+	if (arena == MAP_FAILED)
+	{
+		if ((arena = mmap(NULL, pool->arena_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+			return -1;
+
+		if (REACTOR_BUFFER_HUGEPAGES)
+			madvise(arena, pool->arena_size, MADV_HUGEPAGE);
+	}
+
+	pool->arena = (char *)arena;
+
+	for (size_t i = 0; i < REACTOR_BUFFER_CLASSES; ++i)
+	{
+		reactor_buffer_class_t_ptr class = (pool->classes + i);
+
+		// Pushed from the last buffer down, so the first requests get the lowest addresses.
+		for (size_t j = REACTOR_BUFFER_COUNT; j > 0; --j)
+		{
+			void *buf = pool->arena + class->offset + (j - 1) * class->size;
+
+			*(void **)buf = class->free_head;
+			class->free_head = buf;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Read the monotonic clock.
+ * @return The clock, in milliseconds.
+*/
+static uint64_t reactorClock(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+/*
+ * @brief Initialize an empty timing wheel, starting at the current tick.
+ * @param wheel A pointer to the timing wheel.
+ * @return void
+*/
+static void reactorTimerWheelInit(reactor_timer_wheel_t_ptr wheel) {
+	wheel->now = reactorClock();
+	wheel->tick = wheel->now / REACTOR_TIMER_TICK;
+	wheel->count = 0;
+
+	for (size_t i = 0; i < REACTOR_TIMER_LEVELS; ++i)
+		*(wheel->occupied + i) = 0;
+
+	for (size_t i = 0; i < REACTOR_TIMER_LEVELS * REACTOR_TIMER_SLOTS; ++i)
+		(wheel->slots + i)->next = (wheel->slots + i)->prev = (wheel->slots + i);
+}
+
+/*
+ * @brief Put an armed timer in its slot of the timing wheel.
+ * @param wheel A pointer to the timing wheel.
+ * @param timer A pointer to the timer, whose expiry tick is already set.
+ * @return void
+ * @note The level is picked by how far the expiry is, and the slot by the expiry's bits of that level,
+ * 			so the slot's time comes exactly when the timer should move down a level (or expire, on level 0).
+*/
+static void reactorTimerLink(reactor_timer_wheel_t_ptr wheel, reactor_timer_t_ptr timer) {
+	uint64_t delta = (timer->expires > wheel->tick) ? (timer->expires - wheel->tick) : 0;
+	uint64_t expires = timer->expires;
+	size_t level = 0;
+
+	while (level < REACTOR_TIMER_LEVELS - 1 && delta >= ((uint64_t)1 << (REACTOR_TIMER_BITS * (level + 1))))
+		level++;
+
+	// Beyond the wheel's range, the timer waits in the last level's farthest slot, and is put back there when it comes.
+	if (delta >= ((uint64_t)1 << (REACTOR_TIMER_BITS * REACTOR_TIMER_LEVELS)))
+		expires = wheel->tick + ((uint64_t)1 << (REACTOR_TIMER_BITS * REACTOR_TIMER_LEVELS)) - 1;
+
+	size_t slot = (size_t)((expires >> (REACTOR_TIMER_BITS * level)) & (REACTOR_TIMER_SLOTS - 1));
+	reactor_timer_link_t_ptr head = (wheel->slots + level * REACTOR_TIMER_SLOTS + slot);
+
+	timer->slot = (int)(level * REACTOR_TIMER_SLOTS + slot);
+	timer->link.next = head;
+	timer->link.prev = head->prev;
+	head->prev->next = &timer->link;
+	head->prev = &timer->link;
+
+	*(wheel->occupied + level) |= ((uint64_t)1 << slot);
+}
+
+/*
+ * @brief Take a timer out of its list.
+ * @param wheel A pointer to the timing wheel.
+ * @param timer A pointer to the timer.
+ * @return void
+ * @note A timer that's being expired is in a private list of the expiry pass, which has no bit to clear.
+*/
+static void reactorTimerUnlink(reactor_timer_wheel_t_ptr wheel, reactor_timer_t_ptr timer) {
+	timer->link.prev->next = timer->link.next;
+	timer->link.next->prev = timer->link.prev;
+
+	if (timer->slot >= 0)
+	{
+		reactor_timer_link_t_ptr head = (wheel->slots + timer->slot);
+
+		if (head->next == head)
+			*(wheel->occupied + timer->slot / REACTOR_TIMER_SLOTS) &= ~((uint64_t)1 << (timer->slot % REACTOR_TIMER_SLOTS));
+	}
+
+	timer->link.next = timer->link.prev = NULL;
+	timer->slot = -1;
+}
+
+/*
+ * @brief Move all the timers of a slot into a private list.
+ * @param wheel A pointer to the timing wheel.
+ * @param index The slot's index in the slots array.
+ * @param list The private list's head.
+ * @return void
+*/
+static void reactorTimerSplice(reactor_timer_wheel_t_ptr wheel, size_t index, reactor_timer_link_t_ptr list) {
+	reactor_timer_link_t_ptr head = (wheel->slots + index);
+
+	if (head->next == head)
+	{
+		list->next = list->prev = list;
+		return;
+	}
+
+	list->next = head->next;
+	list->prev = head->prev;
+	list->next->prev = list;
+	list->prev->next = list;
+	head->next = head->prev = head;
+
+	*(wheel->occupied + index / REACTOR_TIMER_SLOTS) &= ~((uint64_t)1 << (index % REACTOR_TIMER_SLOTS));
+
+	for (reactor_timer_link_t_ptr curr = list->next; curr != list; curr = curr->next)
+		((reactor_timer_t_ptr)curr)->slot = -1;
+}
+
+/*
+ * @brief Expire every timer whose tick has come, according to the reactor's clock.
+ * @param reactor A pointer to the reactor object.
+ * @return void
+ * @note Every tick first moves down the higher levels' slots whose time came (from the highest one),
+ * 			and then expires the level 0 slot of the tick.
+ * @note A periodic timer is re-armed before its handler is called, so the handler may cancel it.
+*/
+static void reactorTimersExpire(reactor_t_ptr reactor) {
+	reactor_timer_wheel_t_ptr wheel = &reactor->timers;
+	uint64_t target = wheel->now / REACTOR_TIMER_TICK;
+	reactor_timer_link_t list;
+
+	while (wheel->tick < target)
+	{
+		// Nothing is armed, so the wheel can jump right to the current tick.
+		if (wheel->count == 0)
+		{
+			wheel->tick = target;
+			break;
+		}
+
+		wheel->tick++;
+
+		for (size_t level = REACTOR_TIMER_LEVELS - 1; level > 0; --level)
+		{
+			if ((wheel->tick & (((uint64_t)1 << (REACTOR_TIMER_BITS * level)) - 1)) != 0)
+				continue;
+
+			reactorTimerSplice(wheel, level * REACTOR_TIMER_SLOTS + (size_t)((wheel->tick >> (REACTOR_TIMER_BITS * level)) & (REACTOR_TIMER_SLOTS - 1)), &list);
+
+			while (list.next != &list)
+			{
+				reactor_timer_t_ptr timer = (reactor_timer_t_ptr)list.next;
+
+				reactorTimerUnlink(wheel, timer);
+				reactorTimerLink(wheel, timer);
+			}
+		}
+
+		reactorTimerSplice(wheel, (size_t)(wheel->tick & (REACTOR_TIMER_SLOTS - 1)), &list);
+
+		// The handlers may cancel timers of the list, which simply takes them out of it.
+		while (list.next != &list)
+		{
+			reactor_timer_t_ptr timer = (reactor_timer_t_ptr)list.next;
+
+			reactorTimerUnlink(wheel, timer);
+
+			if (timer->period > 0)
+			{
+				timer->expires = wheel->tick + timer->period;
+				reactorTimerLink(wheel, timer);
+			}
+
+			else
+			{
+				timer->armed = false;
+				wheel->count--;
+			}
+
+			timer->handler(reactor, timer);
+		}
+	}
+}
+
+/*
+ * @brief Get the time until the timing wheel needs the reactor next.
+ * @param reactor A pointer to the reactor object.
+ * @return The time in milliseconds, or -1 if no timer is armed.
+ * @note The first non-empty slot of every level gives the tick in which it expires or moves down a level,
+ * 			which takes a single bit scan per level. The earliest of them is the wakeup time.
+*/
+static int reactorTimerTimeout(reactor_t_ptr reactor) {
+	reactor_timer_wheel_t_ptr wheel = &reactor->timers;
+	uint64_t next = UINT64_MAX;
+
+	if (wheel->count == 0)
+		return -1;
+
+	for (size_t level = 0; level < REACTOR_TIMER_LEVELS; ++level)
+	{
+		uint64_t bits = *(wheel->occupied + level);
+
+		if (bits == 0)
+			continue;
+
+		// The slots are scanned from the one after the current, all the way around to the current one.
+		uint64_t base = wheel->tick >> (REACTOR_TIMER_BITS * level);
+		unsigned int start = (unsigned int)((base + 1) & (REACTOR_TIMER_SLOTS - 1));
+		uint64_t rotated = (bits >> start) | (bits << ((REACTOR_TIMER_SLOTS - start) & (REACTOR_TIMER_SLOTS - 1)));
+		uint64_t tick = (base + 1 + (uint64_t)__builtin_ctzll(rotated)) << (REACTOR_TIMER_BITS * level);
+
+		if (tick < next)
+			next = tick;
+	}
+
+	uint64_t deadline = next * REACTOR_TIMER_TICK;
+
+	if (deadline <= wheel->now)
+		return 0;
+
+	return (deadline - wheel->now > INT_MAX) ? INT_MAX : (int)(deadline - wheel->now);
+}
+
+/*
+ * @brief Update the reactor's clocks once its wait returned.
+ * @param reactor A pointer to the reactor object.
+ * @return void
+ * @note With the latency histograms, the wakeup is timed in nanoseconds, and the timing wheel's clock is derived from it.
+*/
+static inline void reactorWokeUp(reactor_t_ptr reactor) {
+#if LATENCY_HISTOGRAMS
+	reactor->woke = histogramClock();
+	reactor->timers.now = reactor->woke / 1000000;
+#else
+	reactor->timers.now = reactorClock();
+#endif
+}
+
+/*
+ * @brief Call a file descriptor's handler.
+ * @param reactor A pointer to the reactor object.
+ * @param handler The handler.
+ * @param fd The file descriptor.
+ * @return The handler's return value.
+ * @note With the latency histograms, the time since the wakeup and the handler's own time are recorded.
+*/
+static inline void *reactorCall(reactor_t_ptr reactor, handler_t_reactor handler, int fd) {
+#if LATENCY_HISTOGRAMS
+	uint64_t start = histogramClock();
+
+	histogramRecord(&reactor->dispatch_latency, start - reactor->woke);
+
+	void *ret = handler(fd, reactor);
+
+	LATENCY_RECORD(&reactor->handler_latency, start);
+
+	return ret;
+#else
+	return handler(fd, reactor);
+#endif
+}
+
+/*
+ * @brief Get the timeout of the reactor's next wait.
+ * @param reactor A pointer to the reactor object.
+ * @return The timeout in milliseconds, or -1 to wait forever.
+ * @note The earlier of the reactor's poll timeout and the timing wheel's next expiry.
+*/
+static int reactorWaitTimeout(reactor_t_ptr reactor) {
+	int timeout = reactorTimerTimeout(reactor);
+
+	if (reactor->poll_timeout >= 0 && (timeout < 0 || reactor->poll_timeout < timeout))
+		timeout = reactor->poll_timeout;
+
+	return timeout;
+}
+
+/*
+ * @brief Unregister the file descriptor at the given index of the handler table.
+ * @param reactor A pointer to the reactor object.
+ * @param index The index of the file descriptor in the handler table.
+ * @return void
+ * @note The last entry is moved into the removed entry's place, with its pending revents.
+ * @note The file descriptor itself isn't closed, this is the handler's responsibility.
+*/
+static void reactorRemoveSlot(reactor_t_ptr reactor, size_t index) {
+	int fd = (*(reactor->nodes + index)).fd;
+	size_t last = reactor->size - 1;
+
+	// The handler might have closed the file descriptor already, which removes it from epoll as well,
+	// so the error is ignored and errno is preserved for the caller.
+	if (reactor->backend == REACTOR_BACKEND_EPOLL)
+	{
+		int saved_errno = errno;
+		epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+		errno = saved_errno;
+	}
+
+	else if (reactor->backend == REACTOR_BACKEND_URING)
+		reactorUringCancel(reactor, (reactor->nodes + index));
+
+	free((*(reactor->nodes + index)).overflow);
+
+	if (index != last)
+	{
+		*(reactor->nodes + index) = *(reactor->nodes + last);
+		*(reactor->fds + index) = *(reactor->fds + last);
+		*(reactor->slots + (*(reactor->nodes + index)).fd) = (int)index;
+	}
+
+	*(reactor->slots + fd) = -1;
+	reactor->size--;
+}
+
+/*
+ * @brief Check whether the reactor has a live thread.
+ * @param reactor A pointer to the reactor object.
+ * @return true from startReactor() until the thread was joined, false otherwise.
+*/
+static inline bool reactorHasThread(reactor_t_ptr reactor) {
+	return atomic_load_explicit(&reactor->has_thread, memory_order_acquire);
+}
+
+/*
+ * @brief Check whether the calling thread may change the reactor's tables directly.
+ * @param reactor A pointer to the reactor object.
+ * @return true on the reactor's own thread, or while the reactor has no thread, false otherwise.
+*/
+static inline bool reactorOwned(reactor_t_ptr reactor) {
+	return (!reactorHasThread(reactor) || pthread_equal(pthread_self(), reactor->thread));
+}
+
+/*
+ * @brief Wake the reactor up, if it's waiting for events.
+ * @param reactor A pointer to the reactor object.
+ * @return void
+*/
+static void reactorWake(reactor_t_ptr reactor) {
+	uint64_t one = 1;
+
+	while (write(reactor->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR);
+}
+
+/*
+ * @brief Register a file descriptor in the handler table, on the reactor's thread.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @param handler The file descriptor's handler.
+ * @return 0 on success, -1 on failure (errno is set).
+*/
+static int reactorAddSlot(reactor_t_ptr reactor, int fd, handler_t_reactor handler) {
+	logWrite(LOG_LEVEL_INFO, "Adding file descriptor %d to the list.\n", fd);
+
+	if (reactorSlotOf(reactor, fd) >= 0)
+	{
+		fprintf(stderr, "%s addFd() failed: %s\n", C_PREFIX_ERROR, strerror(EEXIST));
+		errno = EEXIST;
+		return -1;
+	}
+
+	if (reactorReserve(reactor, fd, 1) < 0)
+	{
+		fprintf(stderr, "%s realloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return -1;
+	}
+
+	if (reactor->backend == REACTOR_BACKEND_EPOLL)
+	{
+		epoll_event_t ev = { .events = (reactor->edge_triggered ? (EPOLLIN | EPOLLET) : EPOLLIN), .data.fd = fd };
+
+		if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			fprintf(stderr, "%s epoll_ctl() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			return -1;
+		}
+	}
+
+	size_t index = reactor->size;
+	reactor_node_ptr node = (reactor->nodes + index);
+
+	node->fd = fd;
+	node->hdlr.handler = handler;
+	node->generation = 0;
+	node->request = 0;
+	node->armed = false;
+	node->rescheduled = false;
+	node->overflow = NULL;
+	node->overflow_len = 0;
+	node->overflow_off = 0;
+	node->overflow_end = false;
+	node->overflow_res = 0;
+
+	if (reactor->backend == REACTOR_BACKEND_URING)
+	{
+		node->generation = (++reactor->uring->generation) & 0xFFFFFF;
+		node->request = reactorUringRequestOf(fd);
+
+		if (reactorUringArm(reactor, node) < 0)
+		{
+			fprintf(stderr, "%s addFd() failed: io_uring submission queue is full\n", C_PREFIX_ERROR);
+			errno = EBUSY;
+			return -1;
+		}
+	}
+
+	reactor->size++;
+
+	(*(reactor->fds + index)).fd = fd;
+	(*(reactor->fds + index)).events = POLLIN;
+	(*(reactor->fds + index)).revents = 0;
+
+	*(reactor->slots + fd) = (int)index;
+
+	logWrite(LOG_LEVEL_INFO, "Successfuly added file descriptor %d to the list of reactor, function handler address: %p.\n", fd, node->hdlr.handler_ptr);
+
+	return 0;
+}
+
+/*
+ * @brief Unregister a file descriptor from the handler table, on the reactor's thread.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @return void
+*/
+static void reactorRemoveFd(reactor_t_ptr reactor, int fd) {
+	int index = reactorSlotOf(reactor, fd);
+
+	if (index < 0)
+	{
+		fprintf(stderr, "%s removeFd() failed: %s\n", C_PREFIX_ERROR, strerror(ENOENT));
+		return;
+	}
+
+	reactorRemoveSlot(reactor, (size_t)index);
+
+	logWrite(LOG_LEVEL_INFO, "Removed file descriptor %d from the list of reactor.\n", fd);
+}
+
+/*
+ * @brief Replace the handler of a file descriptor, on the reactor's thread.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @param handler The new handler.
+ * @return void
+*/
+static void reactorModifyFd(reactor_t_ptr reactor, int fd, handler_t_reactor handler) {
+	int index = reactorSlotOf(reactor, fd);
+
+	if (index < 0)
+	{
+		fprintf(stderr, "%s modifyFd() failed: %s\n", C_PREFIX_ERROR, strerror(ENOENT));
+		return;
+	}
+
+	(*(reactor->nodes + index)).hdlr.handler = handler;
+}
+
+/*
+ * @brief Allocate a command for the reactor's command queue.
+ * @param type The kind of change.
+ * @param fd The file descriptor.
+ * @param handler The new handler, if any.
+ * @return A pointer to the command, or NULL on failure.
+*/
+static reactor_command_t_ptr reactorCommandCreate(reactor_command_type_t type, int fd, handler_t_reactor handler) {
+	reactor_command_t_ptr command = (reactor_command_t_ptr)malloc(sizeof(reactor_command_t));
+
+	if (command == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return NULL;
+	}
+
+	command->type = type;
+	command->fd = fd;
+	command->handler = handler;
+	command->next = NULL;
+
+	return command;
+}
+
+/*
+ * @brief Push a chain of commands to the reactor's command queue, from any thread.
+ * @param reactor A pointer to the reactor object.
+ * @param head The newest command of the chain.
+ * @param tail The oldest command of the chain.
+ * @return void
+ * @note The chain is linked newest first, like the queue itself, so it's pushed with a single compare-and-swap.
+ * @note The reactor is only woken up when the queue was empty, as it always takes the whole queue at once.
+*/
+static void reactorCommandPush(reactor_t_ptr reactor, reactor_command_t_ptr head, reactor_command_t_ptr tail) {
+	reactor_command_t_ptr old = atomic_load_explicit(&reactor->commands, memory_order_relaxed);
+
+	do
+	{
+		tail->next = old;
+	} while (!atomic_compare_exchange_weak_explicit(&reactor->commands, &old, head, memory_order_release, memory_order_relaxed));
+
+	if (old == NULL)
+		reactorWake(reactor);
+}
+
+/*
+ * @brief Apply all the queued commands, oldest first, on the reactor's thread.
+ * @param reactor A pointer to the reactor object.
+ * @return void
+ * @note The tables are grown once for all the queued additions.
+*/
+static void reactorCommandsApply(reactor_t_ptr reactor) {
+	reactor_command_t_ptr command = atomic_exchange_explicit(&reactor->commands, NULL, memory_order_acquire);
+	reactor_command_t_ptr oldest = NULL;
+	size_t adds = 0;
+	int max_fd = -1;
+
+	// The queue is newest first, so it's reversed.
+	while (command != NULL)
+	{
+		reactor_command_t_ptr next = command->next;
+
+		if (command->type == REACTOR_COMMAND_ADD)
+		{
+			adds++;
+
+			if (command->fd > max_fd)
+				max_fd = command->fd;
+		}
+
+		command->next = oldest;
+		oldest = command;
+		command = next;
+	}
+
+	if (max_fd >= 0 && reactorReserve(reactor, max_fd, adds) < 0)
+		fprintf(stderr, "%s realloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+
+	while (oldest != NULL)
+	{
+		reactor_command_t_ptr next = oldest->next;
+
+		switch (oldest->type)
+		{
+			case REACTOR_COMMAND_ADD:
+				reactorAddSlot(reactor, oldest->fd, oldest->handler);
+				break;
+
+			case REACTOR_COMMAND_REMOVE:
+				reactorRemoveFd(reactor, oldest->fd);
+				break;
+
+			case REACTOR_COMMAND_MODIFY:
+				reactorModifyFd(reactor, oldest->fd, oldest->handler);
+				break;
+		}
+
+		free(oldest);
+		oldest = next;
+	}
+}
+
+/*
+ * @brief The handler of the reactor's wakeup eventfd.
+ * @param fd The eventfd.
+ * @param react A pointer to the reactor object.
+ * @return The reactor object.
+ * @note Only clears the eventfd - the queue itself is applied at the end of the iteration,
+ * 			so the handler table doesn't change under the rest of the batch.
+*/
+static void *reactorWakeHandler(int fd, void *react) {
+	uint64_t value;
+
+	while (read(fd, &value, sizeof(value)) < 0 && errno == EINTR);
+
+	return react;
+}
+
+/*
+ * @brief Check whether an error event of a file descriptor only reports its socket's error queue.
+ * @param fd The file descriptor.
+ * @return true if the socket is healthy and only has error queue messages pending, false otherwise.
+ * @note The proactor's MSG_ZEROCOPY completions are queued there, and they raise POLLERR for every
+ * 			poller of the socket. The reactor keeps the client, and reads them with reactorErrorQueue().
+ * @note A real socket error is reported by the peek itself, in which case the client is dropped as before.
+*/
+static bool reactorErrorQueueOnly(int fd) {
+	int saved_errno = errno;
+	char byte;
+
+	ssize_t peeked = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+
+	// Data that arrived since the event was reported is fine too, the next iteration dispatches it.
+	bool ret = (peeked > 0 || (peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)));
+
+	errno = saved_errno;
+
+	return ret;
+}
+
+/*
+ * @brief Read a healthy socket's error queue, with the reactor's error queue handler if it has one.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @return The handler's return value, or the reactor object if the reactor discarded the messages itself.
+ * @note The error queue raises POLLERR until it's read, so it's always read here, rather than left to its owner.
+*/
+static void *reactorErrorQueue(reactor_t_ptr reactor, int fd) {
+	if (reactor->errqueue_handler != NULL)
+		return reactorCall(reactor, reactor->errqueue_handler, fd);
+
+	int saved_errno = errno;
+	char control[256];
+
+	while (true)
+	{
+		struct msghdr msg = { .msg_control = control, .msg_controllen = sizeof(control) };
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			break;
+	}
+
+	errno = saved_errno;
+
+	return reactor;
+}
+
+/*
+ * @brief Run a single iteration of the reactor using poll().
+ * @param reactor A pointer to the reactor object.
+ * @return 0 on success, -1 on a fatal error.
+ * @note The pollfd array is maintained incrementally by addFd() and the removals,
+ * 			so it's passed to poll() as is.
+*/
+static int reactorRunPoll(reactor_t_ptr reactor) {
+	int ret = poll(reactor->fds, reactor->size, reactorWaitTimeout(reactor));
+
+	reactorWokeUp(reactor);
+
+	if (ret < 0)
+	{
+		if (errno == EINTR)
+			return 0;
+
+		fprintf(stderr, "%s poll() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return -1;
+	}
+
+	else if (ret == 0)
+	{
+		// Waking up for a timer is the normal case.
+		if (reactor->timers.count == 0)
+			fprintf(stdout, "%s poll() timed out.\n", C_PREFIX_WARNING);
+
+		return 0;
+	}
+
+	size_t i = 0;
+
+	/*
+	 * The size is re-read on every iteration, as handlers may add entries (with no pending revents),
+	 * and a removal moves the last entry into the current index, which is then handled without advancing.
+	*/
+	while (i < reactor->size)
+	{
+		int fd = (*(reactor->fds + i)).fd;
+		short revents = (*(reactor->fds + i)).revents;
+		bool removed = false;
+
+		(*(reactor->fds + i)).revents = 0;
+
+		if (revents & POLLIN)
+		{
+			void *handler_ret = reactorCall(reactor, (*(reactor->nodes + i)).hdlr.handler, fd);
+			int index = reactorSlotOf(reactor, fd);
+
+			if (handler_ret == NULL && index > 0)
+			{
+				reactorRemoveSlot(reactor, (size_t)index);
+				removed = ((size_t)index == i);
+			}
+		}
+
+		else if ((revents & (POLLHUP | POLLNVAL | POLLERR)) && i != 0)
+		{
+			void *handler_ret = NULL;
+
+			if (!(revents & (POLLHUP | POLLNVAL)) && reactorErrorQueueOnly(fd))
+				handler_ret = reactorErrorQueue(reactor, fd);
+
+			int index = reactorSlotOf(reactor, fd);
+
+			if (handler_ret == NULL && index > 0)
+			{
+				reactorRemoveSlot(reactor, (size_t)index);
+				removed = ((size_t)index == i);
+			}
+		}
+
+		if (!removed)
+			i++;
+	}
+
+	return 0;
+}
+
+/*
+ * @brief Append a file descriptor to the reschedule list, unless it's there already.
+ * @param reactor A pointer to the reactor object.
+ * @param node A pointer to the file descriptor's handler table entry.
+ * @return void
+*/
+static void reactorReschedule(reactor_t_ptr reactor, reactor_node_ptr node) {
+	if (node->rescheduled)
+		return;
+
+	if (reactor->resched_count == reactor->resched_capacity)
+	{
+		size_t capacity = (reactor->resched_capacity == 0) ? REACTOR_INITIAL_CAPACITY : reactor->resched_capacity * 2;
+		int *resched = (int *)realloc(reactor->resched, capacity * sizeof(int));
+
+		if (resched == NULL)
+		{
+			fprintf(stderr, "%s realloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			return;
+		}
+
+		reactor->resched = resched;
+		reactor->resched_capacity = capacity;
+	}
+
+	node->rescheduled = true;
+	*(reactor->resched + reactor->resched_count++) = node->fd;
+}
+
+/*
+ * @brief Handle a handler's return value in the epoll backend.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor whose handler was called.
+ * @param handler_ret The handler's return value.
+ * @return void
+ * @note A file descriptor whose handler returned REACTOR_RESCHEDULE is appended to the reschedule list,
+ * 			once, and only in edge-triggered mode - the level-triggered mode reports it as ready again anyway.
+*/
+static void reactorEpollHandled(reactor_t_ptr reactor, int fd, void *handler_ret) {
+	// The handler may have added file descriptors, so the index is looked up again.
+	int index = reactorSlotOf(reactor, fd);
+
+	if (index < 0)
+		return;
+
+	reactor_node_ptr node = (reactor->nodes + index);
+
+	if (handler_ret == NULL)
+	{
+		if (index > 0)
+			reactorRemoveSlot(reactor, (size_t)index);
+
+		return;
+	}
+
+	if (handler_ret != REACTOR_RESCHEDULE || !reactor->edge_triggered)
+		return;
+
+	reactorReschedule(reactor, node);
+}
+
+/*
+ * @brief Call the handlers of the file descriptors in the reschedule list once more.
+ * @param reactor A pointer to the reactor object.
+ * @return void
+ * @note Only the entries that were in the list when the pass started are handled, so a file descriptor
+ * 			that's rescheduled again waits for the next pass, after the next batch of events.
+ * @note Entries of removed file descriptors are skipped, as their slot is gone (or belongs to a new
+ * 			registration, which isn't flagged).
+*/
+static void reactorEpollRescheduled(reactor_t_ptr reactor) {
+	size_t count = reactor->resched_count;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		int fd = *(reactor->resched + i);
+		int index = reactorSlotOf(reactor, fd);
+
+		if (index < 0 || !(*(reactor->nodes + index)).rescheduled)
+			continue;
+
+		(*(reactor->nodes + index)).rescheduled = false;
+
+		reactorEpollHandled(reactor, fd, reactorCall(reactor, (*(reactor->nodes + index)).hdlr.handler, fd));
+	}
+
+	reactor->resched_count -= count;
+
+	if (reactor->resched_count > 0)
+		memmove(reactor->resched, reactor->resched + count, reactor->resched_count * sizeof(int));
+}
+
+/*
+ * @brief Run a single iteration of the reactor using epoll_wait().
+ * @param reactor A pointer to the reactor object.
+ * @return 0 on success, -1 on a fatal error.
+ * @note Every file descriptor is already registered with the epoll instance,
+ * 			so only the ready file descriptors are touched.
+ * @note In edge-triggered mode, epoll_wait() doesn't block while the reschedule list isn't empty.
+*/
+static int reactorRunEpoll(reactor_t_ptr reactor) {
+	int timeout = (reactor->resched_count > 0) ? 0 : reactorWaitTimeout(reactor);
+	int ret = epoll_wait(reactor->epoll_fd, reactor->events, REACTOR_MAX_EVENTS, timeout);
+
+	reactorWokeUp(reactor);
+
+	if (ret < 0)
+	{
+		if (errno == EINTR)
+			return 0;
+
+		fprintf(stderr, "%s epoll_wait() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return -1;
+	}
+
+	else if (ret == 0)
+	{
+		// Waking up for a timer, or to go on with the reschedule list, is the normal case.
+		if (timeout != 0 && reactor->timers.count == 0)
+			fprintf(stdout, "%s epoll_wait() timed out.\n", C_PREFIX_WARNING);
+
+		// No new events doesn't mean the rescheduled file descriptors are done.
+		if (reactor->resched_count > 0)
+			reactorEpollRescheduled(reactor);
+
+		return 0;
+	}
+
+	for (int i = 0; i < ret; ++i)
+	{
+		int fd = (*(reactor->events + i)).data.fd;
+		uint32_t events = (*(reactor->events + i)).events;
+		int index = reactorSlotOf(reactor, fd);
+
+		// The file descriptor was removed by an earlier handler in this batch.
+		if (index < 0)
+			continue;
+
+		if (events & EPOLLIN)
+		{
+			// A new edge covers the pending reschedule, which is then skipped.
+			(*(reactor->nodes + index)).rescheduled = false;
+
+			reactorEpollHandled(reactor, fd, reactorCall(reactor, (*(reactor->nodes + index)).hdlr.handler, fd));
+		}
+
+		else if ((events & (EPOLLHUP | EPOLLERR)) && index > 0)
+		{
+			if ((events & EPOLLHUP) || !reactorErrorQueueOnly(fd))
+				reactorRemoveSlot(reactor, (size_t)index);
+
+			else
+				reactorEpollHandled(reactor, fd, reactorErrorQueue(reactor, fd));
+		}
+	}
+
+	if (reactor->resched_count > 0)
+		reactorEpollRescheduled(reactor);
+
+	return 0;
+}
+
+/*
+ * @brief Check whether a file descriptor has received data (or the end of its receive request) waiting in its overflow.
+ * @param node A pointer to the file descriptor's handler table entry.
+ * @return true if the next reactorRecv() is served from the overflow, false otherwise.
+*/
+static inline bool reactorUringOverflowed(reactor_node_ptr node) {
+	return (node->overflow != NULL || node->overflow_end);
+}
+
+/*
+ * @brief Move the part of the completion being dispatched that wasn't consumed yet into a file descriptor's overflow.
+ * @param reactor A pointer to the reactor object.
+ * @param node A pointer to the file descriptor's handler table entry.
+ * @return void
+ * @note The provided buffer is recycled right after the completion, so the data must be copied to survive it.
+ * @note A connection whose overflow would grow past REACTOR_URING_OVERFLOW is failed with ENOBUFS instead,
+ * 			as the kernel no longer holds the data back for a handler that doesn't consume it.
+*/
+static void reactorUringKeep(reactor_t_ptr reactor, reactor_node_ptr node) {
+	reactor_uring_t_ptr uring = reactor->uring;
+
+	if (uring->pending_fd != node->fd)
+		return;
+
+	uring->pending_fd = -1;
+
+	// Nothing is received after the end of the request.
+	if (node->overflow_end)
+		return;
+
+	if (uring->pending_res <= 0)
+	{
+		node->overflow_end = true;
+		node->overflow_res = uring->pending_res;
+		return;
+	}
+
+	size_t count = (size_t)uring->pending_res - uring->pending_off;
+	size_t kept = node->overflow_len - node->overflow_off;
+
+	if (kept + count > REACTOR_URING_OVERFLOW)
+	{
+		fprintf(stderr, "%s File descriptor %d left more than %d bytes unread, failing it.\n", C_PREFIX_ERROR, node->fd, REACTOR_URING_OVERFLOW);
+		node->overflow_end = true;
+		node->overflow_res = -ENOBUFS;
+		return;
+	}
+
+	// The consumed part is dropped on the way.
+	if (node->overflow_off > 0)
+		memmove(node->overflow, node->overflow + node->overflow_off, kept);
+
+	char *overflow = (char *)realloc(node->overflow, kept + count);
+
+	if (overflow == NULL)
+	{
+		fprintf(stderr, "%s realloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		node->overflow_end = true;
+		node->overflow_res = -ENOMEM;
+		return;
+	}
+
+	memcpy(overflow + kept, uring->pending_data + uring->pending_off, count);
+
+	node->overflow = overflow;
+	node->overflow_len = kept + count;
+	node->overflow_off = 0;
+}
+
+/*
+ * @brief Call a file descriptor's handler until it consumed everything it received, or stopped making progress.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor.
+ * @return The handler's last return value.
+*/
+static void *reactorUringCall(reactor_t_ptr reactor, int fd) {
+	reactor_uring_t_ptr uring = reactor->uring;
+	reactor_node_ptr node = (reactor->nodes + reactorSlotOf(reactor, fd));
+	void *handler_ret = NULL;
+
+	do
+	{
+		size_t off = uring->pending_off, overflow_off = node->overflow_off;
+		char *overflow = node->overflow;
+
+		handler_ret = reactorCall(reactor, node->hdlr.handler, fd);
+
+		int index = reactorSlotOf(reactor, fd);
+
+		if (handler_ret == NULL || index < 0)
+			break;
+
+		node = (reactor->nodes + index);
+
+		if (uring->pending_fd != fd && !reactorUringOverflowed(node))
+			break;
+
+		if (uring->pending_off == off && node->overflow == overflow && node->overflow_off == overflow_off)
+			break;
+	} while (true);
+
+	return handler_ret;
+}
+
+/*
+ * @brief Handle a handler's return value in the io_uring backend.
+ * @param reactor A pointer to the reactor object.
+ * @param fd The file descriptor whose handler was called.
+ * @param handler_ret The handler's return value.
+ * @return A pointer to the file descriptor's handler table entry, NULL if it was removed.
+ * @note A file descriptor whose overflow still holds data is appended to the reschedule list,
+ * 			as no completion may come to call its handler again.
+*/
+static reactor_node_ptr reactorUringHandled(reactor_t_ptr reactor, int fd, void *handler_ret) {
+	// The handler may have added file descriptors, so the index is looked up again.
+	int index = reactorSlotOf(reactor, fd);
+
+	if (index < 0)
+		return NULL;
+
+	reactor_node_ptr node = (reactor->nodes + index);
+
+	if (handler_ret == NULL && index > 0)
+	{
+		reactorRemoveSlot(reactor, (size_t)index);
+		return NULL;
+	}
+
+	if (reactorUringOverflowed(node))
+		reactorReschedule(reactor, node);
+
+	return node;
+}
+
+/*
+ * @brief Call the handlers of the file descriptors whose overflow still holds data once more.
+ * @param reactor A pointer to the reactor object.
+ * @return void
+ * @note Only the entries that were in the list when the pass started are handled, so a file descriptor
+ * 			that's rescheduled again waits for the next pass, after the next batch of completions.
+ * @note Entries of removed file descriptors are skipped, as their slot is gone (or belongs to a new
+ * 			registration, which isn't flagged).
+*/
+static void reactorUringRescheduled(reactor_t_ptr reactor) {
+	size_t count = reactor->resched_count;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		int fd = *(reactor->resched + i);
+		int index = reactorSlotOf(reactor, fd);
+
+		if (index < 0 || !(*(reactor->nodes + index)).rescheduled)
+			continue;
+
+		(*(reactor->nodes + index)).rescheduled = false;
+
+		// A completion that came in the meantime already called the handler.
+		if (!reactorUringOverflowed(reactor->nodes + index))
+			continue;
+
+		reactorUringHandled(reactor, fd, reactorUringCall(reactor, fd));
+	}
+
+	reactor->resched_count -= count;
+
+	if (reactor->resched_count > 0)
+		memmove(reactor->resched, reactor->resched + count, reactor->resched_count * sizeof(int));
+}
+
+/*
+ * @brief Dispatch a single completion of a multishot request to its handler.
+ * @param reactor A pointer to the reactor object.
+ * @param cqe A pointer to the completion.
+ * @return void
+*/
+static void reactorUringDispatch(reactor_t_ptr reactor, struct io_uring_cqe *cqe) {
+	reactor_uring_t_ptr uring = reactor->uring;
+	unsigned int request = (unsigned int)(cqe->user_data >> 56);
+	unsigned int generation = (unsigned int)(cqe->user_data >> 32) & 0xFFFFFF;
+	int fd = (int)(uint32_t)cqe->user_data;
+	bool has_buffer = (cqe->flags & IORING_CQE_F_BUFFER) != 0;
+	bool more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+	unsigned short bid = (unsigned short)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+	int index = reactorSlotOf(reactor, fd);
+	reactor_node_ptr node = (index >= 0) ? (reactor->nodes + index) : NULL;
+
+	// A completion of a cancel request, or of a file descriptor that was removed (or replaced) since.
+	if (request == REACTOR_URING_CANCEL || node == NULL || node->generation != generation || node->request != request)
+	{
+		if (has_buffer)
+			reactorUringRecycle(uring, bid);
+
+		if (request == REACTOR_URING_ACCEPT && cqe->res >= 0)
+			close(cqe->res);
+
+		return;
+	}
+
+	if (!more)
+		node->armed = false;
+
+	// Out of provided buffers, the request is re-armed once the buffers are recycled.
+	if (request == REACTOR_URING_RECV && cqe->res == -ENOBUFS)
+	{
+		reactorUringArm(reactor, node);
+		return;
+	}
+
+	if (request == REACTOR_URING_POLL && cqe->res >= 0 && !(cqe->res & POLLIN))
+	{
+		if ((cqe->res & (POLLHUP | POLLERR | POLLNVAL)) && index > 0)
+			reactorRemoveSlot(reactor, (size_t)index);
+
+		return;
+	}
+
+	if (request == REACTOR_URING_ACCEPT && cqe->res < 0)
+	{
+		fprintf(stderr, "%s io_uring accept failed: %s\n", C_PREFIX_ERROR, strerror(-cqe->res));
+
+		if (!node->armed)
+			reactorUringArm(reactor, node);
+
+		return;
+	}
+
+	// Poll completions only report readiness, the handler reads by itself.
+	uring->pending_fd = (request == REACTOR_URING_POLL) ? -1 : fd;
+	uring->pending_res = cqe->res;
+	uring->pending_data = has_buffer ? (uring->buffers + (size_t)bid * MAX_BUFFER) : NULL;
+	uring->pending_off = 0;
+
+	// Data that's still waiting in the overflow must be received first, so the completion joins it.
+	if (request == REACTOR_URING_RECV && reactorUringOverflowed(node))
+		reactorUringKeep(reactor, node);
+
+	void *handler_ret = reactorUringCall(reactor, fd);
+
+	// An accepted connection the handler didn't take would leak otherwise.
+	if (request == REACTOR_URING_ACCEPT && uring->pending_fd == fd)
+		close(uring->pending_res);
+
+	// Whatever the handler didn't consume is kept for its next call, as poll() and epoll would report it again.
+	index = reactorSlotOf(reactor, fd);
+
+	if (request == REACTOR_URING_RECV && handler_ret != NULL && index >= 0)
+		reactorUringKeep(reactor, (reactor->nodes + index));
+
+	uring->pending_fd = -1;
+	uring->pending_data = NULL;
+
+	if (has_buffer)
+		reactorUringRecycle(uring, bid);
+
+	node = reactorUringHandled(reactor, fd, handler_ret);
+
+	// A terminated request is re-armed, unless it ended because the peer closed the connection or failed.
+	if (node != NULL && !node->armed && (request != REACTOR_URING_RECV || cqe->res > 0))
+		reactorUringArm(reactor, node);
+}
+
+/*
+ * @brief Run a single iteration of the reactor using io_uring.
+ * @param reactor A pointer to the reactor object.
+ * @return 0 on success, -1 on a fatal error.
+ * @note All the entries prepared during the previous iteration (new registrations, cancellations
+ * 			and re-armed requests) are submitted by the same io_uring_enter() call that waits.
+*/
+static int reactorRunUring(reactor_t_ptr reactor) {
+	reactor_uring_t_ptr uring = reactor->uring;
+	int timeout = (reactor->resched_count > 0) ? 0 : reactorWaitTimeout(reactor);
+	int ret = reactorUringEnter(uring, true, timeout);
+
+	reactorWokeUp(reactor);
+
+	if (ret < 0 && ret != -ETIME)
+	{
+		if (ret == -EINTR)
+			return 0;
+
+		fprintf(stderr, "%s io_uring_enter() failed: %s\n", C_PREFIX_ERROR, strerror(-ret));
+		return -1;
+	}
+
+	unsigned int head = *uring->cq_head;
+	unsigned int tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+	// Waking up for a timer, or to go on with the reschedule list, is the normal case.
+	if (head == tail && ret == -ETIME && timeout != 0 && reactor->timers.count == 0)
+		fprintf(stdout, "%s io_uring_enter() timed out.\n", C_PREFIX_WARNING);
+
+	while (head != tail)
+	{
+		reactorUringDispatch(reactor, (uring->cqes + (head & *uring->cq_mask)));
+		head++;
+	}
+
+	__atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+	__atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+
+	if (reactor->resched_count > 0)
+		reactorUringRescheduled(reactor);
+
+	return 0;
+}
 
 void *reactorRun(void *react) {
 	if (react == NULL)
@@ -38,127 +1785,189 @@ void *reactorRun(void *react) {
 
 	while (reactor->running)
 	{
-		size_t size = 0, i = 0;
-		reactor_node_ptr curr = reactor->head;
+		int ret = 0;
 
-		while (curr != NULL)
+		switch (reactor->backend)
 		{
-			size++;
-			curr = curr->next;
-		}
+			case REACTOR_BACKEND_EPOLL:
+				ret = reactorRunEpoll(reactor);
+				break;
 
-		curr = reactor->head;
+			case REACTOR_BACKEND_URING:
+				ret = reactorRunUring(reactor);
+				break;
 
-		reactor->fds = (pollfd_t_ptr)calloc(size, sizeof(pollfd_t));
+			default:
+				ret = reactorRunPoll(reactor);
+				break;
+		}
 
-		if (reactor->fds == NULL)
-		{
-			fprintf(stderr, "%s reactorRun() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		if (ret < 0)
 			return NULL;
-		}
 
-		while (curr != NULL)
-		{
-			(*(reactor->fds + i)).fd = curr->fd;
-			(*(reactor->fds + i)).events = POLLIN;
+		reactorTimersExpire(reactor);
 
-			curr = curr->next;
-			i++;
-		}
+		if (atomic_load_explicit(&reactor->commands, memory_order_relaxed) != NULL)
+			reactorCommandsApply(reactor);
+	}
 
-		int ret = poll(reactor->fds, i, POLL_TIMEOUT);
+	fprintf(stdout, "%s Reactor thread finished.\n", C_PREFIX_INFO);
 
-		if (ret < 0)
-		{
-			fprintf(stderr, "%s poll() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-			free(reactor->fds);
-			reactor->fds = NULL;
-			return NULL;
-		}
+	return reactor;
+}
 
-		else if (ret == 0)
-		{
-			fprintf(stdout, "%s poll() timed out.\n", C_PREFIX_WARNING);
-			free(reactor->fds);
-			reactor->fds = NULL;
-			continue;
-		}
+void *createReactor() {
+	reactor_backend_t backend = REACTOR_BACKEND;
+	char *env = getenv("REACTOR_BACKEND");
 
-		for (i = 0; i < size; ++i)
-		{
-			if ((*(reactor->fds + i)).revents & POLLIN)
-			{
-				reactor_node_ptr curr = reactor->head;
+	if (env != NULL)
+	{
+		if (strcmp(env, "poll") == 0)
+			backend = REACTOR_BACKEND_POLL;
 
-				for (unsigned int j = 0; j < i; ++j)
-					curr = curr->next;
+		else if (strcmp(env, "epoll") == 0)
+			backend = REACTOR_BACKEND_EPOLL;
 
-				void *handler_ret = curr->hdlr.handler((*(reactor->fds + i)).fd, reactor);
+		else if (strcmp(env, "uring") == 0)
+			backend = REACTOR_BACKEND_URING;
 
-				if (handler_ret == NULL && (*(reactor->fds + i)).fd != reactor->head->fd)
-				{
-					reactor_node_ptr curr_node = reactor->head;
-					reactor_node_ptr prev_node = NULL;
+		else
+			fprintf(stderr, "%s Unknown reactor backend \"%s\", using the default one.\n", C_PREFIX_WARNING, env);
+	}
 
-					while (curr_node != NULL && curr_node->fd != (*(reactor->fds + i)).fd)
-					{
-						prev_node = curr_node;
-						curr_node = curr_node->next;
-					}
+	return createReactorBackend(backend);
+}
 
-					prev_node->next = curr_node->next;
+void *createReactorBackend(reactor_backend_t backend) {
+	reactor_t_ptr react = NULL;
 
-					free(curr_node);
-				}
+	if (backend != REACTOR_BACKEND_POLL && backend != REACTOR_BACKEND_EPOLL && backend != REACTOR_BACKEND_URING)
+	{
+		errno = EINVAL;
+		fprintf(stderr, "%s createReactorBackend() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return NULL;
+	}
 
-				continue;
-			}
+	fprintf(stdout, "%s Creating reactor...\n", C_PREFIX_INFO);
 
-			else if (((*(reactor->fds + i)).revents & POLLHUP || (*(reactor->fds + i)).revents & POLLNVAL || (*(reactor->fds + i)).revents & POLLERR) && (*(reactor->fds + i)).fd != reactor->head->fd)
-			{
-				reactor_node_ptr curr_node = reactor->head;
-				reactor_node_ptr prev_node = NULL;
+	if ((react = (reactor_t_ptr)malloc(sizeof(reactor_t))) == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return NULL;
+	}
+
+	atomic_init(&react->has_thread, false);
+	react->nodes = NULL;
+	react->fds = NULL;
+	react->slots = NULL;
+	react->size = 0;
+	react->capacity = 0;
+	react->slots_size = 0;
+	react->backend = backend;
+	react->epoll_fd = -1;
+	react->events = NULL;
+	react->uring = NULL;
+	react->edge_triggered = false;
+	react->read_budget = REACTOR_READ_BUDGET;
+	react->poll_timeout = POLL_TIMEOUT;
+
+#if LATENCY_HISTOGRAMS
+	react->woke = 0;
+	memset(&react->dispatch_latency, 0, sizeof(histogram_t));
+	memset(&react->handler_latency, 0, sizeof(histogram_t));
+#endif
+	react->resched = NULL;
+	react->resched_count = 0;
+	react->resched_capacity = 0;
+	react->errqueue_handler = NULL;
+	atomic_init(&react->commands, NULL);
+
+	reactorTimerWheelInit(&react->timers);
+	react->running = false;
+
+	reactorBufferPoolInit(&react->buffers);
+
+	if ((react->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+	{
+		fprintf(stderr, "%s eventfd() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		free(react);
+		return NULL;
+	}
 
-				while (curr_node != NULL && curr_node->fd != (*(reactor->fds + i)).fd)
-				{
-					prev_node = curr_node;
-					curr_node = curr_node->next;
-				}
+	if (backend == REACTOR_BACKEND_URING && (react->uring = reactorUringCreate()) == NULL)
+	{
+		fprintf(stderr, "%s io_uring is unavailable (%s), falling back to epoll.\n", C_PREFIX_WARNING, strerror(errno));
+		react->backend = backend = REACTOR_BACKEND_EPOLL;
+	}
 
-				prev_node->next = curr_node->next;
+	if (backend == REACTOR_BACKEND_EPOLL)
+	{
+		if ((react->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		{
+			fprintf(stderr, "%s epoll_create1() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			close(react->wake_fd);
+			free(react);
+			return NULL;
+		}
 
-				free(curr_node);
-			}
+		if ((react->events = (epoll_event_t_ptr)calloc(REACTOR_MAX_EVENTS, sizeof(epoll_event_t))) == NULL)
+		{
+			fprintf(stderr, "%s calloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+			close(react->epoll_fd);
+			close(react->wake_fd);
+			free(react);
+			return NULL;
 		}
 
-		free(reactor->fds);
-		reactor->fds = NULL;
+		char *env = getenv("REACTOR_EDGE_TRIGGERED");
+
+		react->edge_triggered = (env != NULL) ? (strcmp(env, "0") != 0) : (REACTOR_EDGE_TRIGGERED != 0);
 	}
 
-	fprintf(stdout, "%s Reactor thread finished.\n", C_PREFIX_INFO);
+	fprintf(stdout, "%s Reactor created (backend: %s%s).\n", C_PREFIX_INFO, (backend == REACTOR_BACKEND_URING ? "io_uring" : (backend == REACTOR_BACKEND_EPOLL ? "epoll" : "poll")), (react->edge_triggered ? ", edge-triggered" : ""));
 
-	return reactor;
+	return react;
 }
 
-void *createReactor() {
-	reactor_t_ptr react = NULL;
+void destroyReactor(void *react) {
+	if (react == NULL)
+	{
+		fprintf(stderr, "%s destroyReactor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return;
+	}
 
-	fprintf(stdout, "%s Creating reactor...\n", C_PREFIX_INFO);
+	reactor_t_ptr reactor = (reactor_t_ptr)react;
 
-	if ((react = (reactor_t_ptr)malloc(sizeof(reactor_t))) == NULL)
+	if (reactorHasThread(reactor))
+		stopReactor(reactor);
+
+	// Additions that were queued after the reactor stopped are still its file descriptors.
+	reactorCommandsApply(reactor);
+
+	for (size_t i = 0; i < reactor->size; ++i)
 	{
-		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		return NULL;
+		if ((*(reactor->nodes + i)).fd != reactor->wake_fd)
+			close((*(reactor->nodes + i)).fd);
+
+		free((*(reactor->nodes + i)).overflow);
 	}
 
-	react->thread = 0;
-	react->head = NULL;
-	react->fds = NULL;
-	react->running = false;
+	close(reactor->wake_fd);
 
-	fprintf(stdout, "%s Reactor created.\n", C_PREFIX_INFO);
+	if (reactor->epoll_fd >= 0)
+		close(reactor->epoll_fd);
 
-	return react;
+	reactorUringDestroy(reactor->uring);
+	free(reactor->events);
+	free(reactor->nodes);
+	free(reactor->fds);
+	free(reactor->slots);
+	free(reactor->resched);
+
+	if (reactor->buffers.arena != NULL)
+		munmap(reactor->buffers.arena, reactor->buffers.arena_size);
+
+	free(reactor);
 }
 
 void startReactor(void *react) {
@@ -170,13 +1979,13 @@ void startReactor(void *react) {
 
 	reactor_t_ptr reactor = (reactor_t_ptr)react;
 
-	if (reactor->head == NULL)
+	if (reactor->size == 0)
 	{
 		fprintf(stderr, "%s Tried to start a reactor without registered file descriptors.\n", C_PREFIX_WARNING);
 		return;
 	}
 
-	else if (reactor->running)
+	else if (reactorHasThread(reactor))
 	{
 		fprintf(stderr, "%s Tried to start a reactor that's already running.\n", C_PREFIX_WARNING);
 		return;
@@ -184,6 +1993,11 @@ void startReactor(void *react) {
 
 	fprintf(stdout, "%s Starting reactor thread...\n", C_PREFIX_INFO);
 
+	// The wakeup eventfd is registered after the first file descriptor, which is never removed.
+	// Without it the thread could never be stopped, so the reactor isn't started at all.
+	if (reactorSlotOf(reactor, reactor->wake_fd) < 0 && reactorAddSlot(reactor, reactor->wake_fd, reactorWakeHandler) < 0)
+		return;
+
 	reactor->running = true;
 
 	int ret_val = pthread_create(&reactor->thread, NULL, reactorRun, react);
@@ -192,10 +2006,11 @@ void startReactor(void *react) {
 	{
 		fprintf(stderr, "%s pthread_create() failed: %s\n", C_PREFIX_ERROR, strerror(ret_val));
 		reactor->running = false;
-		reactor->thread = 0;
 		return;
 	}
 
+	atomic_store_explicit(&reactor->has_thread, true, memory_order_release);
+
 	fprintf(stdout, "%s Reactor thread started.\n", C_PREFIX_INFO);
 }
 
@@ -207,9 +2022,8 @@ void stopReactor(void *react) {
 	}
 
 	reactor_t_ptr reactor = (reactor_t_ptr)react;
-	void *ret = NULL;
 
-	if (!reactor->running)
+	if (!reactorHasThread(reactor))
 	{
 		fprintf(stderr, "%s Tried to stop a reactor that's not currently running.\n", C_PREFIX_WARNING);
 		return;
@@ -217,109 +2031,490 @@ void stopReactor(void *react) {
 
 	fprintf(stdout, "%s Stopping reactor thread gracefully...\n", C_PREFIX_INFO);
 
+	// The thread finishes its current iteration and returns, so it's woken up in case it's waiting.
 	reactor->running = false;
+	reactorWake(reactor);
 
-	/*
-	 * In case the thread is blocked on poll(), we ensure that the thread
-	 * is cancelled by joining and detaching it.
-	 * This prevents memory leaks.
-	*/
-	int ret_val = pthread_cancel(reactor->thread);
+	// A handler can't join its own thread, so WaitFor() (or stopReactor() from another thread) joins it.
+	if (pthread_equal(pthread_self(), reactor->thread))
+		return;
 
-	if (ret_val != 0)
+	WaitFor(reactor);
+
+	fprintf(stdout, "%s Reactor thread stopped.\n", C_PREFIX_INFO);
+}
+
+int addFd(void *react, int fd, handler_t_reactor handler) {
+	if (react == NULL || handler == NULL || fd < 0 || fcntl(fd, F_GETFL) == -1)
+	{
+		fprintf(stderr, "%s addFd() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		errno = EINVAL;
+		return -1;
+	}
+
+	reactor_t_ptr reactor = (reactor_t_ptr)react;
+
+	if (reactorOwned(reactor))
+		return reactorAddSlot(reactor, fd, handler);
+
+	reactor_command_t_ptr command = reactorCommandCreate(REACTOR_COMMAND_ADD, fd, handler);
+
+	if (command == NULL)
+		return -1;
+
+	reactorCommandPush(reactor, command, command);
+
+	return 0;
+}
+
+size_t addFds(void *react, const int *fds, size_t count, handler_t_reactor handler) {
+	if (react == NULL || (fds == NULL && count > 0))
+	{
+		fprintf(stderr, "%s addFds() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		errno = EINVAL;
+		return 0;
+	}
+
+	reactor_t_ptr reactor = (reactor_t_ptr)react;
+	int max_fd = -1;
+
+	// Another thread queues the whole batch at once, and the reactor grows its tables once when it applies it.
+	if (!reactorOwned(reactor))
+	{
+		reactor_command_t_ptr head = NULL, tail = NULL;
+		size_t queued = 0;
+
+		for (; queued < count; ++queued)
+		{
+			int fd = *(fds + queued);
+
+			if (handler == NULL || fd < 0 || fcntl(fd, F_GETFL) == -1)
+			{
+				fprintf(stderr, "%s addFds() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+				errno = EINVAL;
+				break;
+			}
+
+			reactor_command_t_ptr command = reactorCommandCreate(REACTOR_COMMAND_ADD, fd, handler);
+
+			if (command == NULL)
+				break;
+
+			// The chain is built newest first, like the queue.
+			command->next = head;
+			head = command;
+
+			if (tail == NULL)
+				tail = command;
+		}
+
+		if (head != NULL)
+			reactorCommandPush(reactor, head, tail);
+
+		return queued;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (*(fds + i) > max_fd)
+			max_fd = *(fds + i);
+	}
+
+	// The tables grow once for the whole batch, so the additions below never reallocate.
+	if (max_fd >= 0 && reactorReserve(reactor, max_fd, count) < 0)
+	{
+		fprintf(stderr, "%s realloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return 0;
+	}
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (addFd(react, *(fds + i), handler) < 0)
+			return i;
+	}
+
+	return count;
+}
+
+void WaitFor(void *react) {
+	if (react == NULL)
 	{
-		fprintf(stderr, "%s pthread_cancel() failed: %s\n", C_PREFIX_ERROR, strerror(ret_val));
+		fprintf(stderr, "%s WaitFor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
 		return;
 	}
 
-	ret_val = pthread_join(reactor->thread, &ret);
+	reactor_t_ptr reactor = (reactor_t_ptr)react;
+	void *ret = NULL;
+
+	if (!reactorHasThread(reactor))
+		return;
+
+	fprintf(stdout, "%s Reactor thread joined.\n", C_PREFIX_INFO);
 
+	int ret_val = pthread_join(reactor->thread, &ret);
+	
 	if (ret_val != 0)
 	{
 		fprintf(stderr, "%s pthread_join() failed: %s\n", C_PREFIX_ERROR, strerror(ret_val));
 		return;
 	}
 
+	// Reset reactor pthread.
+	atomic_store_explicit(&reactor->has_thread, false, memory_order_release);
+	reactor->running = false;
+
 	if (ret == NULL)
-	{
 		fprintf(stderr, "%s Reactor thread fatal error: %s", C_PREFIX_ERROR, strerror(errno));
-		return;
+}
+
+ssize_t reactorRecv(void *react, int fd, void *buf, size_t len) {
+	if (react == NULL || buf == NULL)
+	{
+		errno = EINVAL;
+		return -1;
 	}
 
-	// Free the reactor's file descriptors.
-	if (reactor->fds != NULL)
+	reactor_t_ptr reactor = (reactor_t_ptr)react;
+	reactor_uring_t_ptr uring = reactor->uring;
+
+	if (reactor->backend != REACTOR_BACKEND_URING)
+		return recv(fd, buf, len, 0);
+
+	int index = reactorSlotOf(reactor, fd);
+	reactor_node_ptr node = (index >= 0) ? (reactor->nodes + index) : NULL;
+
+	// Data an earlier call of the handler left behind comes before the completion being dispatched.
+	if (node != NULL && reactorUringOverflowed(node))
 	{
-		free(reactor->fds);
-		reactor->fds = NULL;
+		if (node->overflow == NULL)
+		{
+			node->overflow_end = false;
+
+			if (node->overflow_res == 0)
+				return 0;
+
+			errno = -node->overflow_res;
+			return -1;
+		}
+
+		size_t avail = node->overflow_len - node->overflow_off;
+		size_t count = (len < avail) ? len : avail;
+
+		memcpy(buf, node->overflow + node->overflow_off, count);
+		node->overflow_off += count;
+
+		if (node->overflow_off == node->overflow_len)
+		{
+			free(node->overflow);
+			node->overflow = NULL;
+			node->overflow_len = node->overflow_off = 0;
+		}
+
+		return (ssize_t)count;
 	}
-	
-	// Reset reactor pthread.
-	reactor->thread = 0;
 
-	fprintf(stdout, "%s Reactor thread stopped.\n", C_PREFIX_INFO);
-}
+	if (uring->pending_fd != fd)
+	{
+		// Only stream sockets have a multishot receive request, anything else is read directly.
+		if (node == NULL || node->request != REACTOR_URING_RECV)
+			return recv(fd, buf, len, 0);
+
+		errno = EAGAIN;
+		return -1;
+	}
 
-void addFd(void *react, int fd, handler_t_reactor handler) {
-	if (react == NULL || handler == NULL || fd < 0 || fcntl(fd, F_GETFL) == -1 || errno == EBADF)
+	if (uring->pending_res <= 0)
 	{
-		fprintf(stderr, "%s addFd() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
-		return;
+		int res = uring->pending_res;
+
+		uring->pending_fd = -1;
+
+		if (res == 0)
+			return 0;
+
+		errno = -res;
+		return -1;
 	}
 
-	fprintf(stdout, "%s Adding file descriptor %d to the list.\n", C_PREFIX_INFO, fd);
+	size_t avail = (size_t)uring->pending_res - uring->pending_off;
+	size_t count = (len < avail) ? len : avail;
+
+	memcpy(buf, uring->pending_data + uring->pending_off, count);
+	uring->pending_off += count;
+
+	if (uring->pending_off == (size_t)uring->pending_res)
+		uring->pending_fd = -1;
+
+	return (ssize_t)count;
+}
+
+int reactorAccept(void *react, int fd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+	if (react == NULL)
+	{
+		errno = EINVAL;
+		return -1;
+	}
 
 	reactor_t_ptr reactor = (reactor_t_ptr)react;
-	reactor_node_ptr node = (reactor_node_ptr)malloc(sizeof(reactor_node));
+	reactor_uring_t_ptr uring = reactor->uring;
 
-	if (node == NULL)
+	if (reactor->backend != REACTOR_BACKEND_URING)
+		return accept4(fd, addr, addrlen, flags);
+
+	if (uring->pending_fd != fd)
 	{
-		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
-		return;
+		errno = EAGAIN;
+		return -1;
 	}
 
-	node->fd = fd;
-	node->hdlr.handler = handler;
-	node->next = NULL;
+	int client_fd = uring->pending_res;
+
+	uring->pending_fd = -1;
+
+	// Multishot accept can't report the peer's address, so it's fetched only when it's needed.
+	if (addr != NULL && addrlen != NULL && getpeername(client_fd, addr, addrlen) < 0)
+		memset(addr, 0, *addrlen);
+
+	// The connection was accepted with SOCK_CLOEXEC already.
+	if ((flags & SOCK_NONBLOCK) && fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK) < 0)
+	{
+		int saved_errno = errno;
+		close(client_fd);
+		errno = saved_errno;
+		return -1;
+	}
+
+	return client_fd;
+}
+
+void reactorSetErrorQueueHandler(void *react, handler_t_reactor handler) {
+	if (react != NULL)
+		((reactor_t_ptr)react)->errqueue_handler = handler;
+}
+
+void *reactorBufferAlloc(void *react, size_t size) {
+	if (react == NULL)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	reactor_buffer_pool_t_ptr pool = &((reactor_t_ptr)react)->buffers;
+	reactor_buffer_class_t_ptr class = NULL;
+	void *buf = NULL;
+
+	for (size_t i = 0; i < REACTOR_BUFFER_CLASSES; ++i)
+	{
+		if (size <= (pool->classes + i)->size)
+		{
+			class = (pool->classes + i);
+			break;
+		}
+	}
 
-	if (reactor->head == NULL)
-		reactor->head = node;
+	if (class == NULL)
+		++pool->oversized;
 
 	else
 	{
-		reactor_node_ptr curr = reactor->head;
+		if (pool->arena == NULL && !pool->disabled && reactorBufferPoolMap(pool) < 0)
+		{
+			fprintf(stderr, "%s mmap() failed, receive buffers fall back to malloc(): %s\n", C_PREFIX_ERROR, strerror(errno));
+			pool->disabled = true;
+		}
+
+		if ((buf = class->free_head) != NULL)
+		{
+			class->free_head = *(void **)buf;
+			++class->hits;
+		}
 
-		while (curr->next != NULL)
-			curr = curr->next;
+		else
+			++class->misses;
+	}
 
-		curr->next = node;
+	if (buf == NULL && (buf = malloc(size)) == NULL)
+	{
+		fprintf(stderr, "%s malloc() failed: %s\n", C_PREFIX_ERROR, strerror(errno));
+		return NULL;
 	}
 
-	fprintf(stdout, "%s Successfuly added file descriptor %d to the list of reactor, function handler address: %p.\n", C_PREFIX_INFO, fd, node->hdlr.handler_ptr);
+	if (++pool->in_use > pool->high_water)
+		pool->high_water = pool->in_use;
+
+	return buf;
 }
 
-void WaitFor(void *react) {
+void reactorBufferFree(void *react, void *buf) {
+	if (react == NULL || buf == NULL)
+		return;
+
+	reactor_buffer_pool_t_ptr pool = &((reactor_t_ptr)react)->buffers;
+	char *ptr = (char *)buf;
+
+	--pool->in_use;
+
+	if (pool->arena == NULL || ptr < pool->arena || ptr >= pool->arena + pool->arena_size)
+	{
+		free(buf);
+		return;
+	}
+
+	// The classes are laid out one after the other, so the buffer belongs to the last class that starts at or before it.
+	size_t offset = (size_t)(ptr - pool->arena);
+	reactor_buffer_class_t_ptr class = pool->classes;
+
+	for (size_t i = 1; i < REACTOR_BUFFER_CLASSES && (pool->classes + i)->offset <= offset; ++i)
+		class = (pool->classes + i);
+
+	*(void **)buf = class->free_head;
+	class->free_head = buf;
+}
+
+void reactorBufferStats(void *react, reactor_buffer_stats_t_ptr stats) {
+	if (stats == NULL)
+		return;
+
+	memset(stats, 0, sizeof(reactor_buffer_stats_t));
+
 	if (react == NULL)
+		return;
+
+	reactor_buffer_pool_t_ptr pool = &((reactor_t_ptr)react)->buffers;
+
+	for (size_t i = 0; i < REACTOR_BUFFER_CLASSES; ++i)
 	{
-		fprintf(stderr, "%s WaitFor() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		stats->hits += (pool->classes + i)->hits;
+		stats->misses += (pool->classes + i)->misses;
+	}
+
+	stats->oversized = pool->oversized;
+	stats->in_use = pool->in_use;
+	stats->high_water = pool->high_water;
+}
+
+bool reactorEdgeTriggered(void *react) {
+	return (react != NULL && ((reactor_t_ptr)react)->edge_triggered);
+}
+
+size_t reactorReadBudget(void *react) {
+	return (react != NULL) ? ((reactor_t_ptr)react)->read_budget : REACTOR_READ_BUDGET;
+}
+
+void reactorSetPollTimeout(void *react, int timeout) {
+	if (react != NULL)
+		((reactor_t_ptr)react)->poll_timeout = (timeout < 0) ? -1 : timeout;
+}
+
+void removeFd(void *react, int fd) {
+	if (react == NULL || fd < 0)
+	{
+		fprintf(stderr, "%s removeFd() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
 		return;
 	}
 
 	reactor_t_ptr reactor = (reactor_t_ptr)react;
-	void *ret = NULL;
 
-	if (!reactor->running)
+	if (reactorOwned(reactor))
+	{
+		reactorRemoveFd(reactor, fd);
+		return;
+	}
+
+	reactor_command_t_ptr command = reactorCommandCreate(REACTOR_COMMAND_REMOVE, fd, NULL);
+
+	if (command != NULL)
+		reactorCommandPush(reactor, command, command);
+}
+
+void modifyFd(void *react, int fd, handler_t_reactor handler) {
+	if (react == NULL || handler == NULL || fd < 0)
+	{
+		fprintf(stderr, "%s modifyFd() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
 		return;
+	}
 
-	fprintf(stdout, "%s Reactor thread joined.\n", C_PREFIX_INFO);
+	reactor_t_ptr reactor = (reactor_t_ptr)react;
 
-	int ret_val = pthread_join(reactor->thread, &ret);
-	
-	if (ret_val != 0)
+	if (reactorOwned(reactor))
 	{
-		fprintf(stderr, "%s pthread_join() failed: %s\n", C_PREFIX_ERROR, strerror(ret_val));
+		reactorModifyFd(reactor, fd, handler);
 		return;
 	}
 
-	if (ret == NULL)
-		fprintf(stderr, "%s Reactor thread fatal error: %s", C_PREFIX_ERROR, strerror(errno));
-}
\ No newline at end of file
+	reactor_command_t_ptr command = reactorCommandCreate(REACTOR_COMMAND_MODIFY, fd, handler);
+
+	if (command != NULL)
+		reactorCommandPush(reactor, command, command);
+}
+
+void reactorTimerInit(reactor_timer_t_ptr timer, handler_t_timer handler, void *arg) {
+	timer->link.next = timer->link.prev = NULL;
+	timer->expires = 0;
+	timer->period = 0;
+	timer->handler = handler;
+	timer->arg = arg;
+	timer->slot = -1;
+	timer->armed = false;
+}
+
+void reactorTimerArm(void *react, reactor_timer_t_ptr timer, uint64_t delay, uint64_t period) {
+	if (react == NULL || timer == NULL || timer->handler == NULL)
+	{
+		fprintf(stderr, "%s reactorTimerArm() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return;
+	}
+
+	reactor_timer_wheel_t_ptr wheel = &((reactor_t_ptr)react)->timers;
+
+	if (timer->armed)
+		reactorTimerUnlink(wheel, timer);
+
+	else
+		wheel->count++;
+
+	// Rounded up, so a timer never expires early - and always after the tick that was already expired.
+	timer->expires = (wheel->now + delay + REACTOR_TIMER_TICK - 1) / REACTOR_TIMER_TICK;
+	timer->period = (period + REACTOR_TIMER_TICK - 1) / REACTOR_TIMER_TICK;
+	timer->armed = true;
+
+	if (timer->expires <= wheel->tick)
+		timer->expires = wheel->tick + 1;
+
+	reactorTimerLink(wheel, timer);
+}
+
+void reactorTimerCancel(void *react, reactor_timer_t_ptr timer) {
+	if (react == NULL || timer == NULL)
+	{
+		fprintf(stderr, "%s reactorTimerCancel() failed: %s\n", C_PREFIX_ERROR, strerror(EINVAL));
+		return;
+	}
+
+	if (!timer->armed)
+		return;
+
+	reactor_timer_wheel_t_ptr wheel = &((reactor_t_ptr)react)->timers;
+
+	reactorTimerUnlink(wheel, timer);
+	timer->armed = false;
+	wheel->count--;
+}
+
+uint64_t reactorNow(void *react) {
+	return (react != NULL) ? ((reactor_t_ptr)react)->timers.now : reactorClock();
+}
+
+bool reactorRunning(void *react) {
+	return (react != NULL && reactorHasThread((reactor_t_ptr)react));
+}
+
+#if LATENCY_HISTOGRAMS
+void reactorLatency(void *react, histogram_snapshot_t_ptr dispatch, histogram_snapshot_t_ptr handler) {
+	if (react == NULL || dispatch == NULL || handler == NULL)
+		return;
+
+	histogramMerge(dispatch, &((reactor_t_ptr)react)->dispatch_latency);
+	histogramMerge(handler, &((reactor_t_ptr)react)->handler_latency);
+}
+#endif
\ No newline at end of file